@@ -0,0 +1,777 @@
+/*
+ * contents: B+-Tree ADT.
+ * arch-tag: f70d51b0-af91-45ef-b45d-b81e4093a7e6
+ *
+ * Copyright (C) 2004 Nikolai Weibull <source@pcppopper.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+
+
+#include <string.h>
+#include <clear/internal.h>
+#include <clear/mem.h>
+#include "btree.h"
+
+
+/* {{{1
+ * The order of our tree, i.e. the maximum number of children of an inner
+ * node.  Leaves hold at most ‘B_TREE_MAX_KEYS’ key/value pairs.  All nodes but
+ * the root hold at least ‘B_TREE_MIN_KEYS’ keys.  With the value below, the
+ * keys of a node fit in two cache lines on most architectures, and searching
+ * a node touches at most four (including its children or values).
+ */
+#define B_TREE_ORDER		16
+#define B_TREE_MAX_KEYS		(B_TREE_ORDER - 1)
+#define B_TREE_MIN_KEYS		(B_TREE_MAX_KEYS / 2)
+
+
+/* {{{1
+ * Type definitions: We need a node type and our tree structure.
+ */
+
+
+/* {{{2
+ * Our node type.  A node is either an inner node or a leaf, as told by
+ * ‘leaf’, and contains ‘n’ keys.  An inner node has ‘n’ + 1 ‘children’, where
+ * ‘keys’[i] is the smallest key in the sub-tree rooted at ‘children’[i + 1].
+ * Leaves contain the actual key/value pairs, the value for ‘keys’[i] stored in
+ * ‘values’[i], and are linked together in order through ‘next’.  There's
+ * room for one key (and child or value) more than allowed in each node, so
+ * that we may insert into a full node before splitting it.
+ */
+typedef struct _BTreeNode BTreeNode;
+
+struct _BTreeNode {
+	int n;
+	bool leaf;
+	BTreeNode *next;
+	pointer keys[B_TREE_MAX_KEYS + 1];
+	union {
+		BTreeNode *children[B_TREE_ORDER + 1];
+		pointer values[B_TREE_MAX_KEYS + 1];
+	} u;
+};
+
+
+/* {{{2
+ * Our tree structure, containing function pointers to notifiers and
+ * comparators (with data), a pointer to the root node of our tree, which is
+ * ‹null› for an empty tree, and the number of key/value pairs in it.
+ */
+struct _BTree {
+	CompareDataFunc key_compare;
+	pointer key_compare_data;
+	ReleaseNotify key_release;
+	ReleaseNotify value_release;
+	BTreeNode *root;
+	int size;
+};
+
+
+/* {{{1
+ * Memory Management: We use, like all other ADT's in our library for which
+ * it applies, free-lists.  So let's define them here.
+ */
+G_LOCK_DEFINE_STATIC(node_free_list);
+static BTreeNode *node_free_list = null;
+
+
+
+/* {{{1
+ * Create a new, empty, node.
+ */
+static BTreeNode *
+b_tree_node_new(bool leaf)
+{
+	BTreeNode *node;
+
+	G_LOCK(node_free_list);
+	if (node_free_list) {
+		node = node_free_list;
+		node_free_list = node->next;
+	} else {
+		node = new_struct(BTreeNode);
+	}
+	G_UNLOCK(node_free_list);
+
+	node->n = 0;
+	node->leaf = leaf;
+	node->next = null;
+
+	return node;
+}
+
+
+/* {{{1
+ * Put ‘node’ on the free-list.
+ */
+static void
+b_tree_node_free(BTreeNode *node)
+{
+	G_LOCK(node_free_list);
+	node->next = node_free_list;
+	node_free_list = node;
+	G_UNLOCK(node_free_list);
+}
+
+
+/* {{{1
+ * Free ‘node’ and all nodes below it, notifying the tree's owner of the
+ * release of each key and value.  Keys in inner nodes are copies of keys in
+ * the leaves, so only those in the leaves are released.
+ */
+static void
+b_tree_node_release(BTreeNode *node, ReleaseNotify key_release,
+		    ReleaseNotify value_release)
+{
+	if (node->leaf) {
+		for (int i = 0; i < node->n; i++) {
+			unless (key_release == null) {
+				key_release(node->keys[i]);
+			}
+			unless (value_release == null) {
+				value_release(node->u.values[i]);
+			}
+		}
+	} else {
+		for (int i = 0; i <= node->n; i++) {
+			b_tree_node_release(node->u.children[i],
+					    key_release,
+					    value_release);
+		}
+	}
+
+	b_tree_node_free(node);
+}
+
+
+/* {{{1
+ * Create a new B+-tree.  The tree will sort keys according to ‘key_compare’,
+ * which works in the same manner as the ANSI C standard library function
+ * |strcmp()| does.
+ */
+BTree *
+b_tree_new(CompareFunc key_compare)
+{
+	invariant(key_compare != null);
+
+	return b_tree_new_full((CompareDataFunc)key_compare, null, null, null);
+}
+
+
+/* {{{1
+ * Create a new B+-tree with a comparison function that takes an additional
+ * argument, which will be ‘key_compare_data’.  Otherwise, same as
+ * |b_tree_new|.
+ */
+BTree *
+b_tree_new_with_data(CompareDataFunc key_compare, pointer key_compare_data)
+{
+	invariant(key_compare != null);
+
+	return b_tree_new_full(key_compare, key_compare_data, null, null);
+}
+
+
+/* {{{1
+ * Create a new B+-tree with the same arguments as |b_tree_new_with_data|, but
+ * with two free-notify functions as well.  These work just like they do for
+ * |rb_tree_new_full|.
+ */
+BTree *
+b_tree_new_full(CompareDataFunc key_compare,
+		pointer key_compare_data,
+		ReleaseNotify key_release,
+		ReleaseNotify value_release)
+{
+	invariant(key_compare != null);
+
+	BTree *tree = new_struct(BTree);
+	tree->key_compare = key_compare;
+	tree->key_compare_data = key_compare_data;
+	tree->key_release = key_release;
+	tree->value_release = value_release;
+	tree->root = null;
+	tree->size = 0;
+	return tree;
+}
+
+
+/* {{{1
+ * Release a |BTree|.  This frees all nodes in the tree as well, and if
+ * release-notify functions exist for this tree, memory associated with keys
+ * and values will also be released.
+ */
+void
+b_tree_release(BTree *tree)
+{
+	invariant(tree != null);
+
+	unless (tree->root == null) {
+		b_tree_node_release(tree->root,
+				    tree->key_release,
+				    tree->value_release);
+	}
+	release(tree);
+}
+
+
+/* {{{1
+ * Find the position of ‘key’ in ‘node’ using a binary search.  The return
+ * value is the index of the first key in ‘node’ that isn't less than ‘key’,
+ * and ‘found’ is set to whether that key is equal to ‘key’.
+ */
+static int
+b_tree_node_search(BTree *tree, BTreeNode *node, constpointer key,
+		   bool *found)
+{
+	int lo = 0;
+	int hi = node->n;
+
+	*found = false;
+	while (lo < hi) {
+		int mid = (lo + hi) / 2;
+		int cmp = tree->key_compare(key,
+					    node->keys[mid],
+					    tree->key_compare_data);
+		if (cmp < 0) {
+			hi = mid;
+		} else if (cmp == 0) {
+			*found = true;
+			return mid;
+		} else { /* (cmp > 0) */
+			lo = mid + 1;
+		}
+	}
+
+	return lo;
+}
+
+
+/* {{{1
+ * Find the leaf that ‘key’ belongs in and its position in it.  ‘found’ is set
+ * to whether ‘key’ is in the leaf at that position.
+ */
+static BTreeNode *
+b_tree_find_leaf(BTree *tree, constpointer key, int *i, bool *found)
+{
+	BTreeNode *node = tree->root;
+
+	if (node == null) {
+		*found = false;
+		return null;
+	}
+
+	until (node->leaf) {
+		int j = b_tree_node_search(tree, node, key, found);
+
+		/* a key equal to keys[j] is found in the sub-tree after it */
+		node = node->u.children[*found ? j + 1 : j];
+	}
+	*i = b_tree_node_search(tree, node, key, found);
+
+	return node;
+}
+
+
+/* {{{1
+ * Move the keys (and children or values) from position ‘from’ in ‘node’ to
+ * position ‘to’, making room for new ones or filling up the gap left by ones
+ * removed.
+ */
+static void
+b_tree_node_shift(BTreeNode *node, int from, int to)
+{
+	int n = node->n - from;
+
+	memmove(&node->keys[to], &node->keys[from], n * sizeof(pointer));
+	if (node->leaf) {
+		memmove(&node->u.values[to], &node->u.values[from],
+			n * sizeof(pointer));
+	} else {
+		memmove(&node->u.children[to + 1], &node->u.children[from + 1],
+			n * sizeof(BTreeNode *));
+	}
+	node->n += to - from;
+}
+
+
+/* {{{1
+ * Split the overfull ‘node’ in two, returning the new right half.  ‘key’ is
+ * set to the smallest key in the right half.  For leaves, that key stays in
+ * the right half, and the new leaf is linked in after ‘node’.  For inner
+ * nodes, it moves up to the parent.
+ */
+static BTreeNode *
+b_tree_node_split(BTreeNode *node, pointer *key)
+{
+	BTreeNode *right = b_tree_node_new(node->leaf);
+	int mid = node->n / 2;
+
+	if (node->leaf) {
+		right->n = node->n - mid;
+		memcpy(right->keys, &node->keys[mid],
+		       right->n * sizeof(pointer));
+		memcpy(right->u.values, &node->u.values[mid],
+		       right->n * sizeof(pointer));
+		right->next = node->next;
+		node->next = right;
+	} else {
+		right->n = node->n - mid - 1;
+		memcpy(right->keys, &node->keys[mid + 1],
+		       right->n * sizeof(pointer));
+		memcpy(right->u.children, &node->u.children[mid + 1],
+		       (right->n + 1) * sizeof(BTreeNode *));
+	}
+	node->n = mid;
+	*key = node->leaf ? right->keys[0] : node->keys[mid];
+
+	return right;
+}
+
+
+/* {{{1
+ * Insert ‘key’ and ‘value’ into the sub-tree rooted at ‘node’, or update an
+ * existing pair, as described for |b_tree_insert| and |b_tree_replace|.  If
+ * ‘node’ had to be split, the new right half is returned, with ‘split_key’
+ * set to its smallest key.  Otherwise, ‹null› is returned.
+ */
+static BTreeNode *
+b_tree_node_insert(BTree *tree,
+		   BTreeNode *node,
+		   pointer key,
+		   pointer value,
+		   bool replace,
+		   pointer *split_key)
+{
+	bool found;
+	int i = b_tree_node_search(tree, node, key, &found);
+
+	if (node->leaf && found) {
+		/* this assumes that equal keys have the same total ordering */
+		if (replace) {
+			unless (tree->key_release == null) {
+				tree->key_release(node->keys[i]);
+			}
+			node->keys[i] = key;
+		} else {
+			unless (tree->key_release == null) {
+				tree->key_release(key);
+			}
+		}
+		unless (tree->value_release == null) {
+			tree->value_release(node->u.values[i]);
+		}
+		node->u.values[i] = value;
+
+		return null;
+	} else if (node->leaf) {
+		b_tree_node_shift(node, i, i + 1);
+		node->keys[i] = key;
+		node->u.values[i] = value;
+		tree->size++;
+	} else {
+		/* a key equal to keys[i] is found in the sub-tree after it */
+		int c = found ? i + 1 : i;
+		pointer child_key;
+		BTreeNode *right = b_tree_node_insert(tree,
+						      node->u.children[c],
+						      key,
+						      value,
+						      replace,
+						      &child_key);
+
+		/* keys[i] may be the key we just replaced, so update it */
+		if (found && replace) {
+			node->keys[i] = key;
+		}
+
+		if (right == null) {
+			return null;
+		}
+
+		b_tree_node_shift(node, c, c + 1);
+		node->keys[c] = child_key;
+		node->u.children[c + 1] = right;
+	}
+
+	return (node->n > B_TREE_MAX_KEYS) ?
+		b_tree_node_split(node, split_key) : null;
+}
+
+
+/* {{{1
+ * Insert or update a key/value pair, growing the tree upwards if the root is
+ * split.
+ */
+static void
+b_tree_insert_full(BTree *tree, pointer key, pointer value, bool replace)
+{
+	if (tree->root == null) {
+		tree->root = b_tree_node_new(true);
+	}
+
+	pointer split_key;
+	BTreeNode *right = b_tree_node_insert(tree, tree->root, key, value,
+					      replace, &split_key);
+	unless (right == null) {
+		BTreeNode *root = b_tree_node_new(false);
+		root->n = 1;
+		root->keys[0] = split_key;
+		root->u.children[0] = tree->root;
+		root->u.children[1] = right;
+		tree->root = root;
+	}
+}
+
+
+/* {{{1
+ * Insert a key/value pair into ‘tree’.  If the given key already exists it's
+ * associated value is updated.  The previous value will be freed if
+ * applicable.  ‘key’ will likewise be freed if it already existed and it is
+ * appropriate to do so.
+ */
+void
+b_tree_insert(BTree *tree, pointer key, pointer value)
+{
+	invariant(tree != null);
+
+	b_tree_insert_full(tree, key, value, false);
+}
+
+
+/* {{{1
+ * Works like |b_tree_insert| except that both key and value will be replaced
+ * if ‘key’ already exists.
+ */
+void
+b_tree_replace(BTree *tree, pointer key, pointer value)
+{
+	invariant(tree != null);
+
+	b_tree_insert_full(tree, key, value, true);
+}
+
+
+/* {{{1
+ * Return the number of key/value pairs in ‘tree’.
+ */
+int
+b_tree_size(BTree *tree)
+{
+	invariant(tree != null);
+
+	return tree->size;
+}
+
+
+/* {{{1
+ * Return the height of the tree (i.e. the number of levels from the root node
+ * to the leaves).  All leaves of a B+-tree are on the same level.
+ */
+int
+b_tree_height(BTree *tree)
+{
+	invariant(tree != null);
+
+	int height = 0;
+	for (BTreeNode *node = tree->root; node != null;
+	     node = node->leaf ? null : node->u.children[0]) {
+		height++;
+	}
+
+	return height;
+}
+
+
+/* {{{1
+ * Get the value associated with ‘key’ in ‘tree’.  If ‘key’ doesn't exist,
+ * ‹null› is returned.
+ */
+pointer
+b_tree_lookup(BTree *tree, constpointer key)
+{
+	invariant(tree != null);
+
+	int i;
+	bool found;
+	BTreeNode *leaf = b_tree_find_leaf(tree, key, &i, &found);
+
+	return found ? leaf->u.values[i] : null;
+}
+
+
+/* {{{1
+ * Works like |b_tree_lookup| except that the return value is a boolean
+ * telling whether ‘key’ was found in the tree or not.  ‘orig_key’ will contain
+ * a pointer to the key found in the tree and ‘value’ works likewise.
+ */
+bool
+b_tree_lookup_extended(BTree *tree,
+		       constpointer key,
+		       pointer *orig_key,
+		       pointer *value)
+{
+	invariant(tree != null);
+
+	int i;
+	bool found;
+	BTreeNode *leaf = b_tree_find_leaf(tree, key, &i, &found);
+
+	if (found) {
+		unless (orig_key == null) {
+			*orig_key = leaf->keys[i];
+		}
+		unless (value == null) {
+			*value = leaf->u.values[i];
+		}
+	}
+
+	return found;
+}
+
+
+/* {{{1
+ * Call ‘func’ for each key/value pair in ‘tree’, passing the key and value
+ * plus the user supplied data if applicable.  The pairs are visited in order,
+ * by walking the linked list of leaves.
+ */
+void
+b_tree_map(BTree *tree, MappingMapFunc func, pointer closure)
+{
+	invariant(tree != null);
+	invariant(func != null);
+
+	BTreeNode *leaf = tree->root;
+	if (leaf == null) {
+		return;
+	}
+	until (leaf->leaf) {
+		leaf = leaf->u.children[0];
+	}
+
+	for ( ; leaf != null; leaf = leaf->next) {
+		for (int i = 0; i < leaf->n; i++) {
+			unless (func(leaf->keys[i], leaf->u.values[i],
+				     closure)) {
+				return;
+			}
+		}
+	}
+}
+
+
+/* {{{1
+ * Find the smallest key in the sub-tree rooted at ‘node’.
+ */
+static pointer
+b_tree_node_min_key(BTreeNode *node)
+{
+	until (node->leaf) {
+		node = node->u.children[0];
+	}
+
+	return node->keys[0];
+}
+
+
+/* {{{1
+ * Merge child ‘c’ + 1 of ‘node’ into child ‘c’, removing it (and the key
+ * separating them) from ‘node’.
+ */
+static void
+b_tree_node_merge(BTreeNode *node, int c)
+{
+	BTreeNode *left = node->u.children[c];
+	BTreeNode *right = node->u.children[c + 1];
+
+	if (left->leaf) {
+		memcpy(&left->keys[left->n], right->keys,
+		       right->n * sizeof(pointer));
+		memcpy(&left->u.values[left->n], right->u.values,
+		       right->n * sizeof(pointer));
+		left->n += right->n;
+		left->next = right->next;
+	} else {
+		left->keys[left->n] = node->keys[c];
+		memcpy(&left->keys[left->n + 1], right->keys,
+		       right->n * sizeof(pointer));
+		memcpy(&left->u.children[left->n + 1], right->u.children,
+		       (right->n + 1) * sizeof(BTreeNode *));
+		left->n += right->n + 1;
+	}
+
+	b_tree_node_shift(node, c + 1, c);
+	b_tree_node_free(right);
+}
+
+
+/* {{{1
+ * Restore the minimum number of keys in child ‘c’ of ‘node’, either by
+ * borrowing a key from one of its siblings, or, if neither can spare any, by
+ * merging it with one of them.
+ */
+static void
+b_tree_node_restore(BTreeNode *node, int c)
+{
+	BTreeNode *child = node->u.children[c];
+	BTreeNode *left = (c > 0) ? node->u.children[c - 1] : null;
+	BTreeNode *right = (c < node->n) ? node->u.children[c + 1] : null;
+
+	if (left != null && left->n > B_TREE_MIN_KEYS) {
+		/* move the last pair or child of left to the front of child */
+		b_tree_node_shift(child, 0, 1);
+		if (child->leaf) {
+			child->keys[0] = left->keys[left->n - 1];
+			child->u.values[0] = left->u.values[left->n - 1];
+			node->keys[c - 1] = child->keys[0];
+		} else {
+			child->u.children[1] = child->u.children[0];
+			child->u.children[0] = left->u.children[left->n];
+			child->keys[0] = node->keys[c - 1];
+			node->keys[c - 1] = left->keys[left->n - 1];
+		}
+		left->n--;
+	} else if (right != null && right->n > B_TREE_MIN_KEYS) {
+		/* move the first pair or child of right to the end of child */
+		if (child->leaf) {
+			child->keys[child->n] = right->keys[0];
+			child->u.values[child->n] = right->u.values[0];
+			child->n++;
+			b_tree_node_shift(right, 1, 0);
+			node->keys[c] = right->keys[0];
+		} else {
+			child->keys[child->n] = node->keys[c];
+			child->u.children[child->n + 1] = right->u.children[0];
+			child->n++;
+			node->keys[c] = right->keys[0];
+			right->u.children[0] = right->u.children[1];
+			b_tree_node_shift(right, 1, 0);
+		}
+	} else if (left != null) {
+		b_tree_node_merge(node, c - 1);
+	} else {
+		b_tree_node_merge(node, c);
+	}
+}
+
+
+/* {{{1
+ * Remove ‘key’ from the sub-tree rooted at ‘node’, notifying of the removal if
+ * applicable.  The return value tells whether ‘key’ was found.
+ */
+static bool
+b_tree_node_remove(BTree *tree, BTreeNode *node, constpointer key,
+		   bool notify)
+{
+	bool found;
+	int i = b_tree_node_search(tree, node, key, &found);
+
+	if (node->leaf) {
+		unless (found) {
+			return false;
+		}
+
+		if (notify) {
+			unless (tree->key_release == null) {
+				tree->key_release(node->keys[i]);
+			}
+			unless (tree->value_release == null) {
+				tree->value_release(node->u.values[i]);
+			}
+		}
+		b_tree_node_shift(node, i + 1, i);
+		tree->size--;
+
+		return true;
+	}
+
+	/* a key equal to keys[i] is found in the sub-tree after it */
+	int c = found ? i + 1 : i;
+	BTreeNode *child = node->u.children[c];
+	unless (b_tree_node_remove(tree, child, key, notify)) {
+		return false;
+	}
+
+	/*
+	 * if keys[i] was the key we removed, it was the smallest key of the
+	 * child, so replace it with the child's new smallest key.
+	 */
+	if (found) {
+		node->keys[i] = b_tree_node_min_key(child);
+	}
+
+	if (child->n < B_TREE_MIN_KEYS) {
+		b_tree_node_restore(node, c);
+	}
+
+	return true;
+}
+
+
+/* {{{1
+ * Remove ‘key’ from ‘tree’, shrinking it from the top if the root is left
+ * without keys.
+ */
+static void
+b_tree_remove_full(BTree *tree, constpointer key, bool notify)
+{
+	if (tree->root == null) {
+		return;
+	}
+
+	b_tree_node_remove(tree, tree->root, key, notify);
+
+	BTreeNode *root = tree->root;
+	if (root->n == 0) {
+		tree->root = root->leaf ? null : root->u.children[0];
+		b_tree_node_free(root);
+	}
+}
+
+
+/* {{{1
+ * Remove the key/value pair with the given key from ‘tree’, freeing key and
+ * value if applicable.
+ */
+void
+b_tree_remove(BTree *tree, constpointer key)
+{
+	invariant(tree != null);
+
+	b_tree_remove_full(tree, key, true);
+}
+
+
+/* {{{1
+ * Works like |b_tree_remove|, except that the key and value of the pair with
+ * key ‘key’ will not be freed even if applicable.
+ */
+void
+b_tree_steal(BTree *tree, constpointer key)
+{
+	invariant(tree != null);
+
+	b_tree_remove_full(tree, key, false);
+}
+
+
+/* }}}1 */
+
+
+
+/* vim: set sts=0 sw=8 ts=8: */
@@ -0,0 +1,58 @@
+/*
+ * contents: B+-Tree ADT.
+ * arch-tag: ca776115-84b8-43f8-a580-ccf63c808b90
+ *
+ * Copyright (C) 2004 Nikolai Weibull <source@pcppopper.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+
+
+#ifndef BTREE_H
+#define BTREE_H
+
+
+typedef struct _BTree BTree;
+
+
+BTree *b_tree_new(CompareFunc key_compare);
+BTree *b_tree_new_with_data(CompareDataFunc key_compare,
+			    pointer key_compare_data);
+BTree *b_tree_new_full(CompareDataFunc key_compare,
+		       pointer key_compare_data,
+		       ReleaseNotify key_release,
+		       ReleaseNotify value_release);
+void b_tree_release(BTree *tree);
+
+void b_tree_insert(BTree *tree, pointer key, pointer value);
+void b_tree_replace(BTree *tree, pointer key, pointer value);
+int b_tree_size(BTree *tree);
+int b_tree_height(BTree *tree);
+pointer b_tree_lookup(BTree *tree, constpointer key);
+bool b_tree_lookup_extended(BTree *tree,
+			    constpointer key,
+			    pointer *orig_key,
+			    pointer *value);
+void b_tree_map(BTree *tree, MappingMapFunc lambda, pointer closure);
+void b_tree_remove(BTree *tree, constpointer key);
+void b_tree_steal(BTree *tree, constpointer key);
+
+
+#endif /* BTREE_H */
+
+
+
+/* vim: set sts=0 sw=8 ts=8: */
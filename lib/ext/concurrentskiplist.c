@@ -0,0 +1,668 @@
+/*
+ * contents: Lock-free concurrent Skiplist ADT.
+ * arch-tag: 353d159c-1837-4dc8-81d5-b1048ef52c94
+ *
+ * Copyright (C) 2004 Nikolai Weibull <source@pcppopper.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+
+#include <stdint.h>
+#include <clear/internal.h>
+#include <clear/mem.h>
+#include "concurrentskiplist.h"
+
+
+/* {{{1
+ * A lock-free skiplist, as described by Fraser in “Practical Lock-Freedom”,
+ * and by Herlihy and Shavit in “The Art of Multiprocessor Programming”.  Any
+ * number of threads may insert, remove, and look up keys at the same time,
+ * without any locking.  Each level of the list is a linked list whose links
+ * are updated with compare-and-swap.  A node is removed by first marking its
+ * links, from the top level down, by setting their lowest bit, and the node
+ * is logically removed once its link on the lowest level is marked.  Marked
+ * links are never changed again, so no node can be linked in after a marked
+ * node, and any insertion or removal that comes across a marked node
+ * physically unlinks it before going on.  Lookups never change anything:
+ * they just step past marked nodes, so they're wait-free on each level.
+ *
+ * As other threads may still be looking at nodes that have been removed,
+ * they, and their keys and values, can't be released right away.  Like the
+ * nodes of concurrent |RBTree|s, they are put in ‘limbo’ instead, and the
+ * owner of the list must call |concurrent_skip_list_reclaim| when no
+ * operation that started before they were removed can still be running.
+ *
+ * Unlike |SkipList|s, there's no finger, as it would be a point of contention
+ * between threads, and no backward links, as they can't be kept consistent
+ * with the forward ones without locking.
+ */
+
+
+/* {{{1
+ * The maximum height of a node, which, as for |SkipList|s, is enough for 4^32
+ * nodes.
+ */
+#define CONCURRENT_SKIP_LIST_MAX_HEIGHT	32
+
+
+/* {{{1
+ * The bit of a link that marks the node it's a link of as removed.
+ */
+#define MARK	((uintptr_t)1)
+
+
+/* {{{1
+ * A node in the list.  The ‘next’ links are allocated inline with the node,
+ * one per level, as for |SkipList|s, and are pointers to the next node on
+ * each level, or ‹null›, possibly with their ‘MARK’ bit set.  ‘retired’ links
+ * the node into limbo once it has been removed.
+ */
+typedef struct _ConcurrentSkipListNode ConcurrentSkipListNode;
+
+struct _ConcurrentSkipListNode {
+	pointer key;
+	pointer value;
+	ConcurrentSkipListNode *retired;
+	int height;
+	uintptr_t next[];
+};
+
+
+/* {{{1
+ * Our concurrent skiplist structure.  ‘head’ is a node without key or value
+ * that is part of every level.  ‘height’ is the number of levels that have
+ * been used, which never decreases, and ‘size’ the number of nodes in the
+ * list.  ‘limbo’ is the list of nodes that have been removed, but not yet
+ * released, see above.
+ */
+struct _ConcurrentSkipList {
+	CompareDataFunc key_compare;
+	pointer key_compare_data;
+	ReleaseNotify key_release;
+	ReleaseNotify value_release;
+	ConcurrentSkipListNode *head;
+	int height;
+	int size;
+	ConcurrentSkipListNode *limbo;
+};
+
+
+/* {{{1
+ * The state of each thread's random number generator, see
+ * |concurrent_skip_list_random_height|.
+ */
+static __thread uint32_t s_random_state;
+
+
+/* {{{1
+ * Links: All links are read and updated atomically, and all of these
+ * operations are sequentially consistent, as an insertion and a removal of
+ * the same node must agree on whether the removal saw all the levels that the
+ * insertion linked the node in on, see |concurrent_skip_list_insert|.
+ */
+
+
+/* {{{2
+ * Get the node that ‘link’ points to, without its mark.
+ */
+static inline ConcurrentSkipListNode *
+concurrent_skip_list_node(uintptr_t link)
+{
+	return (ConcurrentSkipListNode *)(link & ~MARK);
+}
+
+
+/* {{{2
+ * Check if ‘link’ is marked.
+ */
+static inline bool
+concurrent_skip_list_marked(uintptr_t link)
+{
+	return (link & MARK) != 0;
+}
+
+
+/* {{{2
+ * Read the link at ‘link’.
+ */
+static inline uintptr_t
+concurrent_skip_list_load(uintptr_t *link)
+{
+	return __atomic_load_n(link, __ATOMIC_SEQ_CST);
+}
+
+
+/* {{{2
+ * Set the link at ‘link’ to ‘desired’ if it's ‘*expected’.  Returns true if
+ * it was, else sets ‘*expected’ to what it was instead.
+ */
+static inline bool
+concurrent_skip_list_cas(uintptr_t *link, uintptr_t *expected,
+			 uintptr_t desired)
+{
+	return __atomic_compare_exchange_n(link, expected, desired, false,
+					   __ATOMIC_SEQ_CST,
+					   __ATOMIC_SEQ_CST);
+}
+
+
+/* {{{1
+ * Allocate a new node of height ‘height’, with all its links ‹null›.
+ */
+static ConcurrentSkipListNode *
+concurrent_skip_list_node_new(pointer key, pointer value, int height)
+{
+	ConcurrentSkipListNode *node =
+		(ConcurrentSkipListNode *)new_array(char,
+			sizeof(ConcurrentSkipListNode) +
+			height * sizeof(uintptr_t));
+	node->key = key;
+	node->value = value;
+	node->retired = null;
+	node->height = height;
+	for (int i = 0; i < height; i++) {
+		node->next[i] = 0;
+	}
+
+	return node;
+}
+
+
+/* {{{1
+ * Release ‘node’, calling the release-notify functions of ‘list’ on its key
+ * and value if ‘notify’ is true.
+ */
+static void
+concurrent_skip_list_node_release(ConcurrentSkipList *list,
+				  ConcurrentSkipListNode *node,
+				  bool notify)
+{
+	if (notify) {
+		unless (list->key_release == null) {
+			list->key_release(node->key);
+		}
+		unless (list->value_release == null) {
+			list->value_release(node->value);
+		}
+	}
+	release(node);
+}
+
+
+/* {{{1
+ * Pick a height for a new node, the way |SkipList|s do, but with a generator
+ * per thread, seeded with the address of its state, as in MultiQueues.
+ */
+static int
+concurrent_skip_list_random_height(void)
+{
+	if (s_random_state == 0) {
+		s_random_state = (uint32_t)(uintptr_t)&s_random_state | 1;
+	}
+
+	uint32_t r = s_random_state;
+	r ^= r << 13;
+	r ^= r >> 17;
+	r ^= r << 5;
+	s_random_state = r;
+
+	int height = 1;
+	while ((r & 3) == 0 && height < CONCURRENT_SKIP_LIST_MAX_HEIGHT) {
+		height++;
+		r >>= 2;
+	}
+
+	return height;
+}
+
+
+/* {{{1
+ * Create a new concurrent skiplist.  The list will sort keys according to
+ * ‘key_compare’, which is passed ‘key_compare_data’, and release keys and
+ * values with ‘key_release’ and ‘value_release’, which may be ‹null›, as
+ * with |skip_list_new_full|.  Keys and values are only released by
+ * |concurrent_skip_list_reclaim| and |concurrent_skip_list_release|.
+ */
+ConcurrentSkipList *
+concurrent_skip_list_new(CompareDataFunc key_compare,
+			 pointer key_compare_data,
+			 ReleaseNotify key_release,
+			 ReleaseNotify value_release)
+{
+	invariant(key_compare != null);
+
+	ConcurrentSkipList *list = new_struct(ConcurrentSkipList);
+	list->key_compare = key_compare;
+	list->key_compare_data = key_compare_data;
+	list->key_release = key_release;
+	list->value_release = value_release;
+	list->head = concurrent_skip_list_node_new(null, null,
+					CONCURRENT_SKIP_LIST_MAX_HEIGHT);
+	list->height = 1;
+	list->size = 0;
+	list->limbo = null;
+
+	return list;
+}
+
+
+/* {{{1
+ * Release ‘list’, all its nodes, and those in limbo, along with their keys
+ * and values, if applicable.  No other thread may be using the list.
+ */
+void
+concurrent_skip_list_release(ConcurrentSkipList *list)
+{
+	invariant(list != null);
+
+	uintptr_t link = list->head->next[0];
+	until (concurrent_skip_list_node(link) == null) {
+		ConcurrentSkipListNode *node = concurrent_skip_list_node(link);
+		link = node->next[0];
+
+		/* a marked node is in limbo, and is released below */
+		unless (concurrent_skip_list_marked(link)) {
+			concurrent_skip_list_node_release(list, node, true);
+		}
+	}
+
+	concurrent_skip_list_reclaim(list);
+	release(list->head);
+	release(list);
+}
+
+
+/* {{{1
+ * Release the nodes, keys, and values that removals from ‘list’ have put in
+ * limbo.  This may be called by any thread, but only when no operation on the
+ * list that started before the last removal can still be running, for
+ * example when all threads using the list have reached some quiescent point.
+ */
+void
+concurrent_skip_list_reclaim(ConcurrentSkipList *list)
+{
+	invariant(list != null);
+
+	ConcurrentSkipListNode *node = __atomic_exchange_n(&list->limbo, null,
+							   __ATOMIC_ACQUIRE);
+	until (node == null) {
+		ConcurrentSkipListNode *next = node->retired;
+		concurrent_skip_list_node_release(list, node, true);
+		node = next;
+	}
+}
+
+
+/* {{{1
+ * Put the removed ‘node’ in the limbo of ‘list’.
+ */
+static void
+concurrent_skip_list_retire(ConcurrentSkipList *list,
+			    ConcurrentSkipListNode *node)
+{
+	ConcurrentSkipListNode *limbo = __atomic_load_n(&list->limbo,
+							__ATOMIC_RELAXED);
+	do {
+		node->retired = limbo;
+	} until (__atomic_compare_exchange_n(&list->limbo, &limbo, node,
+					     true, __ATOMIC_RELEASE,
+					     __ATOMIC_RELAXED));
+}
+
+
+/* {{{1
+ * Try to find the last node before ‘key’ and the first node after it on each
+ * level, filling in ‘preds’ and ‘succs’ with them.  Marked nodes that we come
+ * across are unlinked.  If another thread changes the link we're unlinking
+ * one from, we give up and return false, and the search has to be started
+ * over from the head.
+ */
+static bool
+concurrent_skip_list_try_find(ConcurrentSkipList *list,
+			      constpointer key,
+			      ConcurrentSkipListNode **preds,
+			      ConcurrentSkipListNode **succs)
+{
+	ConcurrentSkipListNode *pred = list->head;
+	int height = __atomic_load_n(&list->height, __ATOMIC_SEQ_CST);
+
+	for (int i = CONCURRENT_SKIP_LIST_MAX_HEIGHT - 1; i >= height; i--) {
+		preds[i] = list->head;
+		succs[i] = null;
+	}
+
+	for (int i = height - 1; i >= 0; i--) {
+		uintptr_t link = concurrent_skip_list_load(&pred->next[i]);
+		ConcurrentSkipListNode *curr = concurrent_skip_list_node(link);
+
+		until (curr == null) {
+			uintptr_t succ =
+				concurrent_skip_list_load(&curr->next[i]);
+			if (concurrent_skip_list_marked(succ)) {
+				uintptr_t expected = (uintptr_t)curr;
+				unless (concurrent_skip_list_cas(&pred->next[i],
+						&expected, succ & ~MARK)) {
+					return false;
+				}
+				curr = concurrent_skip_list_node(succ);
+			} else if (list->key_compare(curr->key, key,
+						list->key_compare_data) < 0) {
+				pred = curr;
+				curr = concurrent_skip_list_node(succ);
+			} else {
+				break;
+			}
+		}
+
+		preds[i] = pred;
+		succs[i] = curr;
+	}
+
+	return true;
+}
+
+
+/* {{{1
+ * Find ‘key’ in ‘list’, filling in ‘preds’ and ‘succs’ as
+ * |concurrent_skip_list_try_find| does.  Returns true if ‘key’ is in the
+ * list, in which case it's the key of the first node in ‘succs’.
+ */
+static bool
+concurrent_skip_list_find(ConcurrentSkipList *list,
+			  constpointer key,
+			  ConcurrentSkipListNode **preds,
+			  ConcurrentSkipListNode **succs)
+{
+	until (concurrent_skip_list_try_find(list, key, preds, succs)) {
+		/* retry */
+	}
+
+	return succs[0] != null &&
+		list->key_compare(key, succs[0]->key,
+				  list->key_compare_data) == 0;
+}
+
+
+/* {{{1
+ * Raise the height of ‘list’ to ‘height’, unless it's already higher.
+ */
+static void
+concurrent_skip_list_raise(ConcurrentSkipList *list, int height)
+{
+	int current = __atomic_load_n(&list->height, __ATOMIC_SEQ_CST);
+
+	while (current < height &&
+	       !__atomic_compare_exchange_n(&list->height, &current, height,
+					    false, __ATOMIC_SEQ_CST,
+					    __ATOMIC_SEQ_CST)) {
+		/* retry */
+	}
+}
+
+
+/* {{{1
+ * Insert ‘key’ and ‘value’ into ‘list’, unless ‘key’ is already in it, in
+ * which case nothing is changed, and the caller keeps ‘key’ and ‘value’.
+ * Returns true if they were inserted.
+ *
+ * The node is first linked in on the lowest level, which is what inserts it,
+ * and then on each level above.  If the node gets removed while we're at it,
+ * we stop, and as we can't tell if the removal saw all the levels that we
+ * linked it in on, we make sure that it's unlinked from them ourselves.
+ */
+bool
+concurrent_skip_list_insert(ConcurrentSkipList *list,
+			    pointer key,
+			    pointer value)
+{
+	invariant(list != null);
+
+	ConcurrentSkipListNode *preds[CONCURRENT_SKIP_LIST_MAX_HEIGHT];
+	ConcurrentSkipListNode *succs[CONCURRENT_SKIP_LIST_MAX_HEIGHT];
+	ConcurrentSkipListNode *node = null;
+	int height = concurrent_skip_list_random_height();
+
+	while (true) {
+		if (concurrent_skip_list_find(list, key, preds, succs)) {
+			unless (node == null) {
+				release(node);
+			}
+			return false;
+		}
+
+		if (node == null) {
+			node = concurrent_skip_list_node_new(key, value,
+							     height);
+			concurrent_skip_list_raise(list, height);
+		}
+		for (int i = 0; i < height; i++) {
+			node->next[i] = (uintptr_t)succs[i];
+		}
+
+		uintptr_t expected = (uintptr_t)succs[0];
+		if (concurrent_skip_list_cas(&preds[0]->next[0], &expected,
+					     (uintptr_t)node)) {
+			break;
+		}
+	}
+	__atomic_add_fetch(&list->size, 1, __ATOMIC_RELAXED);
+
+	bool removed = false;
+	for (int i = 1; i < height && !removed; i++) {
+		while (true) {
+			uintptr_t next =
+				concurrent_skip_list_load(&node->next[i]);
+			if (concurrent_skip_list_marked(next)) {
+				removed = true;
+				break;
+			}
+
+			/* the node must point at its successor first */
+			if (concurrent_skip_list_node(next) != succs[i] &&
+			    !concurrent_skip_list_cas(&node->next[i], &next,
+						      (uintptr_t)succs[i])) {
+				continue;
+			}
+
+			uintptr_t expected = (uintptr_t)succs[i];
+			if (concurrent_skip_list_cas(&preds[i]->next[i],
+						     &expected,
+						     (uintptr_t)node)) {
+				break;
+			}
+			concurrent_skip_list_find(list, key, preds, succs);
+		}
+	}
+
+	uintptr_t next = concurrent_skip_list_load(&node->next[0]);
+	if (concurrent_skip_list_marked(next)) {
+		concurrent_skip_list_find(list, key, preds, succs);
+	}
+
+	return true;
+}
+
+
+/* {{{1
+ * Remove the node with key ‘key’ from ‘list’.  Returns true if it was there
+ * and this call removed it.  The node, its key, and its value are put in
+ * limbo, see |concurrent_skip_list_reclaim|.
+ */
+bool
+concurrent_skip_list_remove(ConcurrentSkipList *list, constpointer key)
+{
+	invariant(list != null);
+
+	ConcurrentSkipListNode *preds[CONCURRENT_SKIP_LIST_MAX_HEIGHT];
+	ConcurrentSkipListNode *succs[CONCURRENT_SKIP_LIST_MAX_HEIGHT];
+
+	unless (concurrent_skip_list_find(list, key, preds, succs)) {
+		return false;
+	}
+
+	ConcurrentSkipListNode *node = succs[0];
+	for (int i = node->height - 1; i > 0; i--) {
+		uintptr_t next = concurrent_skip_list_load(&node->next[i]);
+		until (concurrent_skip_list_marked(next) ||
+		       concurrent_skip_list_cas(&node->next[i], &next,
+						next | MARK)) {
+			/* retry */
+		}
+	}
+
+	/* whoever marks the lowest level removes the node */
+	uintptr_t next = concurrent_skip_list_load(&node->next[0]);
+	do {
+		if (concurrent_skip_list_marked(next)) {
+			return false;
+		}
+	} until (concurrent_skip_list_cas(&node->next[0], &next, next | MARK));
+
+	concurrent_skip_list_find(list, key, preds, succs);
+	concurrent_skip_list_retire(list, node);
+	__atomic_sub_fetch(&list->size, 1, __ATOMIC_RELAXED);
+
+	return true;
+}
+
+
+/* {{{1
+ * Return the number of nodes in ‘list’.  While other threads are modifying
+ * the list, this is only an estimate.
+ */
+int
+concurrent_skip_list_size(ConcurrentSkipList *list)
+{
+	invariant(list != null);
+
+	return __atomic_load_n(&list->size, __ATOMIC_RELAXED);
+}
+
+
+/* {{{1
+ * Find the node with key ‘key’ in ‘list’, or ‹null›, without changing
+ * anything, by stepping past marked nodes.
+ */
+static ConcurrentSkipListNode *
+concurrent_skip_list_search(ConcurrentSkipList *list, constpointer key)
+{
+	ConcurrentSkipListNode *pred = list->head;
+	ConcurrentSkipListNode *curr = null;
+	int height = __atomic_load_n(&list->height, __ATOMIC_SEQ_CST);
+
+	for (int i = height - 1; i >= 0; i--) {
+		curr = concurrent_skip_list_node(
+			concurrent_skip_list_load(&pred->next[i]));
+
+		until (curr == null) {
+			uintptr_t succ =
+				concurrent_skip_list_load(&curr->next[i]);
+			if (concurrent_skip_list_marked(succ)) {
+				curr = concurrent_skip_list_node(succ);
+			} else if (list->key_compare(curr->key, key,
+						list->key_compare_data) < 0) {
+				pred = curr;
+				curr = concurrent_skip_list_node(succ);
+			} else {
+				break;
+			}
+		}
+	}
+
+	if (curr != null &&
+	    list->key_compare(key, curr->key, list->key_compare_data) == 0) {
+		return curr;
+	}
+	return null;
+}
+
+
+/* {{{1
+ * Get the value associated with ‘key’ in ‘list’.  If ‘key’ doesn't exist,
+ * ‹null› is returned.
+ */
+pointer
+concurrent_skip_list_lookup(ConcurrentSkipList *list, constpointer key)
+{
+	invariant(list != null);
+
+	ConcurrentSkipListNode *node = concurrent_skip_list_search(list, key);
+	return (node != null) ? node->value : null;
+}
+
+
+/* {{{1
+ * Works like |concurrent_skip_list_lookup| except that the return value is a
+ * boolean telling whether ‘key’ was found in the list or not.  ‘orig_key’
+ * will contain a pointer to the key found in the list and ‘value’ works
+ * likewise.
+ */
+bool
+concurrent_skip_list_lookup_extended(ConcurrentSkipList *list,
+				     constpointer key,
+				     pointer *orig_key,
+				     pointer *value)
+{
+	invariant(list != null);
+
+	ConcurrentSkipListNode *node = concurrent_skip_list_search(list, key);
+	if (node == null) {
+		return false;
+	}
+
+	unless (orig_key == null) {
+		*orig_key = node->key;
+	}
+	unless (value == null) {
+		*value = node->value;
+	}
+	return true;
+}
+
+
+/* {{{1
+ * Call ‘lambda’ for each node in ‘list’, in order of increasing keys,
+ * passing the key and value of the node plus ‘closure’, until it returns
+ * false.  Nodes that are inserted or removed while we're at it may or may not
+ * be visited, but all others are, once each.
+ */
+void
+concurrent_skip_list_map(ConcurrentSkipList *list,
+			 MappingMapFunc lambda,
+			 pointer closure)
+{
+	invariant(list != null);
+	invariant(lambda != null);
+
+	uintptr_t link = concurrent_skip_list_load(&list->head->next[0]);
+	until (concurrent_skip_list_node(link) == null) {
+		ConcurrentSkipListNode *node = concurrent_skip_list_node(link);
+		link = concurrent_skip_list_load(&node->next[0]);
+		if (concurrent_skip_list_marked(link)) {
+			continue;
+		}
+		unless (lambda(node->key, node->value, closure)) {
+			break;
+		}
+	}
+}
+
+
+/* }}}1 */
+
+
+
+/* vim: set sts=0 sw=8 ts=8: */
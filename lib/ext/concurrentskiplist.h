@@ -0,0 +1,58 @@
+/*
+ * contents: Lock-free concurrent Skiplist ADT.
+ * arch-tag: 9d5027cb-f18e-4246-8a2a-fecad176cb51
+ *
+ * Copyright (C) 2004 Nikolai Weibull <source@pcppopper.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+
+
+#ifndef CONCURRENTSKIPLIST_H
+#define CONCURRENTSKIPLIST_H
+
+
+typedef struct _ConcurrentSkipList ConcurrentSkipList;
+
+
+ConcurrentSkipList *concurrent_skip_list_new(CompareDataFunc key_compare,
+					     pointer key_compare_data,
+					     ReleaseNotify key_release,
+					     ReleaseNotify value_release);
+void concurrent_skip_list_release(ConcurrentSkipList *list);
+void concurrent_skip_list_reclaim(ConcurrentSkipList *list);
+
+bool concurrent_skip_list_insert(ConcurrentSkipList *list,
+				 pointer key,
+				 pointer value);
+bool concurrent_skip_list_remove(ConcurrentSkipList *list, constpointer key);
+int concurrent_skip_list_size(ConcurrentSkipList *list);
+pointer concurrent_skip_list_lookup(ConcurrentSkipList *list,
+				    constpointer key);
+bool concurrent_skip_list_lookup_extended(ConcurrentSkipList *list,
+					  constpointer key,
+					  pointer *orig_key,
+					  pointer *value);
+void concurrent_skip_list_map(ConcurrentSkipList *list,
+			      MappingMapFunc lambda,
+			      pointer closure);
+
+
+#endif /* CONCURRENTSKIPLIST_H */
+
+
+
+/* vim: set sts=0 sw=8 ts=8: */
@@ -0,0 +1,32 @@
+# Generates the Makefile for the native RDSL extension.  Build it with
+#
+#   ruby extconf.rb && make
+#
+# and put the resulting library in the load path, after the RDSL sources, to
+# have the RDSL classes use it.  Without it, they're pure Ruby, except for
+# RDSL::RedBlackTree, RDSL::PriorityQueue, and the RDSL::Pattern classes,
+# which need it.
+#
+# The statistics of RDSL::RedBlackTree#stats and RDSL::PriorityQueue#stats
+# are only kept, at some cost, if it's configured with --enable-stats.
+
+require 'mkmf'
+
+dir_config 'clear'
+$CFLAGS << ' -std=gnu99'
+
+unless have_header('clear/internal.h') and have_header('clear/mem.h')
+	abort 'the clear library is needed to build the RDSL extension'
+end
+have_library 'clear'
+have_library 'pthread', 'pthread_create'
+
+if enable_config('stats', false)
+	$defs.push '-DRB_TREE_STATS', '-DPRIORITY_QUEUE_STATS'
+end
+
+$srcs = %w[rdsl.c rskiplist.c skiplist.c rredblack.c redblack.c
+	   rpattern.c pattern.c patternstream.c patternparallel.c
+	   rmultipattern.c multipattern.c rpriorityqueue.c priorityqueue.c]
+
+create_makefile 'rdsl'
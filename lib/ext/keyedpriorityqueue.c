@@ -0,0 +1,369 @@
+/*
+ * contents: Priority queue ADT with inline priorities.
+ * arch-tag: 85bcd7fd-486f-406d-b65c-8c3037034a66
+ *
+ * Copyright (C) 2004 Nikolai Weibull <source@pcppopper.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+
+#include <stdint.h>
+#include <string.h>
+#include <clear/internal.h>
+#include <clear/mem.h>
+#include "keyedpriorityqueue.h"
+
+
+/* {{{1
+ * The default initial size of a keyed priority queue.
+ */
+#define KEYED_PRIORITY_QUEUE_INITIAL_SIZE	16
+
+
+/* {{{1
+ * The default arity of the heap, i.e. the number of children of each node.
+ */
+#define KEYED_PRIORITY_QUEUE_DEFAULT_ARITY	2
+
+
+/* {{{1
+ * The size of a cache line.
+ */
+#define KEYED_PRIORITY_QUEUE_CACHE_LINE		64
+
+
+/* {{{1
+ * An entry in the heap.  The priority ‘key’ is stored right next to the
+ * ‘data’ it belongs to, so sifting compares keys in the heap array itself,
+ * without following any pointers.  Smaller keys have higher priority.  Each
+ * entry takes up 16 bytes, even where pointers are smaller, so that four of
+ * them make up a cache line.
+ */
+typedef struct _KeyedPriorityQueueEntry KeyedPriorityQueueEntry;
+
+struct _KeyedPriorityQueueEntry {
+	double key;
+	pointer data;
+} __attribute__((aligned(16)));
+
+
+/* {{{1
+ * The number of entries in a cache line, and the number of unused entries
+ * that we put in front of the heap, so that its node 2 starts a cache line.
+ * The first children of all nodes of a 4-ary heap then do too, as ‘arity’ *
+ * (i - 1) + 2 is 2 more than a multiple of 4, so each node's children share
+ * a single line.  In a binary heap, the two children of a node are likewise
+ * always in the same line.
+ */
+#define KEYED_PRIORITY_QUEUE_LINE_ENTRIES \
+	(KEYED_PRIORITY_QUEUE_CACHE_LINE / sizeof(KeyedPriorityQueueEntry))
+#define KEYED_PRIORITY_QUEUE_PADDING \
+	(KEYED_PRIORITY_QUEUE_LINE_ENTRIES - 2)
+
+
+/* {{{1
+ * Our keyed priority queue structure.  This works just like a
+ * |PriorityQueue|, but ‘heap’ is an array of entries instead of an array of
+ * pointers, and there's no ‘compare’ function, as keys are compared directly.
+ * The heap starts at index 1, see |PriorityQueue| for the details.  ‘block’
+ * is the memory the heap lives in, see |keyed_priority_queue_resize|.
+ */
+struct _KeyedPriorityQueue {
+	pointer block;
+	KeyedPriorityQueueEntry *heap;
+	size_t len;
+	size_t size;
+	size_t arity;
+};
+
+
+/* {{{1
+ * Get the index of the parent of node ‘i’.
+ */
+static inline size_t
+keyed_priority_queue_parent(KeyedPriorityQueue *q, size_t i)
+{
+	return (i - 2) / q->arity + 1;
+}
+
+
+/* {{{1
+ * Get the index of the first child of node ‘i’.
+ */
+static inline size_t
+keyed_priority_queue_first_child(KeyedPriorityQueue *q, size_t i)
+{
+	return q->arity * (i - 1) + 2;
+}
+
+
+/* {{{1
+ * Move the heap of ‘q’ to memory with room for ‘size’ entries.  We allocate
+ * a cache line more than we need, and place the heap so that its node 2
+ * starts a cache line, see KEYED_PRIORITY_QUEUE_PADDING.  As reallocating
+ * could move the block to a different offset within a line, we always copy
+ * the heap over to a new block.
+ */
+static void
+keyed_priority_queue_resize(KeyedPriorityQueue *q, size_t size)
+{
+	size_t n = KEYED_PRIORITY_QUEUE_PADDING + size + 1;
+	char *block = new_array(char, n * sizeof(KeyedPriorityQueueEntry) +
+				KEYED_PRIORITY_QUEUE_CACHE_LINE);
+
+	uintptr_t line = (uintptr_t)block + KEYED_PRIORITY_QUEUE_CACHE_LINE - 1;
+	line &= ~(uintptr_t)(KEYED_PRIORITY_QUEUE_CACHE_LINE - 1);
+	KeyedPriorityQueueEntry *heap = (KeyedPriorityQueueEntry *)line +
+		KEYED_PRIORITY_QUEUE_PADDING;
+
+	unless (q->block == null) {
+		memcpy(heap, q->heap,
+		       (q->len + 1) * sizeof(KeyedPriorityQueueEntry));
+		release(q->block);
+	}
+
+	q->block = block;
+	q->heap = heap;
+	q->size = size;
+}
+
+
+/* {{{1
+ * Create a new keyed priority queue ADT.
+ */
+KeyedPriorityQueue *
+keyed_priority_queue_new(void)
+{
+	return keyed_priority_queue_sized_new(
+			KEYED_PRIORITY_QUEUE_INITIAL_SIZE);
+}
+
+
+/* {{{1
+ * Create a new keyed priority queue with a starting size.
+ */
+KeyedPriorityQueue *
+keyed_priority_queue_sized_new(size_t size)
+{
+	KeyedPriorityQueue *q = new_struct(KeyedPriorityQueue);
+	q->block = null;
+	q->heap = null;
+	q->len = 0;
+	q->arity = KEYED_PRIORITY_QUEUE_DEFAULT_ARITY;
+	keyed_priority_queue_resize(q, size);
+
+	return q;
+}
+
+
+/* {{{1
+ * Create a new keyed priority queue whose heap is ‘arity’-ary instead of
+ * binary, see |priority_queue_new_dary|.  With 4 children per node, all of
+ * them fit in a single 64-byte cache line, see KEYED_PRIORITY_QUEUE_PADDING.
+ */
+KeyedPriorityQueue *
+keyed_priority_queue_new_dary(size_t arity)
+{
+	invariant(arity >= 2);
+
+	KeyedPriorityQueue *q = keyed_priority_queue_new();
+	q->arity = arity;
+
+	return q;
+}
+
+
+/* {{{1
+ * Release all resources associated with the given keyed priority queue.
+ */
+void
+keyed_priority_queue_release(KeyedPriorityQueue *q)
+{
+	invariant(q != null);
+
+	release(q->block);
+	release(q);
+}
+
+
+/* {{{1
+ * Sift the entry at node ‘i’ upwards while its key is smaller than that of
+ * its parent, moving the parents down into the hole it leaves behind.
+ */
+static void
+keyed_priority_queue_sift_up(KeyedPriorityQueue *q, size_t i)
+{
+	KeyedPriorityQueueEntry entry = q->heap[i];
+
+	for (size_t p; i > 1 &&
+	     q->heap[p = keyed_priority_queue_parent(q, i)].key > entry.key;
+	     i = p) {
+		q->heap[i] = q->heap[p];
+	}
+	q->heap[i] = entry;
+}
+
+
+/* {{{1
+ * Sift the entry at node ‘i’ downwards while the key of its smallest child is
+ * smaller than its own.
+ */
+static void
+keyed_priority_queue_sift_down(KeyedPriorityQueue *q, size_t i)
+{
+	KeyedPriorityQueueEntry entry = q->heap[i];
+
+	size_t c;
+	while ((c = keyed_priority_queue_first_child(q, i)) <= q->len) {
+		/* find the smallest child */
+		size_t last = MIN(c + q->arity - 1, q->len);
+		for (size_t j = c + 1; j <= last; j++) {
+			if (q->heap[j].key < q->heap[c].key) {
+				c = j;
+			}
+		}
+
+		unless (entry.key > q->heap[c].key) {
+			break;
+		}
+		q->heap[i] = q->heap[c];
+		i = c;
+	}
+	q->heap[i] = entry;
+}
+
+
+/* {{{1
+ * Push ‘data’ on the keyed priority queue with priority ‘key’.
+ */
+void
+keyed_priority_queue_push(KeyedPriorityQueue *q, double key, pointer data)
+{
+	invariant(q != null);
+
+	/* first, resize to fit this entry as well, if necessary */
+	if (q->len == q->size) {
+		keyed_priority_queue_resize(q, (q->size > 0) ? 2 * q->size :
+					    KEYED_PRIORITY_QUEUE_INITIAL_SIZE);
+	}
+
+	/* then add it at the bottom and sift it upwards */
+	q->len++;
+	q->heap[q->len].key = key;
+	q->heap[q->len].data = data;
+	keyed_priority_queue_sift_up(q, q->len);
+}
+
+
+/* {{{1
+ * Pop the item with the smallest key off of the keyed priority queue.  If
+ * ‘key’ is non-‹null›, the item's key is stored in it.  Returns ‹null›, and
+ * leaves ‘key’ alone, if the queue is empty.
+ */
+pointer
+keyed_priority_queue_pop(KeyedPriorityQueue *q, double *key)
+{
+	invariant(q != null);
+
+	if (q->len == 0) {
+		return null;
+	}
+
+	/* first, save the root so that we can return it later on */
+	KeyedPriorityQueueEntry root = q->heap[1];
+
+	/* then, set the root to our last entry, and sift it downwards */
+	q->heap[1] = q->heap[q->len--];
+	if (q->len > 0) {
+		keyed_priority_queue_sift_down(q, 1);
+	}
+
+	if (key != null) {
+		*key = root.key;
+	}
+
+	return root.data;
+}
+
+
+/* {{{1
+ * Get the item with the smallest key without removing it from the queue.
+ * Works like |keyed_priority_queue_pop| otherwise.
+ */
+pointer
+keyed_priority_queue_peek(KeyedPriorityQueue *q, double *key)
+{
+	invariant(q != null);
+
+	if (q->len == 0) {
+		return null;
+	}
+
+	if (key != null) {
+		*key = q->heap[1].key;
+	}
+
+	return q->heap[1].data;
+}
+
+
+/* {{{1
+ * Retrieve the number of items in the keyed priority queue.
+ */
+int
+keyed_priority_queue_length(KeyedPriorityQueue *q)
+{
+	invariant(q != null);
+
+	return q->len;
+}
+
+
+/* {{{1
+ * Check if the given keyed priority queue is empty.
+ */
+bool
+keyed_priority_queue_empty(KeyedPriorityQueue *q)
+{
+	invariant(q != null);
+
+	return q->len == 0;
+}
+
+
+/* {{{1
+ * Map over all the items in the queue, in heap order, calling ‘lambda’ with
+ * each item and ‘closure’.
+ */
+void
+keyed_priority_queue_map(KeyedPriorityQueue *q,
+			 MapFunc lambda,
+			 pointer closure)
+{
+	invariant(q != null);
+	invariant(lambda != null);
+
+	for (size_t i = 1; i <= q->len; i++) {
+		lambda(q->heap[i].data, closure);
+	}
+}
+
+
+/* }}}1 */
+
+
+
+/* vim: set sts=0 sw=8 ts=8: */
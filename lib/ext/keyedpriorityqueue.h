@@ -0,0 +1,51 @@
+/*
+ * contents: Priority queue ADT with inline priorities.
+ * arch-tag: 79d505bc-bb7a-4ec9-92ce-8bb8f6400898
+ *
+ * Copyright (C) 2004 Nikolai Weibull <source@pcppopper.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+
+
+#ifndef KEYEDPRIORITYQUEUE_H
+#define KEYEDPRIORITYQUEUE_H
+
+
+typedef struct _KeyedPriorityQueue KeyedPriorityQueue;
+
+
+KeyedPriorityQueue *keyed_priority_queue_new(void);
+KeyedPriorityQueue *keyed_priority_queue_sized_new(size_t size);
+KeyedPriorityQueue *keyed_priority_queue_new_dary(size_t arity);
+void keyed_priority_queue_release(KeyedPriorityQueue *q);
+void keyed_priority_queue_push(KeyedPriorityQueue *q,
+			       double key,
+			       pointer data);
+pointer keyed_priority_queue_pop(KeyedPriorityQueue *q, double *key);
+pointer keyed_priority_queue_peek(KeyedPriorityQueue *q, double *key);
+int keyed_priority_queue_length(KeyedPriorityQueue *q);
+bool keyed_priority_queue_empty(KeyedPriorityQueue *q);
+void keyed_priority_queue_map(KeyedPriorityQueue *q,
+			      MapFunc lambda,
+			      pointer closure);
+
+
+#endif /* KEYEDPRIORITYQUEUE_H */
+
+
+
+/* vim: set sts=0 sw=8 ts=8: */
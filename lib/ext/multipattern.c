@@ -0,0 +1,673 @@
+/*
+ * contents: Aho-Corasick multi-pattern string search.
+ * arch-tag: 24c217f8-09d7-4e11-a8f6-4e95d575a316
+ *
+ * Copyright (C) 2004 Nikolai Weibull <source@pcppopper.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+
+#include <stdint.h>
+#include <string.h>
+#include <clear/internal.h>
+#include <clear/mem.h>
+#include "multipattern.h"
+
+
+/* {{{1
+ * As with |Pattern|, we use SSE2 on x86, here to skip ahead to the next byte
+ * that can start a match while we're in the root state.
+ */
+#if defined(__GNUC__) && defined(__SSE2__) && \
+    (defined(__x86_64__) || defined(__i386__))
+#  define MULTI_PATTERN_SIMD
+#  include <emmintrin.h>
+#endif
+
+
+/* {{{1
+ * The bit that is set in a transition if the state it leads to has any
+ * output, see |_MultiPattern|.
+ */
+#define MULTI_PATTERN_OUTPUT_FLAG	((uint32_t)1 << 31)
+
+
+/* {{{1
+ * The number of states that we make room for in the transition table to
+ * begin with.  It's doubled whenever the trie needs more, see
+ * |multi_pattern_reserve_state|.
+ */
+#define MULTI_PATTERN_INITIAL_STATES	64
+
+
+/* {{{1
+ * The largest number of distinct first bytes that the patterns may have for
+ * us to skip ahead in the text in search of them, see
+ * |multi_pattern_skip|.  With more of them, the automaton itself does
+ * better.
+ */
+#define MULTI_PATTERN_PREFILTER_MAX	4
+
+
+/* {{{1
+ * Our MultiPattern structure.  The needles are stored one after the other in
+ * ‘bytes’, the one with id i at offsets[i], with a length of lengths[i].
+ *
+ * Once compiled, the Aho-Corasick automaton is a DFA, stored as a dense
+ * transition table in ‘delta’.  Bytes that appear in no needle all lead
+ * back to the root, so we map each byte to a class, with ‘classes’, where
+ * class 0 is for those bytes and the others are for one byte each, and the
+ * table has ‘stride’ columns, one for each class.  States are identified by
+ * the offset of their row in the table, so that following a transition is a
+ * single load, without any multiplications, and the root is 0.  The
+ * MULTI_PATTERN_OUTPUT_FLAG is set in a transition if any needle ends in the
+ * state it leads to.
+ *
+ * The needles that end in a state s, as opposed to in the states of its
+ * suffixes, are outputs[out_start[s / stride]] up to
+ * outputs[out_start[s / stride + 1]], and dict[s / stride] is the nearest
+ * state along the failure links of s where some needle ends, or 0 if there
+ * is none.
+ *
+ * If the needles start with at most MULTI_PATTERN_PREFILTER_MAX different
+ * bytes, those bytes are in ‘prefilter’.
+ */
+struct _MultiPattern {
+	unsigned char *bytes;
+	size_t bytes_length;
+	size_t bytes_allocated;
+	size_t *offsets;
+	size_t *lengths;
+	size_t size;
+	size_t allocated;
+	size_t max_length;
+
+	bool compiled;
+	uint16_t classes[256];
+	size_t stride;
+	uint32_t *delta;
+	size_t *out_start;
+	size_t *outputs;
+	uint32_t *dict;
+	unsigned char prefilter[MULTI_PATTERN_PREFILTER_MAX];
+	int n_prefilter;
+};
+
+
+/* {{{1
+ * Create a new, empty, multi-pattern.  Add needles to it with
+ * |multi_pattern_add|, and then compile it with |multi_pattern_compile|
+ * before searching with it.
+ */
+MultiPattern *
+multi_pattern_new(void)
+{
+	MultiPattern *mp = new_struct(MultiPattern);
+	mp->bytes_length = 0;
+	mp->bytes_allocated = 64;
+	mp->bytes = new_array(unsigned char, mp->bytes_allocated);
+	mp->size = 0;
+	mp->allocated = 8;
+	mp->offsets = new_array(size_t, mp->allocated);
+	mp->lengths = new_array(size_t, mp->allocated);
+	mp->max_length = 0;
+
+	mp->compiled = false;
+	mp->stride = 0;
+	mp->delta = null;
+	mp->out_start = null;
+	mp->outputs = null;
+	mp->dict = null;
+	mp->n_prefilter = 0;
+
+	return mp;
+}
+
+
+/* {{{1
+ * Release the automaton of ‘mp’, if it's been compiled.
+ */
+static void
+multi_pattern_release_automaton(MultiPattern *mp)
+{
+	unless (mp->compiled) {
+		return;
+	}
+
+	release(mp->delta);
+	release(mp->out_start);
+	release(mp->outputs);
+	release(mp->dict);
+	mp->compiled = false;
+}
+
+
+/* {{{1
+ * Release ‘mp’.
+ */
+void
+multi_pattern_release(MultiPattern *mp)
+{
+	multi_pattern_release_automaton(mp);
+	release(mp->bytes);
+	release(mp->offsets);
+	release(mp->lengths);
+	release(mp);
+}
+
+
+/* {{{1
+ * Add the ‘length’ bytes at ‘needle’ to the needles of ‘mp’.  They may be
+ * any bytes, but there must be at least one of them.  The bytes are copied,
+ * so ‘needle’ needn't outlive ‘mp’.  Returns the id of the needle, which is
+ * the number of needles that were added before it.  ‘mp’ must be compiled
+ * again before it's used for searching.
+ */
+size_t
+multi_pattern_add(MultiPattern *mp, const char *needle, size_t length)
+{
+	invariant(needle != null && length > 0);
+
+	multi_pattern_release_automaton(mp);
+
+	if (mp->size == mp->allocated) {
+		mp->allocated *= 2;
+		mp->offsets = resize_array(mp->offsets, size_t, mp->allocated);
+		mp->lengths = resize_array(mp->lengths, size_t, mp->allocated);
+	}
+	if (mp->bytes_length + length > mp->bytes_allocated) {
+		mp->bytes_allocated = MAX(2 * mp->bytes_allocated,
+					  mp->bytes_length + length);
+		mp->bytes = resize_array(mp->bytes, unsigned char,
+					 mp->bytes_allocated);
+	}
+
+	memcpy(mp->bytes + mp->bytes_length, needle, length);
+	mp->offsets[mp->size] = mp->bytes_length;
+	mp->lengths[mp->size] = length;
+	mp->bytes_length += length;
+	mp->max_length = MAX(mp->max_length, length);
+
+	return mp->size++;
+}
+
+
+/* {{{1
+ * Make sure that the transition table of ‘mp’, which has room for
+ * ‘*capacity’ states, has room for state ‘s’ as well, doubling it if it
+ * doesn't.  Returns false if the row of ‘s’ can't be told apart from the
+ * MULTI_PATTERN_OUTPUT_FLAG, and the automaton is thus too large for us.
+ */
+static bool
+multi_pattern_reserve_state(MultiPattern *mp, size_t s, size_t *capacity)
+{
+	if (s + 1 > MULTI_PATTERN_OUTPUT_FLAG / mp->stride) {
+		return false;
+	}
+
+	if (s == *capacity) {
+		size_t old = *capacity;
+		*capacity = MIN(2 * old, mp->bytes_length + 1);
+		mp->delta = resize_array(mp->delta, uint32_t,
+					 *capacity * mp->stride);
+		memset(mp->delta + old * mp->stride, 0,
+		       (*capacity - old) * mp->stride * sizeof(uint32_t));
+	}
+
+	return true;
+}
+
+
+/* {{{1
+ * Build the trie of the needles of ‘mp’ in ‘mp->delta’, growing it as more
+ * states are needed, and fill in the outputs.  Returns the number of states,
+ * or 0 if there are too many of them, see |multi_pattern_reserve_state|.
+ */
+static size_t
+multi_pattern_build_trie(MultiPattern *mp)
+{
+	size_t n_states = 1;
+	size_t capacity = MIN(mp->bytes_length + 1,
+			      MULTI_PATTERN_INITIAL_STATES);
+	mp->delta = new_array(uint32_t, capacity * mp->stride);
+	memset(mp->delta, 0, capacity * mp->stride * sizeof(uint32_t));
+
+	size_t *ends = new_array(size_t, mp->size + 1);
+	size_t *counts = new_array(size_t, mp->bytes_length + 2);
+	memset(counts, 0, (mp->bytes_length + 2) * sizeof(size_t));
+
+	bool fits = true;
+	for (size_t id = 0; fits && id < mp->size; id++) {
+		const unsigned char *x = mp->bytes + mp->offsets[id];
+		uint32_t row = 0;
+		for (size_t i = 0; i < mp->lengths[id]; i++) {
+			size_t next = row + mp->classes[x[i]];
+			if (mp->delta[next] == 0) {
+				unless (multi_pattern_reserve_state(mp,
+						n_states, &capacity)) {
+					fits = false;
+					break;
+				}
+				mp->delta[next] = n_states * mp->stride;
+				n_states++;
+			}
+			row = mp->delta[next];
+		}
+		ends[id] = row / mp->stride;
+		counts[ends[id]]++;
+	}
+
+	unless (fits) {
+		release(counts);
+		release(ends);
+		return 0;
+	}
+
+	mp->out_start = new_array(size_t, n_states + 1);
+	mp->out_start[0] = 0;
+	for (size_t s = 0; s < n_states; s++) {
+		mp->out_start[s + 1] = mp->out_start[s] + counts[s];
+		counts[s] = mp->out_start[s];
+	}
+	mp->outputs = new_array(size_t, mp->size + 1);
+	for (size_t id = 0; id < mp->size; id++) {
+		mp->outputs[counts[ends[id]]++] = id;
+	}
+
+	release(counts);
+	release(ends);
+
+	return n_states;
+}
+
+
+/* {{{1
+ * Check if any needle ends in the state at ‘row’ of ‘mp’, either in the
+ * state itself, or in a suffix of it.
+ */
+static inline bool
+multi_pattern_has_output(MultiPattern *mp, uint32_t row)
+{
+	size_t s = row / mp->stride;
+
+	return mp->out_start[s + 1] > mp->out_start[s] || mp->dict[s] != 0;
+}
+
+
+/* {{{1
+ * Turn the trie of ‘mp’ into the DFA of the Aho-Corasick automaton.  We go
+ * through the states in breadth-first order, so the failure link of a state
+ * always leads to a state whose row has already been completed, and every
+ * transition that the trie lacks can be copied from there.
+ */
+static void
+multi_pattern_build_dfa(MultiPattern *mp, size_t n_states)
+{
+	size_t stride = mp->stride;
+	uint32_t *fail = new_array(uint32_t, n_states);
+	uint32_t *queue = new_array(uint32_t, n_states);
+	size_t head = 0, tail = 0;
+
+	mp->dict = new_array(uint32_t, n_states);
+	fail[0] = 0;
+	mp->dict[0] = 0;
+	for (size_t c = 1; c < stride; c++) {
+		uint32_t child = mp->delta[c];
+		unless (child == 0) {
+			fail[child / stride] = 0;
+			mp->dict[child / stride] = 0;
+			queue[tail++] = child;
+		}
+	}
+
+	while (head < tail) {
+		uint32_t row = queue[head++];
+		uint32_t f = fail[row / stride];
+		for (size_t c = 1; c < stride; c++) {
+			uint32_t child = mp->delta[row + c];
+			if (child == 0) {
+				mp->delta[row + c] = mp->delta[f + c];
+				continue;
+			}
+
+			uint32_t g = mp->delta[f + c];
+			size_t t = g / stride;
+			fail[child / stride] = g;
+			mp->dict[child / stride] =
+				(mp->out_start[t + 1] > mp->out_start[t]) ?
+				g : mp->dict[t];
+			queue[tail++] = child;
+		}
+	}
+
+	for (size_t i = 0; i < n_states * stride; i++) {
+		if (multi_pattern_has_output(mp, mp->delta[i])) {
+			mp->delta[i] |= MULTI_PATTERN_OUTPUT_FLAG;
+		}
+	}
+
+	release(queue);
+	release(fail);
+}
+
+
+/* {{{1
+ * Compile the needles of ‘mp’ into an Aho-Corasick automaton.  This takes
+ * time and space proportional to the number of states of the automaton, at
+ * most the total length of the needles, times the number of distinct bytes
+ * in them.  Returns false, leaving ‘mp’ uncompiled, if the automaton would
+ * have more than 2^31 transitions, which we can't tell apart.  Searching
+ * with the compiled ‘mp’ doesn't modify it, so any number of threads may
+ * search with it at once.
+ */
+bool
+multi_pattern_compile(MultiPattern *mp)
+{
+	if (mp->compiled) {
+		return true;
+	}
+
+	memset(mp->classes, 0, sizeof(mp->classes));
+	size_t n_classes = 1;
+	for (size_t i = 0; i < mp->bytes_length; i++) {
+		if (mp->classes[mp->bytes[i]] == 0) {
+			mp->classes[mp->bytes[i]] = n_classes++;
+		}
+	}
+	mp->stride = n_classes;
+
+	size_t n_states = multi_pattern_build_trie(mp);
+	if (n_states == 0) {
+		release(mp->delta);
+		mp->delta = null;
+		return false;
+	}
+	mp->delta = resize_array(mp->delta, uint32_t, n_states * mp->stride);
+	multi_pattern_build_dfa(mp, n_states);
+
+	mp->n_prefilter = 0;
+	for (size_t id = 0; id < mp->size; id++) {
+		unsigned char c = mp->bytes[mp->offsets[id]];
+		int i = 0;
+		while (i < mp->n_prefilter && mp->prefilter[i] != c) {
+			i++;
+		}
+		if (i < mp->n_prefilter) {
+			continue;
+		}
+		if (mp->n_prefilter == MULTI_PATTERN_PREFILTER_MAX) {
+			mp->n_prefilter = 0;
+			break;
+		}
+		mp->prefilter[mp->n_prefilter++] = c;
+	}
+
+	mp->compiled = true;
+
+	return true;
+}
+
+
+/* {{{1
+ * Get the number of needles in ‘mp’.
+ */
+size_t
+multi_pattern_size(MultiPattern *mp)
+{
+	return mp->size;
+}
+
+
+/* {{{1
+ * Get the length of the needle with id ‘id’ in ‘mp’.
+ */
+size_t
+multi_pattern_length(MultiPattern *mp, size_t id)
+{
+	invariant(id < mp->size);
+
+	return mp->lengths[id];
+}
+
+
+/* {{{1
+ * Find the first byte at or after ‘i’, and before ‘to’, in ‘text’ that some
+ * needle of ‘mp’ starts with.  Returns ‘to’ if there is none.
+ */
+static size_t
+multi_pattern_skip(MultiPattern *mp,
+		   const unsigned char *text,
+		   size_t i,
+		   size_t to)
+{
+	if (mp->n_prefilter == 1) {
+		const unsigned char *p = memchr(text + i, mp->prefilter[0],
+						to - i);
+		return (p != null) ? (size_t)(p - text) : to;
+	}
+
+#ifdef MULTI_PATTERN_SIMD
+	__m128i wanted[MULTI_PATTERN_PREFILTER_MAX];
+	for (int j = 0; j < mp->n_prefilter; j++) {
+		wanted[j] = _mm_set1_epi8((char)mp->prefilter[j]);
+	}
+	while (to - i >= 16) {
+		__m128i v = _mm_loadu_si128((const __m128i *)(text + i));
+		__m128i hits = _mm_cmpeq_epi8(v, wanted[0]);
+		for (int j = 1; j < mp->n_prefilter; j++) {
+			hits = _mm_or_si128(hits, _mm_cmpeq_epi8(v, wanted[j]));
+		}
+		uint32_t mask = _mm_movemask_epi8(hits);
+		unless (mask == 0) {
+			return i + __builtin_ctz(mask);
+		}
+		i += 16;
+	}
+#endif
+
+	for (; i < to; i++) {
+		for (int j = 0; j < mp->n_prefilter; j++) {
+			if (text[i] == mp->prefilter[j]) {
+				return i;
+			}
+		}
+	}
+
+	return to;
+}
+
+
+/* {{{1
+ * Report the needles of ‘mp’ that end in the state at ‘row’, at offset
+ * ‘end’, through ‘lambda’.  Longer needles are reported before shorter ones
+ * and, among needles of the same length, in the order they were added.
+ * Returns false if ‘lambda’ did.
+ */
+static bool
+multi_pattern_report(MultiPattern *mp,
+		     uint32_t row,
+		     size_t end,
+		     MultiPatternMapFunc lambda,
+		     pointer closure)
+{
+	do {
+		size_t s = row / mp->stride;
+		size_t end_k = mp->out_start[s + 1];
+		for (size_t k = mp->out_start[s]; k < end_k; k++) {
+			size_t id = mp->outputs[k];
+			unless (lambda(id, end - mp->lengths[id], closure)) {
+				return false;
+			}
+		}
+		row = mp->dict[s];
+	} while (row != 0);
+
+	return true;
+}
+
+
+/* {{{1
+ * Run the automaton of ‘mp’ over the bytes of ‘text’ from ‘from’ up to ‘to’,
+ * starting in the state at ‘*row’, and reporting each match through
+ * ‘lambda’, see |multi_pattern_report|.  The state we end up in is stored in
+ * ‘*row’, so that we may continue from there.  Returns the offset of the
+ * byte after which ‘lambda’ returned false, or ‘to’ if it never did.
+ */
+static size_t
+multi_pattern_run(MultiPattern *mp,
+		  const unsigned char *text,
+		  size_t from,
+		  size_t to,
+		  uint32_t *row,
+		  MultiPatternMapFunc lambda,
+		  pointer closure)
+{
+	uint32_t r = *row;
+
+	for (size_t i = from; i < to; i++) {
+		if (r == 0 && mp->n_prefilter > 0) {
+			i = multi_pattern_skip(mp, text, i, to);
+			if (i == to) {
+				break;
+			}
+		}
+
+		uint32_t next = mp->delta[r + mp->classes[text[i]]];
+		r = next & ~MULTI_PATTERN_OUTPUT_FLAG;
+		if ((next & MULTI_PATTERN_OUTPUT_FLAG) &&
+		    !multi_pattern_report(mp, r, i + 1, lambda, closure)) {
+			*row = r;
+			return i;
+		}
+	}
+
+	*row = r;
+	return to;
+}
+
+
+/* {{{1
+ * The leftmost match found so far by |multi_pattern_search|.
+ */
+typedef struct _MultiPatternMatch MultiPatternMatch;
+
+struct _MultiPatternMatch {
+	size_t offset;
+	size_t id;
+};
+
+
+/* {{{1
+ * Record the first match found by |multi_pattern_search| and stop.
+ */
+static bool
+multi_pattern_first(size_t id, size_t offset, pointer closure)
+{
+	MultiPatternMatch *match = closure;
+	match->offset = offset;
+	match->id = id;
+
+	return false;
+}
+
+
+/* {{{1
+ * Record a match found by |multi_pattern_search| if it's further to the left
+ * than the one we have, or starts at the same offset and has a lower id.
+ */
+static bool
+multi_pattern_leftmost(size_t id, size_t offset, pointer closure)
+{
+	MultiPatternMatch *match = closure;
+	if (offset < match->offset ||
+	    (offset == match->offset && id < match->id)) {
+		match->offset = offset;
+		match->id = id;
+	}
+
+	return true;
+}
+
+
+/* {{{1
+ * Search for the needles of ‘mp’ in the ‘n’ bytes of ‘text’, starting at
+ * offset ‘pos’.  Returns the offset of the leftmost match at or after ‘pos’,
+ * or MULTI_PATTERN_NO_MATCH if there is none, like |pattern_search|.  If
+ * several needles match there, the one that was added first wins.  Its id is
+ * stored in ‘*id’, unless ‘id’ is ‹null›.
+ *
+ * The automaton finds matches in the order they end, so once it's found
+ * one, we keep going for as long as a match that starts further to the left
+ * could still end, which is at most the length of the longest needle.
+ */
+size_t
+multi_pattern_search(MultiPattern *mp,
+		     const char *text,
+		     size_t n,
+		     size_t pos,
+		     size_t *id)
+{
+	invariant(mp->compiled);
+
+	if (pos >= n) {
+		return MULTI_PATTERN_NO_MATCH;
+	}
+
+	const unsigned char *y = (const unsigned char *)text;
+	MultiPatternMatch match;
+	uint32_t row = 0;
+	size_t i = multi_pattern_run(mp, y, pos, n, &row, multi_pattern_first,
+				     &match);
+	if (i == n) {
+		return MULTI_PATTERN_NO_MATCH;
+	}
+
+	multi_pattern_run(mp, y, i + 1, MIN(n, match.offset + mp->max_length),
+			  &row, multi_pattern_leftmost, &match);
+	unless (id == null) {
+		*id = match.id;
+	}
+
+	return match.offset;
+}
+
+
+/* {{{1
+ * Call ‘lambda’ with the id and offset of every match of every needle of
+ * ‘mp’ in the ‘n’ bytes of ‘text’, including overlapping ones, in a single
+ * pass over the text.  Matches are reported in the order they end, see
+ * |multi_pattern_report|.  If ‘lambda’ returns false, the search stops.
+ */
+void
+multi_pattern_map(MultiPattern *mp,
+		  const char *text,
+		  size_t n,
+		  MultiPatternMapFunc lambda,
+		  pointer closure)
+{
+	invariant(mp->compiled);
+
+	uint32_t row = 0;
+	multi_pattern_run(mp, (const unsigned char *)text, 0, n, &row,
+			  lambda, closure);
+}
+
+
+/* }}}1 */
+
+
+
+/* vim: set sts=0 sw=8 ts=8: */
@@ -0,0 +1,60 @@
+/*
+ * contents: Aho-Corasick multi-pattern string search.
+ * arch-tag: 1cede6d5-5c9a-4ea6-8a74-c33298004cbf
+ *
+ * Copyright (C) 2004 Nikolai Weibull <source@pcppopper.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+
+
+#ifndef MULTIPATTERN_H
+#define MULTIPATTERN_H
+
+
+#define MULTI_PATTERN_NO_MATCH	((size_t)-1)
+
+
+typedef struct _MultiPattern MultiPattern;
+
+typedef bool (*MultiPatternMapFunc)(size_t id, size_t offset, pointer closure);
+
+
+MultiPattern *multi_pattern_new(void);
+void multi_pattern_release(MultiPattern *mp);
+
+size_t multi_pattern_add(MultiPattern *mp, const char *needle, size_t length);
+bool multi_pattern_compile(MultiPattern *mp);
+size_t multi_pattern_size(MultiPattern *mp);
+size_t multi_pattern_length(MultiPattern *mp, size_t id);
+
+size_t multi_pattern_search(MultiPattern *mp,
+			    const char *text,
+			    size_t n,
+			    size_t pos,
+			    size_t *id);
+void multi_pattern_map(MultiPattern *mp,
+		       const char *text,
+		       size_t n,
+		       MultiPatternMapFunc lambda,
+		       pointer closure);
+
+
+#endif /* MULTIPATTERN_H */
+
+
+
+/* vim: set sts=0 sw=8 ts=8: */
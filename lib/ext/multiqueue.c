@@ -0,0 +1,304 @@
+/*
+ * contents: Relaxed concurrent priority queue (MultiQueue) ADT.
+ * arch-tag: faa3502c-9a3a-4d0e-bed9-3aa07ae29a29
+ *
+ * Copyright (C) 2004 Nikolai Weibull <source@pcppopper.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+
+#include <sched.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <clear/internal.h>
+#include <clear/mem.h>
+#include "priorityqueue.h"
+#include "multiqueue.h"
+
+
+/* {{{1
+ * The size of a cache line.  Each heap is padded and aligned to this size, so
+ * that threads working on neighbouring heaps don't fight over the same line.
+ */
+#define MULTI_QUEUE_CACHE_LINE		64
+
+
+/* {{{1
+ * The number of times we spin on a busy lock before we start yielding the
+ * processor to other threads, one of which may well be holding it.
+ */
+#define MULTI_QUEUE_SPINS		64
+
+
+/* {{{1
+ * Tell the processor that we're spinning on a lock.  On x86, ‘pause’ keeps
+ * the spinning thread from flooding the memory pipeline and hogging the core
+ * from its hyper-thread sibling.  Elsewhere, we don't have anything better.
+ */
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#  define multi_queue_pause()	__builtin_ia32_pause()
+#else
+#  define multi_queue_pause()
+#endif
+
+
+/* {{{1
+ * A heap, and the spin lock that protects it.
+ */
+typedef union _MultiQueueHeap MultiQueueHeap;
+
+union _MultiQueueHeap {
+	struct {
+		PriorityQueue *q;
+		bool locked;
+	} s;
+	char padding[MULTI_QUEUE_CACHE_LINE];
+} __attribute__((aligned(MULTI_QUEUE_CACHE_LINE)));
+
+
+/* {{{1
+ * Our MultiQueue structure.  It's a relaxed priority queue made up of ‘n’
+ * ordinary |PriorityQueue|s, each with its own lock, see |multi_queue_new|.
+ */
+struct _MultiQueue {
+	CompareFunc compare;
+	MultiQueueHeap *heaps;
+	size_t n;
+};
+
+
+/* {{{1
+ * The state of each thread's random number generator.  It's seeded lazily,
+ * see |multi_queue_random|.
+ */
+static __thread uint64_t s_random_state;
+
+
+/* {{{1
+ * Get a random heap index in [0, ‘n’).  We use a xorshift generator, as it's
+ * cheap and good enough for picking heaps.  Each thread seeds its generator
+ * with the address of its own state, which is unique to it.
+ */
+static inline size_t
+multi_queue_random(MultiQueue *mq)
+{
+	if (s_random_state == 0) {
+		s_random_state = (uintptr_t)&s_random_state | 1;
+	}
+
+	s_random_state ^= s_random_state << 13;
+	s_random_state ^= s_random_state >> 7;
+	s_random_state ^= s_random_state << 17;
+
+	return s_random_state % mq->n;
+}
+
+
+/* {{{1
+ * Try to lock heap ‘h’ without waiting.  Returns true if we got it.
+ */
+static inline bool
+multi_queue_heap_trylock(MultiQueueHeap *h)
+{
+	return !__atomic_load_n(&h->s.locked, __ATOMIC_RELAXED) &&
+		!__atomic_test_and_set(&h->s.locked, __ATOMIC_ACQUIRE);
+}
+
+
+/* {{{1
+ * Lock heap ‘h’, waiting for it if necessary.  We spin for a while, as locks
+ * are held only briefly, and then yield, in case the thread holding the lock
+ * isn't running.
+ */
+static inline void
+multi_queue_heap_lock(MultiQueueHeap *h)
+{
+	for (int spins = 0; !multi_queue_heap_trylock(h); spins++) {
+		if (spins < MULTI_QUEUE_SPINS) {
+			multi_queue_pause();
+		} else {
+			sched_yield();
+		}
+	}
+}
+
+
+/* {{{1
+ * Unlock heap ‘h’.
+ */
+static inline void
+multi_queue_heap_unlock(MultiQueueHeap *h)
+{
+	__atomic_clear(&h->s.locked, __ATOMIC_RELEASE);
+}
+
+
+/* {{{1
+ * Create a new MultiQueue made up of ‘n’ heaps, ordered by ‘compare’.  Any
+ * number of threads may push and pop concurrently.  A push goes to a random
+ * heap, and a pop takes the better of the tops of two random heaps, so
+ * threads rarely contend for the same lock, and throughput scales with the
+ * number of threads as long as ‘n’ is a few times larger than it; c·p heaps
+ * for p threads, with c between 2 and 4, is a good choice.
+ *
+ * The price is that the ordering is relaxed: |multi_queue_pop| doesn't
+ * necessarily return the item with highest priority.  With ‘n’ heaps, the
+ * expected rank of the item it returns (0 being the best item in the queue)
+ * is O(‘n’), and the probability of the rank being much larger than that
+ * falls off exponentially.  Items pushed by one thread and popped by
+ * another also come out in no particular order relative to each other, even
+ * when they have the same priority.  Use a |PriorityQueue| when an exact
+ * ordering is needed.
+ *
+ * The heaps are allocated on a cache line boundary, so that each one has a
+ * line of its own.  Returns ‹null› if there's no memory for them.
+ */
+MultiQueue *
+multi_queue_new(CompareFunc compare, size_t n)
+{
+	invariant(compare != null);
+	invariant(n >= 2);
+
+	pointer heaps;
+	unless (posix_memalign(&heaps, MULTI_QUEUE_CACHE_LINE,
+			       n * sizeof(MultiQueueHeap)) == 0) {
+		return null;
+	}
+
+	MultiQueue *mq = new_struct(MultiQueue);
+	mq->compare = compare;
+	mq->n = n;
+	mq->heaps = heaps;
+	for (size_t i = 0; i < n; i++) {
+		mq->heaps[i].s.q = priority_queue_new(compare, null);
+		mq->heaps[i].s.locked = false;
+	}
+
+	return mq;
+}
+
+
+/* {{{1
+ * Release all resources associated with the given MultiQueue.  No other
+ * thread may be using it at this point.
+ */
+void
+multi_queue_release(MultiQueue *mq)
+{
+	invariant(mq != null);
+
+	for (size_t i = 0; i < mq->n; i++) {
+		priority_queue_release(mq->heaps[i].s.q);
+	}
+	/* the heaps come from |posix_memalign|, not from |new_array| */
+	free(mq->heaps);
+	release(mq);
+}
+
+
+/* {{{1
+ * Push ‘data’ on the MultiQueue.  We keep picking random heaps until we find
+ * one that isn't locked by another thread.
+ */
+void
+multi_queue_push(MultiQueue *mq, pointer data)
+{
+	invariant(mq != null);
+
+	MultiQueueHeap *h;
+	do {
+		h = &mq->heaps[multi_queue_random(mq)];
+	} until (multi_queue_heap_trylock(h));
+
+	priority_queue_push(h->s.q, data);
+	multi_queue_heap_unlock(h);
+}
+
+
+/* {{{1
+ * Pop an item from the first non-empty heap, starting at heap ‘i’, waiting
+ * for each heap's lock in turn.  This is the slow path of |multi_queue_pop|,
+ * used once random picks keep finding empty heaps.
+ */
+static pointer
+multi_queue_pop_sweep(MultiQueue *mq, size_t i)
+{
+	for (size_t k = 0; k < mq->n; k++) {
+		MultiQueueHeap *h = &mq->heaps[(i + k) % mq->n];
+
+		multi_queue_heap_lock(h);
+		pointer data = priority_queue_pop(h->s.q);
+		multi_queue_heap_unlock(h);
+
+		if (data != null) {
+			return data;
+		}
+	}
+
+	return null;
+}
+
+
+/* {{{1
+ * Pop an item with high priority off of the MultiQueue, see
+ * |multi_queue_new| for how high.  We lock a random heap and then try to
+ * lock a second one; if we get both, we pop from the one whose top item has
+ * the higher priority.  If the second heap is busy, we make do with the
+ * first.  Returns ‹null› if the queue is empty.  As a push may be in
+ * progress on another thread, this may happen just as an item arrives.
+ */
+pointer
+multi_queue_pop(MultiQueue *mq)
+{
+	invariant(mq != null);
+
+	MultiQueueHeap *h;
+	size_t i;
+	do {
+		i = multi_queue_random(mq);
+		h = &mq->heaps[i];
+	} until (multi_queue_heap_trylock(h));
+
+	size_t j = multi_queue_random(mq);
+	if (j != i && multi_queue_heap_trylock(&mq->heaps[j])) {
+		MultiQueueHeap *other = &mq->heaps[j];
+		pointer a = priority_queue_peek(h->s.q);
+		pointer b = priority_queue_peek(other->s.q);
+
+		if (a == null || (b != null && mq->compare(b, a) < 0)) {
+			multi_queue_heap_unlock(h);
+			h = other;
+		} else {
+			multi_queue_heap_unlock(other);
+		}
+	}
+
+	pointer data = priority_queue_pop(h->s.q);
+	multi_queue_heap_unlock(h);
+
+	if (data == null) {
+		return multi_queue_pop_sweep(mq, i);
+	}
+
+	return data;
+}
+
+
+/* }}}1 */
+
+
+
+/* vim: set sts=0 sw=8 ts=8: */
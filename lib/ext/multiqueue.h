@@ -0,0 +1,41 @@
+/*
+ * contents: Relaxed concurrent priority queue (MultiQueue) ADT.
+ * arch-tag: 8bf654c7-20ab-48d6-ba30-2f72a03c891e
+ *
+ * Copyright (C) 2004 Nikolai Weibull <source@pcppopper.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+
+
+#ifndef MULTIQUEUE_H
+#define MULTIQUEUE_H
+
+
+typedef struct _MultiQueue MultiQueue;
+
+
+MultiQueue *multi_queue_new(CompareFunc compare, size_t n);
+void multi_queue_release(MultiQueue *mq);
+void multi_queue_push(MultiQueue *mq, pointer data);
+pointer multi_queue_pop(MultiQueue *mq);
+
+
+#endif /* MULTIQUEUE_H */
+
+
+
+/* vim: set sts=0 sw=8 ts=8: */
@@ -0,0 +1,457 @@
+/*
+ * contents: Precompiled single-pattern string search.
+ * arch-tag: 58d1f500-fcd0-41ca-8ab0-a44dd600c5d3
+ *
+ * Copyright (C) 2004 Nikolai Weibull <source@pcppopper.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+
+#include <stdint.h>
+#include <string.h>
+#include <clear/internal.h>
+#include <clear/mem.h>
+#include "pattern.h"
+
+
+/* {{{1
+ * On x86 we filter candidate positions sixteen or thirty-two at a time with
+ * SSE2 or AVX2.  SSE2 is always there on x86-64, but AVX2 may not be, so its
+ * scanner is compiled for it separately and only picked if the CPU we run on
+ * supports it, see |pattern_new|.
+ */
+#if defined(__GNUC__) && defined(__SSE2__) && \
+    (defined(__x86_64__) || defined(__i386__))
+#  define PATTERN_SIMD
+#  include <immintrin.h>
+#endif
+
+
+/* {{{1
+ * A function that searches for a |Pattern|, see |pattern_search|.
+ */
+typedef size_t (*PatternScanFunc)(Pattern *pattern,
+				  const unsigned char *text,
+				  size_t n,
+				  size_t pos);
+
+
+/* {{{1
+ * Our Pattern structure.  ‘shift’ is the bad-character table of
+ * Boyer-Moore-Horspool, that says how far we may move the window when its
+ * last byte is a given byte.  ‘border’ is the failure function of
+ * Knuth-Morris-Pratt, where border[i] is the length of the longest proper
+ * prefix of the first i + 1 bytes of ‘needle’ that is also a suffix of them.
+ * ‘scan’ is the fastest searcher we have for the CPU we're running on.
+ */
+struct _Pattern {
+	unsigned char *needle;
+	size_t length;
+	size_t shift[256];
+	size_t *border;
+	PatternScanFunc scan;
+};
+
+
+static size_t pattern_scan(Pattern *pattern,
+			   const unsigned char *text,
+			   size_t n,
+			   size_t pos);
+#ifdef PATTERN_SIMD
+static size_t pattern_scan_sse2(Pattern *pattern,
+				const unsigned char *text,
+				size_t n,
+				size_t pos);
+static size_t pattern_scan_avx2(Pattern *pattern,
+				const unsigned char *text,
+				size_t n,
+				size_t pos);
+#endif
+
+
+/* {{{1
+ * Create a new pattern for the ‘length’ bytes at ‘needle’, which may contain
+ * any bytes, including NULs.  The bytes are copied, so ‘needle’ needn't
+ * outlive the pattern.  All the tables the searches need are built here, in
+ * O(m) time, so that searching for the same needle over and over again
+ * doesn't redo it every time.
+ */
+Pattern *
+pattern_new(const char *needle, size_t length)
+{
+	invariant(needle != null || length == 0);
+
+	Pattern *pattern = new_struct(Pattern);
+	pattern->length = length;
+	pattern->needle = new_array(unsigned char, length + 1);
+	pattern->border = new_array(size_t, length + 1);
+	if (length > 0) {
+		memcpy(pattern->needle, needle, length);
+	}
+
+	const unsigned char *x = pattern->needle;
+	for (int c = 0; c < 256; c++) {
+		pattern->shift[c] = length;
+	}
+	for (size_t i = 0; i + 1 < length; i++) {
+		pattern->shift[x[i]] = length - 1 - i;
+	}
+
+	size_t k = 0;
+	for (size_t i = 1; i < length; i++) {
+		while (k > 0 && x[i] != x[k]) {
+			k = pattern->border[k - 1];
+		}
+		if (x[i] == x[k]) {
+			k++;
+		}
+		pattern->border[i] = k;
+	}
+
+	pattern->scan = pattern_scan;
+#ifdef PATTERN_SIMD
+	pattern->scan = pattern_scan_sse2;
+	if (__builtin_cpu_supports("avx2")) {
+		pattern->scan = pattern_scan_avx2;
+	}
+#endif
+
+	return pattern;
+}
+
+
+/* {{{1
+ * Release ‘pattern’.
+ */
+void
+pattern_release(Pattern *pattern)
+{
+	release(pattern->needle);
+	release(pattern->border);
+	release(pattern);
+}
+
+
+/* {{{1
+ * Get the length of the needle of ‘pattern’.
+ */
+size_t
+pattern_length(Pattern *pattern)
+{
+	return pattern->length;
+}
+
+
+/* {{{1
+ * Get the needle of ‘pattern’.  It's |pattern_length| bytes long and is
+ * NUL-terminated, though it may contain NULs as well.
+ */
+const char *
+pattern_needle(Pattern *pattern)
+{
+	return (const char *)pattern->needle;
+}
+
+
+/* {{{1
+ * Handle the cases that all the searches share: an empty needle matches at
+ * ‘pos’ itself, and there can be no match if the needle doesn't fit in what's
+ * left of the text.  Returns true if ‘*result’ has been set to the result of
+ * the search.
+ */
+static inline bool
+pattern_trivial(Pattern *pattern, size_t n, size_t pos, size_t *result)
+{
+	if (pos > n || pattern->length > n - pos) {
+		*result = PATTERN_NO_MATCH;
+		return true;
+	}
+	if (pattern->length == 0) {
+		*result = pos;
+		return true;
+	}
+
+	return false;
+}
+
+
+/* {{{1
+ * Search for ‘pattern’ in the ‘n’ bytes of ‘text’, starting at offset ‘pos’.
+ * Returns the offset of the first match at or after ‘pos’, or
+ * PATTERN_NO_MATCH if there is none.  This uses the fastest method we have,
+ * which, on x86, is to compare the first and last bytes of the needle
+ * against sixteen or thirty-two windows at a time with SSE2 or AVX2, and then
+ * verify only the windows where both match.  Elsewhere, and for what's left
+ * at the end of the text, we use |pattern_bmh_search|.
+ */
+size_t
+pattern_search(Pattern *pattern, const char *text, size_t n, size_t pos)
+{
+	size_t result;
+	if (pattern_trivial(pattern, n, pos, &result)) {
+		return result;
+	}
+
+	if (pattern->length == 1) {
+		const char *match = memchr(text + pos, pattern->needle[0],
+					   n - pos);
+		return (match != null) ? (size_t)(match - text) :
+			PATTERN_NO_MATCH;
+	}
+
+	return pattern->scan(pattern, (const unsigned char *)text, n, pos);
+}
+
+
+/* {{{1
+ * Search for ‘pattern’ in ‘text’ using Boyer-Moore-Horspool.  The arguments
+ * and result are as for |pattern_search|.  This takes O(n/m) time for most
+ * texts, but O(nm) in the worst case.
+ */
+size_t
+pattern_bmh_search(Pattern *pattern, const char *text, size_t n, size_t pos)
+{
+	size_t result;
+	if (pattern_trivial(pattern, n, pos, &result)) {
+		return result;
+	}
+
+	return pattern_scan(pattern, (const unsigned char *)text, n, pos);
+}
+
+
+/* {{{1
+ * Search for ‘pattern’ in ‘text’ using Knuth-Morris-Pratt.  The arguments
+ * and result are as for |pattern_search|.  This always takes O(n) time, as
+ * it looks at each byte of the text once, and never goes back.
+ */
+size_t
+pattern_kmp_search(Pattern *pattern, const char *text, size_t n, size_t pos)
+{
+	size_t result;
+	if (pattern_trivial(pattern, n, pos, &result)) {
+		return result;
+	}
+
+	const unsigned char *x = pattern->needle;
+	const unsigned char *y = (const unsigned char *)text;
+	size_t m = pattern->length;
+	size_t k = 0;
+	for (size_t i = pos; i < n; i++) {
+		while (k > 0 && y[i] != x[k]) {
+			k = pattern->border[k - 1];
+		}
+		if (y[i] == x[k]) {
+			k++;
+		}
+		if (k == m) {
+			return i + 1 - m;
+		}
+	}
+
+	return PATTERN_NO_MATCH;
+}
+
+
+/* {{{1
+ * Count the occurrences of ‘pattern’ in the ‘n’ bytes of ‘text’, overlapping
+ * ones included.  This is what calling |pattern_search| again after each
+ * match would give you, but without checking the arguments again each time,
+ * or calling out to anything for each match.  An empty pattern occurs at
+ * each of the n + 1 offsets.
+ */
+size_t
+pattern_count(Pattern *pattern, const char *text, size_t n)
+{
+	size_t m = pattern->length;
+	if (m == 0) {
+		return n + 1;
+	}
+	if (m > n) {
+		return 0;
+	}
+
+	size_t count = 0;
+	if (m == 1) {
+		const char *p = text, *end = text + n;
+		while ((p = memchr(p, pattern->needle[0], end - p)) != null) {
+			count++;
+			p++;
+		}
+		return count;
+	}
+
+	const unsigned char *y = (const unsigned char *)text;
+	size_t pos = 0;
+	while ((pos = pattern->scan(pattern, y, n, pos)) != PATTERN_NO_MATCH) {
+		count++;
+		pos++;
+	}
+
+	return count;
+}
+
+
+/* {{{1
+ * Call ‘lambda’ with the offset of every occurrence of ‘pattern’ in the ‘n’
+ * bytes of ‘text’, overlapping ones included, in increasing order.  If
+ * ‘lambda’ returns false, the search stops, and so do we, returning false.
+ * Otherwise we return true.
+ */
+bool
+pattern_map(Pattern *pattern,
+	    const char *text,
+	    size_t n,
+	    PatternMapFunc lambda,
+	    pointer closure)
+{
+	size_t pos = 0;
+	while ((pos = pattern_search(pattern, text, n, pos)) !=
+	       PATTERN_NO_MATCH) {
+		unless (lambda(pos, closure)) {
+			return false;
+		}
+		pos++;
+	}
+
+	return true;
+}
+
+
+/* {{{1
+ * The Boyer-Moore-Horspool scanner behind |pattern_bmh_search|, which the
+ * SIMD scanners fall back to as well.  We check the last byte of the window
+ * first, as that's the one we already have at hand for the shift.
+ */
+static size_t
+pattern_scan(Pattern *pattern, const unsigned char *text, size_t n, size_t pos)
+{
+	const unsigned char *x = pattern->needle;
+	size_t m = pattern->length;
+	unsigned char last = x[m - 1];
+
+	while (pos <= n - m) {
+		unsigned char c = text[pos + m - 1];
+		if (c == last && memcmp(text + pos, x, m - 1) == 0) {
+			return pos;
+		}
+		pos += pattern->shift[c];
+	}
+
+	return PATTERN_NO_MATCH;
+}
+
+
+#ifdef PATTERN_SIMD
+/* {{{1
+ * Verify the windows of ‘text’ starting at ‘pos’ plus each bit set in ‘mask’,
+ * where the first and last bytes are already known to match.  Returns the
+ * first match, or PATTERN_NO_MATCH.
+ */
+static inline size_t
+pattern_verify(Pattern *pattern,
+	       const unsigned char *text,
+	       size_t pos,
+	       uint32_t mask)
+{
+	while (mask != 0) {
+		size_t i = pos + __builtin_ctz(mask);
+		if (memcmp(text + i + 1, pattern->needle + 1,
+			   pattern->length - 2) == 0) {
+			return i;
+		}
+		mask &= mask - 1;
+	}
+
+	return PATTERN_NO_MATCH;
+}
+
+
+/* {{{1
+ * The SSE2 scanner behind |pattern_search|.  We load sixteen bytes at ‘pos’
+ * and sixteen at the last byte of the window at ‘pos’, and compare them with
+ * the first and last bytes of the needle, respectively, which gives us a bit
+ * for each of the sixteen windows that could be a match.
+ */
+static size_t
+pattern_scan_sse2(Pattern *pattern,
+		  const unsigned char *text,
+		  size_t n,
+		  size_t pos)
+{
+	size_t m = pattern->length;
+	const __m128i first = _mm_set1_epi8((char)pattern->needle[0]);
+	const __m128i last = _mm_set1_epi8((char)pattern->needle[m - 1]);
+
+	while (n - pos >= m - 1 + 16) {
+		__m128i a = _mm_loadu_si128((const __m128i *)(text + pos));
+		__m128i b = _mm_loadu_si128((const __m128i *)
+					    (text + pos + m - 1));
+		uint32_t mask = _mm_movemask_epi8(
+			_mm_and_si128(_mm_cmpeq_epi8(a, first),
+				      _mm_cmpeq_epi8(b, last)));
+		size_t match = pattern_verify(pattern, text, pos, mask);
+		unless (match == PATTERN_NO_MATCH) {
+			return match;
+		}
+		pos += 16;
+	}
+
+	return (pos <= n - m) ? pattern_scan(pattern, text, n, pos) :
+		PATTERN_NO_MATCH;
+}
+
+
+/* {{{1
+ * The AVX2 scanner behind |pattern_search|, which works like
+ * |pattern_scan_sse2|, but with thirty-two windows at a time.
+ */
+__attribute__((target("avx2")))
+static size_t
+pattern_scan_avx2(Pattern *pattern,
+		  const unsigned char *text,
+		  size_t n,
+		  size_t pos)
+{
+	size_t m = pattern->length;
+	const __m256i first = _mm256_set1_epi8((char)pattern->needle[0]);
+	const __m256i last = _mm256_set1_epi8((char)pattern->needle[m - 1]);
+
+	while (n - pos >= m - 1 + 32) {
+		__m256i a = _mm256_loadu_si256((const __m256i *)(text + pos));
+		__m256i b = _mm256_loadu_si256((const __m256i *)
+					       (text + pos + m - 1));
+		uint32_t mask = _mm256_movemask_epi8(
+			_mm256_and_si256(_mm256_cmpeq_epi8(a, first),
+					 _mm256_cmpeq_epi8(b, last)));
+		size_t match = pattern_verify(pattern, text, pos, mask);
+		unless (match == PATTERN_NO_MATCH) {
+			return match;
+		}
+		pos += 32;
+	}
+
+	return (pos <= n - m) ? pattern_scan(pattern, text, n, pos) :
+		PATTERN_NO_MATCH;
+}
+#endif
+
+
+/* }}}1 */
+
+
+
+/* vim: set sts=0 sw=8 ts=8: */
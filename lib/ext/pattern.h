@@ -0,0 +1,66 @@
+/*
+ * contents: Precompiled single-pattern string search.
+ * arch-tag: 6285945f-ddd9-4d44-a400-147879362b97
+ *
+ * Copyright (C) 2004 Nikolai Weibull <source@pcppopper.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+
+
+#ifndef PATTERN_H
+#define PATTERN_H
+
+
+#define PATTERN_NO_MATCH	((size_t)-1)
+
+
+typedef struct _Pattern Pattern;
+
+typedef bool (*PatternMapFunc)(size_t offset, pointer closure);
+
+
+Pattern *pattern_new(const char *needle, size_t length);
+void pattern_release(Pattern *pattern);
+
+size_t pattern_length(Pattern *pattern);
+const char *pattern_needle(Pattern *pattern);
+
+size_t pattern_search(Pattern *pattern,
+		      const char *text,
+		      size_t n,
+		      size_t pos);
+size_t pattern_bmh_search(Pattern *pattern,
+			  const char *text,
+			  size_t n,
+			  size_t pos);
+size_t pattern_kmp_search(Pattern *pattern,
+			  const char *text,
+			  size_t n,
+			  size_t pos);
+size_t pattern_count(Pattern *pattern, const char *text, size_t n);
+bool pattern_map(Pattern *pattern,
+		 const char *text,
+		 size_t n,
+		 PatternMapFunc lambda,
+		 pointer closure);
+
+
+#endif /* PATTERN_H */
+
+
+
+/* vim: set sts=0 sw=8 ts=8: */
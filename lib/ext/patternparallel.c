@@ -0,0 +1,310 @@
+/*
+ * contents: Multi-threaded counting and collecting of Pattern matches.
+ * arch-tag: 418495c0-e092-468d-a84e-379aa22f28b6
+ *
+ * Copyright (C) 2004 Nikolai Weibull <source@pcppopper.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <clear/internal.h>
+#include <clear/mem.h>
+#include "pattern.h"
+#include "patternstream.h"
+#include "patternparallel.h"
+
+
+/* {{{1
+ * A slice of the text that one thread searches.  It's responsible for the
+ * matches that start at offsets from ‘from’ up to ‘to’, so it searches up to
+ * m - 1 bytes past ‘to’ as well, which is where the slices overlap.  It
+ * either counts the matches in ‘count’, or, if ‘collect’ is true, stores
+ * their offsets in ‘offsets’ as well.
+ */
+typedef struct _PatternSlice PatternSlice;
+
+struct _PatternSlice {
+	Pattern *pattern;
+	const char *text;
+	size_t n;
+	size_t from;
+	size_t to;
+	bool collect;
+	size_t count;
+	size_t *offsets;
+	size_t allocated;
+};
+
+
+/* {{{1
+ * Store the offset of a match in the |PatternSlice| ‘closure’.
+ */
+static bool
+pattern_slice_collect(size_t offset, pointer closure)
+{
+	PatternSlice *slice = closure;
+
+	if (slice->count == slice->allocated) {
+		slice->allocated = MAX(2 * slice->allocated, 64);
+		slice->offsets = resize_array(slice->offsets, size_t,
+					      slice->allocated);
+	}
+	slice->offsets[slice->count++] = slice->from + offset;
+
+	return true;
+}
+
+
+/* {{{1
+ * Search the |PatternSlice| ‘arg’.  This is what each thread runs.
+ */
+static void *
+pattern_slice_search(void *arg)
+{
+	PatternSlice *slice = arg;
+	size_t m = pattern_length(slice->pattern);
+	size_t end = (m > 0) ? MIN(slice->n, slice->to + m - 1) : slice->to;
+	const char *text = slice->text + slice->from;
+
+	if (slice->collect) {
+		pattern_map(slice->pattern, text, end - slice->from,
+			    pattern_slice_collect, slice);
+	} else {
+		slice->count = pattern_count(slice->pattern, text,
+					     end - slice->from);
+	}
+
+	return null;
+}
+
+
+/* {{{1
+ * Figure out how many threads to search ‘n’ bytes with, when asked to use
+ * ‘n_threads’ of them.  If ‘n_threads’ isn't positive, we use one for each
+ * processor that is online.  We don't give a thread less than
+ * PATTERN_PARALLEL_MIN_SLICE bytes, as it wouldn't be worth starting it.
+ */
+static int
+pattern_parallel_threads(size_t n, int n_threads)
+{
+	if (n_threads <= 0) {
+		long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+		n_threads = (cpus > 0) ? (int)cpus : 1;
+	}
+
+	size_t most = MAX(n / PATTERN_PARALLEL_MIN_SLICE, 1);
+	if ((size_t)n_threads > most) {
+		n_threads = (int)most;
+	}
+
+	return n_threads;
+}
+
+
+/* {{{1
+ * Split ‘text’ into ‘k’ slices of about the same size, and search them
+ * with ‘k’ threads, one of which is the calling one.  If a thread can't be
+ * started, its slice is searched by the calling thread instead.  Returns the
+ * slices, which the caller must release.
+ */
+static PatternSlice *
+pattern_parallel_search(Pattern *pattern,
+			const char *text,
+			size_t n,
+			int k,
+			bool collect)
+{
+	PatternSlice *slices = new_array(PatternSlice, k);
+	pthread_t *threads = new_array(pthread_t, k);
+	bool *started = new_array(bool, k);
+
+	for (int i = 0; i < k; i++) {
+		slices[i].pattern = pattern;
+		slices[i].text = text;
+		slices[i].n = n;
+		slices[i].from = n / k * i;
+		slices[i].to = (i == k - 1) ? n : n / k * (i + 1);
+		slices[i].collect = collect;
+		slices[i].count = 0;
+		slices[i].offsets = null;
+		slices[i].allocated = 0;
+	}
+
+	for (int i = 1; i < k; i++) {
+		started[i] = (pthread_create(&threads[i], null,
+					     pattern_slice_search,
+					     &slices[i]) == 0);
+	}
+	pattern_slice_search(&slices[0]);
+	for (int i = 1; i < k; i++) {
+		if (started[i]) {
+			pthread_join(threads[i], null);
+		} else {
+			pattern_slice_search(&slices[i]);
+		}
+	}
+
+	release(started);
+	release(threads);
+
+	return slices;
+}
+
+
+/* {{{1
+ * Count the occurrences of ‘pattern’ in the ‘n’ bytes of ‘text’, as
+ * |pattern_count| does, but with ‘n_threads’ threads, see
+ * |pattern_parallel_threads|.  Each thread counts the matches that start in
+ * its own slice of the text, so the slices only overlap by m - 1 bytes, and
+ * no match is counted twice.
+ */
+size_t
+pattern_count_parallel(Pattern *pattern,
+		       const char *text,
+		       size_t n,
+		       int n_threads)
+{
+	int k = pattern_parallel_threads(n, n_threads);
+	if (k == 1 || pattern_length(pattern) == 0) {
+		return pattern_count(pattern, text, n);
+	}
+
+	PatternSlice *slices = pattern_parallel_search(pattern, text, n, k,
+						       false);
+	size_t count = 0;
+	for (int i = 0; i < k; i++) {
+		count += slices[i].count;
+	}
+	release(slices);
+
+	return count;
+}
+
+
+/* {{{1
+ * Find the offsets of all occurrences of ‘pattern’ in the ‘n’ bytes of
+ * ‘text’, overlapping ones included, using ‘n_threads’ threads, as with
+ * |pattern_count_parallel|.  The offsets are stored in increasing order in
+ * an array that is stored in ‘*offsets’, and that the caller must release.
+ * Returns the number of offsets.
+ */
+size_t
+pattern_find_all(Pattern *pattern,
+		 const char *text,
+		 size_t n,
+		 int n_threads,
+		 size_t **offsets)
+{
+	int k = pattern_parallel_threads(n, n_threads);
+	if (pattern_length(pattern) == 0) {
+		k = 1;
+	}
+
+	PatternSlice *slices = pattern_parallel_search(pattern, text, n, k,
+						       true);
+	size_t count = 0;
+	for (int i = 0; i < k; i++) {
+		count += slices[i].count;
+	}
+
+	*offsets = new_array(size_t, count + 1);
+	size_t j = 0;
+	for (int i = 0; i < k; i++) {
+		unless (slices[i].offsets == null) {
+			memcpy(*offsets + j, slices[i].offsets,
+			       slices[i].count * sizeof(size_t));
+			release(slices[i].offsets);
+		}
+		j += slices[i].count;
+	}
+	release(slices);
+
+	return count;
+}
+
+
+/* {{{1
+ * Count a match found by |pattern_map_fd| in |pattern_count_file|.
+ */
+static bool
+pattern_count_match(size_t offset, pointer closure)
+{
+	(*(size_t *)closure)++;
+
+	return true;
+}
+
+
+/* {{{1
+ * Count the occurrences of ‘pattern’, which mustn't be empty, in the file at
+ * ‘path’, storing the count in ‘*count’.  Regular files are mapped into
+ * memory and split between ‘n_threads’ threads, as with
+ * |pattern_count_parallel|.  Other files are read in chunks, see
+ * |pattern_map_file|.  Returns false, with errno set, if the file can't be
+ * opened or read.
+ */
+bool
+pattern_count_file(Pattern *pattern,
+		   const char *path,
+		   int n_threads,
+		   size_t *count)
+{
+	invariant(pattern_length(pattern) > 0);
+
+	int fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		return false;
+	}
+
+	struct stat st;
+	pointer map = MAP_FAILED;
+	if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0 &&
+	    (uintmax_t)st.st_size <= SIZE_MAX) {
+		map = mmap(null, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	}
+
+	bool ok = true;
+	*count = 0;
+	if (map != MAP_FAILED) {
+		*count = pattern_count_parallel(pattern, map, st.st_size,
+						n_threads);
+		munmap(map, st.st_size);
+	} else {
+		ok = pattern_map_fd(pattern, fd, PATTERN_STREAM_CHUNK_SIZE,
+				    pattern_count_match, count);
+	}
+
+	int saved_errno = errno;
+	close(fd);
+	errno = saved_errno;
+
+	return ok;
+}
+
+
+/* }}}1 */
+
+
+
+/* vim: set sts=0 sw=8 ts=8: */
@@ -0,0 +1,50 @@
+/*
+ * contents: Multi-threaded counting and collecting of Pattern matches.
+ * arch-tag: c042ed16-ed07-45ce-a7c2-3b286b2d3828
+ *
+ * Copyright (C) 2004 Nikolai Weibull <source@pcppopper.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+
+
+#ifndef PATTERNPARALLEL_H
+#define PATTERNPARALLEL_H
+
+
+#define PATTERN_PARALLEL_MIN_SLICE	(1 << 20)
+
+
+size_t pattern_count_parallel(Pattern *pattern,
+			      const char *text,
+			      size_t n,
+			      int n_threads);
+size_t pattern_find_all(Pattern *pattern,
+			const char *text,
+			size_t n,
+			int n_threads,
+			size_t **offsets);
+bool pattern_count_file(Pattern *pattern,
+			const char *path,
+			int n_threads,
+			size_t *count);
+
+
+#endif /* PATTERNPARALLEL_H */
+
+
+
+/* vim: set sts=0 sw=8 ts=8: */
@@ -0,0 +1,317 @@
+/*
+ * contents: Streaming search of chunked input and files for a Pattern.
+ * arch-tag: 24e727a0-6867-4587-ad5e-026441e1724f
+ *
+ * Copyright (C) 2004 Nikolai Weibull <source@pcppopper.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <clear/internal.h>
+#include <clear/mem.h>
+#include "pattern.h"
+#include "patternstream.h"
+
+
+/* {{{1
+ * Our PatternStream structure.  A match may start in one chunk and end in
+ * the next, so we hold on to the last m - 1 bytes we've been fed in ‘carry’,
+ * which are the only ones such a match can start in, and look for matches
+ * that start there in ‘window’, which has room for them and the first m - 1
+ * bytes of the next chunk.  ‘offset’ is the number of bytes we've been fed,
+ * that is, the offset of the next chunk in the stream, and every match that
+ * starts before ‘done’ has been reported.
+ */
+struct _PatternStream {
+	Pattern *pattern;
+	PatternMapFunc lambda;
+	pointer closure;
+	unsigned char *carry;
+	size_t carry_length;
+	unsigned char *window;
+	size_t offset;
+	size_t done;
+	bool stopped;
+};
+
+
+/* {{{1
+ * Create a new stream that searches for ‘pattern’, which must be non-empty,
+ * in the chunks it's fed with |pattern_stream_feed|, calling ‘lambda’ with
+ * the offset in the stream of each occurrence, like |pattern_map|.  Only
+ * 2(m - 1) bytes are kept between chunks, so the memory needed doesn't grow
+ * with the size of the input.
+ */
+PatternStream *
+pattern_stream_new(Pattern *pattern, PatternMapFunc lambda, pointer closure)
+{
+	invariant(pattern_length(pattern) > 0);
+
+	size_t m = pattern_length(pattern);
+	PatternStream *stream = new_struct(PatternStream);
+	stream->pattern = pattern;
+	stream->lambda = lambda;
+	stream->closure = closure;
+	stream->carry = new_array(unsigned char, m);
+	stream->carry_length = 0;
+	stream->window = new_array(unsigned char, 2 * m);
+	stream->offset = 0;
+	stream->done = 0;
+	stream->stopped = false;
+
+	return stream;
+}
+
+
+/* {{{1
+ * Release ‘stream’.  Its |Pattern| is left alone.
+ */
+void
+pattern_stream_release(PatternStream *stream)
+{
+	release(stream->carry);
+	release(stream->window);
+	release(stream);
+}
+
+
+/* {{{1
+ * The closure of |pattern_stream_report|.
+ */
+typedef struct _PatternStreamChunk PatternStreamChunk;
+
+struct _PatternStreamChunk {
+	PatternStream *stream;
+	size_t base;
+};
+
+
+/* {{{1
+ * Report a match at ‘offset’ in the current chunk of a stream, which is at
+ * ‘base’ in the stream.
+ */
+static bool
+pattern_stream_report(size_t offset, pointer closure)
+{
+	PatternStreamChunk *chunk = closure;
+
+	return chunk->stream->lambda(chunk->base + offset,
+				     chunk->stream->closure);
+}
+
+
+/* {{{1
+ * Look for matches in ‘stream’ that start in the bytes carried over from
+ * the previous chunks and end in the first bytes of ‘chunk’.  Returns false
+ * if the lambda of ‘stream’ did.
+ */
+static bool
+pattern_stream_feed_window(PatternStream *stream,
+			   const char *chunk,
+			   size_t n)
+{
+	size_t m = pattern_length(stream->pattern);
+	size_t cl = stream->carry_length;
+	size_t k = MIN(n, m - 1);
+	size_t base = stream->offset - cl;
+
+	memcpy(stream->window, stream->carry, cl);
+	memcpy(stream->window + cl, chunk, k);
+
+	size_t pos = stream->done - base;
+	while ((pos = pattern_search(stream->pattern,
+				     (const char *)stream->window, cl + k,
+				     pos)) < cl) {
+		unless (stream->lambda(base + pos, stream->closure)) {
+			return false;
+		}
+		pos++;
+	}
+
+	return true;
+}
+
+
+/* {{{1
+ * Hold on to the last m - 1 bytes we've seen in ‘stream’, now that it's been
+ * fed ‘chunk’ as well.
+ */
+static void
+pattern_stream_carry(PatternStream *stream, const char *chunk, size_t n)
+{
+	size_t m = pattern_length(stream->pattern);
+
+	if (n >= m - 1) {
+		memcpy(stream->carry, chunk + n - (m - 1), m - 1);
+		stream->carry_length = m - 1;
+		return;
+	}
+
+	size_t keep = MIN(stream->carry_length, m - 1 - n);
+	memmove(stream->carry, stream->carry + stream->carry_length - keep,
+		keep);
+	memcpy(stream->carry + keep, chunk, n);
+	stream->carry_length = keep + n;
+}
+
+
+/* {{{1
+ * Feed the ‘n’ bytes of ‘chunk’ to ‘stream’, reporting each match that ends
+ * in them.  Each chunk is searched in place, with the fastest method
+ * |pattern_search| has, and only the bytes around its start are copied.
+ * Returns false if the lambda of ‘stream’ returned false, now or during an
+ * earlier call, in which case nothing more is done.
+ */
+bool
+pattern_stream_feed(PatternStream *stream, const char *chunk, size_t n)
+{
+	if (stream->stopped) {
+		return false;
+	}
+
+	PatternStreamChunk closure = { stream, stream->offset };
+	if ((stream->carry_length > 0 &&
+	     !pattern_stream_feed_window(stream, chunk, n)) ||
+	    !pattern_map(stream->pattern, chunk, n, pattern_stream_report,
+			 &closure)) {
+		stream->stopped = true;
+		return false;
+	}
+
+	size_t m = pattern_length(stream->pattern);
+	pattern_stream_carry(stream, chunk, n);
+	stream->offset += n;
+	stream->done = (stream->offset >= m - 1) ?
+		stream->offset - (m - 1) : 0;
+
+	return true;
+}
+
+
+/* {{{1
+ * Get the number of bytes that have been fed to ‘stream’.
+ */
+size_t
+pattern_stream_offset(PatternStream *stream)
+{
+	return stream->offset;
+}
+
+
+/* {{{1
+ * Search for ‘pattern’ in everything that can be read from the file
+ * descriptor ‘fd’, reading it ‘chunk_size’ bytes at a time, as with
+ * |pattern_map|, but with offsets relative to where we started reading.
+ * This works for pipes and sockets as well, and needs no more memory than
+ * that for a chunk.  As with |pattern_stream_new|, ‘pattern’ mustn't be
+ * empty.  Returns false, with errno set, if reading fails, and
+ * true otherwise, also if ‘lambda’ stopped the search.
+ */
+bool
+pattern_map_fd(Pattern *pattern,
+	       int fd,
+	       size_t chunk_size,
+	       PatternMapFunc lambda,
+	       pointer closure)
+{
+	invariant(chunk_size > 0);
+
+	char *buffer = new_array(char, chunk_size);
+	PatternStream *stream = pattern_stream_new(pattern, lambda, closure);
+	bool ok = true;
+
+	while (true) {
+		ssize_t n = read(fd, buffer, chunk_size);
+		if (n < 0 && errno == EINTR) {
+			continue;
+		}
+		if (n <= 0) {
+			ok = (n == 0);
+			break;
+		}
+		unless (pattern_stream_feed(stream, buffer, n)) {
+			break;
+		}
+	}
+
+	int saved_errno = errno;
+	pattern_stream_release(stream);
+	release(buffer);
+	errno = saved_errno;
+
+	return ok;
+}
+
+
+/* {{{1
+ * Search for ‘pattern’ in the file at ‘path’, as with |pattern_map|.  Regular
+ * files are mapped into memory and searched in one go, which avoids copying
+ * them, and lets the kernel page them in and out as we go, so files much
+ * larger than memory can be searched.  If the file can't be mapped, it's
+ * read in chunks of PATTERN_STREAM_CHUNK_SIZE bytes instead, see
+ * |pattern_map_fd|, so ‘pattern’ mustn't be empty.  Returns false, with
+ * errno set, if the file can't be opened or read.
+ */
+bool
+pattern_map_file(Pattern *pattern,
+		 const char *path,
+		 PatternMapFunc lambda,
+		 pointer closure)
+{
+	invariant(pattern_length(pattern) > 0);
+
+	int fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		return false;
+	}
+
+	struct stat st;
+	pointer map = MAP_FAILED;
+	if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0 &&
+	    (uintmax_t)st.st_size <= SIZE_MAX) {
+		map = mmap(null, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	}
+
+	bool ok = true;
+	if (map != MAP_FAILED) {
+		madvise(map, st.st_size, MADV_SEQUENTIAL);
+		pattern_map(pattern, map, st.st_size, lambda, closure);
+		munmap(map, st.st_size);
+	} else {
+		ok = pattern_map_fd(pattern, fd, PATTERN_STREAM_CHUNK_SIZE,
+				    lambda, closure);
+	}
+
+	int saved_errno = errno;
+	close(fd);
+	errno = saved_errno;
+
+	return ok;
+}
+
+
+/* }}}1 */
+
+
+
+/* vim: set sts=0 sw=8 ts=8: */
@@ -0,0 +1,59 @@
+/*
+ * contents: Streaming search of chunked input and files for a Pattern.
+ * arch-tag: f236b985-9686-4266-bf12-c5e6285aaa49
+ *
+ * Copyright (C) 2004 Nikolai Weibull <source@pcppopper.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+
+
+#ifndef PATTERNSTREAM_H
+#define PATTERNSTREAM_H
+
+
+#define PATTERN_STREAM_CHUNK_SIZE	(1 << 20)
+
+
+typedef struct _PatternStream PatternStream;
+
+
+PatternStream *pattern_stream_new(Pattern *pattern,
+				  PatternMapFunc lambda,
+				  pointer closure);
+void pattern_stream_release(PatternStream *stream);
+
+bool pattern_stream_feed(PatternStream *stream,
+			 const char *chunk,
+			 size_t n);
+size_t pattern_stream_offset(PatternStream *stream);
+
+bool pattern_map_fd(Pattern *pattern,
+		    int fd,
+		    size_t chunk_size,
+		    PatternMapFunc lambda,
+		    pointer closure);
+bool pattern_map_file(Pattern *pattern,
+		      const char *path,
+		      PatternMapFunc lambda,
+		      pointer closure);
+
+
+#endif /* PATTERNSTREAM_H */
+
+
+
+/* vim: set sts=0 sw=8 ts=8: */
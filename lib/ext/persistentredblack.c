@@ -0,0 +1,775 @@
+/*
+ * contents: Persistent Red-Black Tree ADT.
+ * arch-tag: ce2e709f-7c3f-4f18-b4c8-8cc5c9b657df
+ *
+ * Copyright (C) 2004 Nikolai Weibull <source@pcppopper.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+
+#include <clear/internal.h>
+#include <clear/mem.h>
+#include "persistentredblack.h"
+
+
+/* {{{1
+ * A persistent red-black tree is never modified.  Inserting into it or removing
+ * from it instead returns a new version of the tree, which shares all the
+ * nodes that the operation didn't touch with the old one, and only copies the
+ * O(log n) nodes on the path down to where the change was made (path
+ * copying).  Keeping a snapshot of a version is thus O(1): just keep a
+ * reference to it, see |prb_tree_ref|.
+ *
+ * Nodes are reference counted, each being referenced by the parents and
+ * versions that it's a part of, and released when the last of them is.  The
+ * counts are updated atomically, and nodes are never modified once they're
+ * shared, so versions may be read and released by any number of threads at
+ * once, and new versions made of them, without any locking.
+ *
+ * As keys and values are shared by all versions that contain them, the tree
+ * never releases them.  Keep them in an arena, or something else that
+ * outlives all versions of the tree, instead.
+ *
+ * The algorithms are those of the functional red-black trees verified by
+ * Nipkow et al. in Isabelle/HOL, which in turn follow Okasaki for insertion
+ * and Kahrs for removal.  They're written in terms of taking trees apart and
+ * putting new ones together, which we do in place on nodes that we hold the
+ * only reference to, see |prb_tree_node_unshare|, and on copies of all other
+ * nodes, so only nodes that are shared with other versions are copied.
+ */
+
+
+/* {{{1
+ * The maximum height of a tree, as one with n nodes is at most 2 log(n + 1)
+ * high.  It's used to size the stack of |prb_tree_map|.  Insertion and
+ * removal recurse to this depth as well.
+ */
+#define PRB_TREE_MAX_HEIGHT	(2 * 64)
+
+
+/* {{{1
+ * PRBTreeNodeColor: Enumeration over node colors (red and black).
+ */
+typedef enum {
+	BLACK,
+	RED
+} PRBTreeNodeColor;
+
+
+/* {{{1
+ * Our node type.  ‘left’ and ‘right’ are our binary children, or ‹null›, and
+ * ‘refs’ is the number of references to the node, see above.
+ */
+typedef struct _PRBTreeNode PRBTreeNode;
+
+struct _PRBTreeNode {
+	PRBTreeNode *left;
+	PRBTreeNode *right;
+	pointer key;
+	pointer value;
+	int refs;
+	unsigned char color;
+};
+
+
+/* {{{1
+ * A version of a tree.  ‘refs’ is the number of references to it, and ‘root’
+ * is its root node, which it holds a reference to.  ‘key_compare’ and
+ * ‘key_compare_data’ are passed on to each new version made from it.
+ */
+struct _PRBTree {
+	int refs;
+	PRBTreeNode *root;
+	int size;
+	CompareDataFunc key_compare;
+	pointer key_compare_data;
+};
+
+
+/* {{{1
+ * Nodes: References to nodes are passed around and returned by our functions,
+ * each of which is either borrowed, meaning that the caller keeps it, or
+ * owned, meaning that it's handed over to whoever it's given to, who must
+ * release it or give it to someone else in turn.  The trees of versions are
+ * always borrowed, whereas the trees being built are owned.
+ */
+
+
+/* {{{2
+ * Create a new node with the given fields, which takes over the owned
+ * references ‘left’ and ‘right’.  Returns an owned reference to the node.
+ */
+static PRBTreeNode *
+prb_tree_node_new(PRBTreeNodeColor color,
+		  PRBTreeNode *left,
+		  pointer key,
+		  pointer value,
+		  PRBTreeNode *right)
+{
+	PRBTreeNode *node = new_struct(PRBTreeNode);
+
+	node->left = left;
+	node->right = right;
+	node->key = key;
+	node->value = value;
+	node->refs = 1;
+	node->color = color;
+
+	return node;
+}
+
+
+/* {{{2
+ * Take another reference to ‘node’, which may be ‹null›, and return it.
+ */
+static inline PRBTreeNode *
+prb_tree_node_ref(PRBTreeNode *node)
+{
+	unless (node == null) {
+		__atomic_add_fetch(&node->refs, 1, __ATOMIC_RELAXED);
+	}
+
+	return node;
+}
+
+
+/* {{{2
+ * Release a reference to ‘node’, which may be ‹null›, releasing it, and then
+ * its children, if it was the last one.  We don't recurse, but keep the nodes
+ * whose right children are still to be released on a stack linked through
+ * their ‘left’ pointers, as those children are all they're still needed for.
+ */
+static void
+prb_tree_node_unref(PRBTreeNode *node)
+{
+	PRBTreeNode *stack = null;
+
+	while (true) {
+		if (node != null &&
+		    __atomic_sub_fetch(&node->refs, 1, __ATOMIC_ACQ_REL) == 0) {
+			PRBTreeNode *left = node->left;
+			node->left = stack;
+			stack = node;
+			node = left;
+		} else if (stack != null) {
+			PRBTreeNode *dead = stack;
+			stack = dead->left;
+			node = dead->right;
+			release(dead);
+		} else {
+			break;
+		}
+	}
+}
+
+
+/* {{{2
+ * Make sure that the owned reference at ‘link’ is the only reference to its
+ * node, so that we may modify it, by replacing it with a copy of the node if
+ * it's shared.  The copy shares the children of the node.  Returns the node
+ * that ‘link’ then refers to.  As nobody else can get hold of a node that we
+ * hold the only reference to, no locking is needed.
+ */
+static PRBTreeNode *
+prb_tree_node_unshare(PRBTreeNode **link)
+{
+	PRBTreeNode *node = *link;
+
+	if (__atomic_load_n(&node->refs, __ATOMIC_ACQUIRE) == 1) {
+		return node;
+	}
+
+	PRBTreeNode *copy = prb_tree_node_new(node->color,
+					      prb_tree_node_ref(node->left),
+					      node->key,
+					      node->value,
+					      prb_tree_node_ref(node->right));
+	prb_tree_node_unref(node);
+	*link = copy;
+
+	return copy;
+}
+
+
+/* {{{2
+ * Release ‘node’, which we hold the only reference to, and whose children
+ * have been given to other nodes, without releasing them.
+ */
+static inline void
+prb_tree_node_free(PRBTreeNode *node)
+{
+	release(node);
+}
+
+
+/* {{{2
+ * Check if ‘node’ is a red node, or a black one (and not ‹null›).
+ */
+static inline bool
+prb_tree_node_red_p(PRBTreeNode *node)
+{
+	return node != null && node->color == RED;
+}
+
+static inline bool
+prb_tree_node_black_p(PRBTreeNode *node)
+{
+	return node != null && node->color == BLACK;
+}
+
+
+/* {{{2
+ * Color the owned tree ‘node’, which may be ‹null›, ‘color’.  Returns the
+ * tree.
+ */
+static PRBTreeNode *
+prb_tree_node_paint(PRBTreeNode *node, PRBTreeNodeColor color)
+{
+	unless (node == null || node->color == color) {
+		prb_tree_node_unshare(&node)->color = color;
+	}
+
+	return node;
+}
+
+
+/* {{{1
+ * Balancing: Each of these functions takes owned references to the left and
+ * right sub-trees of a new node with ‘key’ and ‘value’, and returns an owned
+ * reference to the tree rooted at the node, rebalanced.  The comments give
+ * the cases handled, in the notation of the paper, with R and B being red and
+ * black nodes.
+ */
+
+
+/* {{{2
+ * Put a black node over ‘l’ and ‘r’, where ‘l’ may have a red-red violation
+ * at its root after an insertion into it:
+ *
+ *   baliL (R (R t1 a t2) b t3) c t4 = R (B t1 a t2) b (B t3 c t4)
+ *   baliL (R t1 a (R t2 b t3)) c t4 = R (B t1 a t2) b (B t3 c t4)
+ *   baliL t1 a t2 = B t1 a t2
+ */
+static PRBTreeNode *
+prb_tree_balance_left(PRBTreeNode *l,
+		      pointer key,
+		      pointer value,
+		      PRBTreeNode *r)
+{
+	if (prb_tree_node_red_p(l) && prb_tree_node_red_p(l->left)) {
+		PRBTreeNode *b = prb_tree_node_unshare(&l);
+		prb_tree_node_unshare(&b->left)->color = BLACK;
+		b->right = prb_tree_node_new(BLACK, b->right, key, value, r);
+		return b;
+	} else if (prb_tree_node_red_p(l) && prb_tree_node_red_p(l->right)) {
+		PRBTreeNode *a = prb_tree_node_unshare(&l);
+		PRBTreeNode *b = prb_tree_node_unshare(&a->right);
+		a->right = b->left;
+		a->color = BLACK;
+		b->left = a;
+		b->right = prb_tree_node_new(BLACK, b->right, key, value, r);
+		return b;
+	}
+
+	return prb_tree_node_new(BLACK, l, key, value, r);
+}
+
+
+/* {{{2
+ * Put a black node over ‘l’ and ‘r’, where ‘r’ may have a red-red violation
+ * at its root after an insertion into it:
+ *
+ *   baliR t1 a (R t2 b (R t3 c t4)) = R (B t1 a t2) b (B t3 c t4)
+ *   baliR t1 a (R (R t2 b t3) c t4) = R (B t1 a t2) b (B t3 c t4)
+ *   baliR t1 a t2 = B t1 a t2
+ */
+static PRBTreeNode *
+prb_tree_balance_right(PRBTreeNode *l,
+		       pointer key,
+		       pointer value,
+		       PRBTreeNode *r)
+{
+	if (prb_tree_node_red_p(r) && prb_tree_node_red_p(r->right)) {
+		PRBTreeNode *b = prb_tree_node_unshare(&r);
+		prb_tree_node_unshare(&b->right)->color = BLACK;
+		b->left = prb_tree_node_new(BLACK, l, key, value, b->left);
+		return b;
+	} else if (prb_tree_node_red_p(r) && prb_tree_node_red_p(r->left)) {
+		PRBTreeNode *c = prb_tree_node_unshare(&r);
+		PRBTreeNode *b = prb_tree_node_unshare(&c->left);
+		c->left = b->right;
+		c->color = BLACK;
+		b->right = c;
+		b->left = prb_tree_node_new(BLACK, l, key, value, b->left);
+		return b;
+	}
+
+	return prb_tree_node_new(BLACK, l, key, value, r);
+}
+
+
+/* {{{2
+ * Put a node over ‘l’ and ‘r’, where ‘l’ is one black node lower than ‘r’
+ * after a removal from it:
+ *
+ *   baldL (R t1 a t2) b t3 = R (B t1 a t2) b t3
+ *   baldL t1 a (B t2 b t3) = baliR t1 a (R t2 b t3)
+ *   baldL t1 a (R (B t2 b t3) c t4) =
+ *           R (B t1 a t2) b (baliR t3 c (paint Red t4))
+ *   baldL t1 a t2 = R t1 a t2
+ */
+static PRBTreeNode *
+prb_tree_rebalance_left(PRBTreeNode *l,
+			pointer key,
+			pointer value,
+			PRBTreeNode *r)
+{
+	if (prb_tree_node_red_p(l)) {
+		return prb_tree_node_new(RED, prb_tree_node_paint(l, BLACK),
+					 key, value, r);
+	} else if (prb_tree_node_black_p(r)) {
+		return prb_tree_balance_right(l, key, value,
+					      prb_tree_node_paint(r, RED));
+	} else if (prb_tree_node_red_p(r) &&
+		   prb_tree_node_black_p(r->left)) {
+		PRBTreeNode *c = prb_tree_node_unshare(&r);
+		PRBTreeNode *b = prb_tree_node_unshare(&c->left);
+		PRBTreeNode *t3 = b->right;
+		PRBTreeNode *t4 = c->right;
+		b->left = prb_tree_node_new(BLACK, l, key, value, b->left);
+		b->right = prb_tree_balance_right(t3, c->key, c->value,
+						  prb_tree_node_paint(t4,
+								      RED));
+		b->color = RED;
+		prb_tree_node_free(c);
+		return b;
+	}
+
+	return prb_tree_node_new(RED, l, key, value, r);
+}
+
+
+/* {{{2
+ * Put a node over ‘l’ and ‘r’, where ‘r’ is one black node lower than ‘l’
+ * after a removal from it:
+ *
+ *   baldR t1 a (R t2 b t3) = R t1 a (B t2 b t3)
+ *   baldR (B t1 a t2) b t3 = baliL (R t1 a t2) b t3
+ *   baldR (R t1 a (B t2 b t3)) c t4 =
+ *           R (baliL (paint Red t1) a t2) b (B t3 c t4)
+ *   baldR t1 a t2 = R t1 a t2
+ */
+static PRBTreeNode *
+prb_tree_rebalance_right(PRBTreeNode *l,
+			 pointer key,
+			 pointer value,
+			 PRBTreeNode *r)
+{
+	if (prb_tree_node_red_p(r)) {
+		return prb_tree_node_new(RED, l, key, value,
+					 prb_tree_node_paint(r, BLACK));
+	} else if (prb_tree_node_black_p(l)) {
+		return prb_tree_balance_left(prb_tree_node_paint(l, RED),
+					     key, value, r);
+	} else if (prb_tree_node_red_p(l) &&
+		   prb_tree_node_black_p(l->right)) {
+		PRBTreeNode *a = prb_tree_node_unshare(&l);
+		PRBTreeNode *b = prb_tree_node_unshare(&a->right);
+		PRBTreeNode *t1 = a->left;
+		PRBTreeNode *t2 = b->left;
+		b->left = prb_tree_balance_left(prb_tree_node_paint(t1, RED),
+						a->key, a->value, t2);
+		b->right = prb_tree_node_new(BLACK, b->right, key, value, r);
+		b->color = RED;
+		prb_tree_node_free(a);
+		return b;
+	}
+
+	return prb_tree_node_new(RED, l, key, value, r);
+}
+
+
+/* {{{2
+ * Join the owned trees ‘l’ and ‘r’, all of whose keys are smaller and larger,
+ * respectively, than that of a node that has been removed from between them:
+ *
+ *   join Leaf t = t
+ *   join t Leaf = t
+ *   join (R t1 a t2) (R t3 c t4) = case join t2 t3 of
+ *           R u2 b u3 => R (R t1 a u2) b (R u3 c t4)
+ *           t23 => R t1 a (R t23 c t4)
+ *   join (B t1 a t2) (B t3 c t4) = case join t2 t3 of
+ *           R u2 b u3 => R (B t1 a u2) b (B u3 c t4)
+ *           t23 => baldL t1 a (B t23 c t4)
+ *   join t1 (R t2 a t3) = R (join t1 t2) a t3
+ *   join (R t1 a t2) t3 = R t1 a (join t2 t3)
+ */
+static PRBTreeNode *
+prb_tree_join(PRBTreeNode *l, PRBTreeNode *r)
+{
+	if (l == null) {
+		return r;
+	} else if (r == null) {
+		return l;
+	} else if (l->color == r->color) {
+		PRBTreeNode *a = prb_tree_node_unshare(&l);
+		PRBTreeNode *c = prb_tree_node_unshare(&r);
+		PRBTreeNode *mid = prb_tree_join(a->right, c->left);
+
+		if (prb_tree_node_red_p(mid)) {
+			PRBTreeNode *b = prb_tree_node_unshare(&mid);
+			a->right = b->left;
+			c->left = b->right;
+			b->left = a;
+			b->right = c;
+			return b;
+		}
+
+		c->left = mid;
+		if (a->color == RED) {
+			a->right = c;
+			return a;
+		}
+
+		PRBTreeNode *t1 = a->left;
+		pointer key = a->key;
+		pointer value = a->value;
+		prb_tree_node_free(a);
+		return prb_tree_rebalance_left(t1, key, value, c);
+	} else if (r->color == RED) {
+		PRBTreeNode *a = prb_tree_node_unshare(&r);
+		a->left = prb_tree_join(l, a->left);
+		return a;
+	} else {
+		PRBTreeNode *a = prb_tree_node_unshare(&l);
+		a->right = prb_tree_join(a->right, r);
+		return a;
+	}
+}
+
+
+/* {{{1
+ * Compare ‘a’ and ‘b’ the way ‘tree’ does.
+ */
+static inline int
+prb_tree_compare(PRBTree *tree, constpointer a, constpointer b)
+{
+	return tree->key_compare(a, b, tree->key_compare_data);
+}
+
+
+/* {{{1
+ * Insert ‘key’ and ‘value’ into the borrowed tree ‘node’, returning an owned
+ * reference to the new tree, whose root may be red, and have a red child.  If
+ * ‘key’ is already in the tree, its value is replaced.
+ *
+ *   ins x Leaf = R Leaf x Leaf
+ *   ins x (B l a r) = case cmp x a of
+ *           LT => baliL (ins x l) a r | GT => baliR l a (ins x r)
+ *   ins x (R l a r) = case cmp x a of
+ *           LT => R (ins x l) a r | GT => R l a (ins x r)
+ */
+static PRBTreeNode *
+prb_tree_node_insert(PRBTree *tree,
+		     PRBTreeNode *node,
+		     pointer key,
+		     pointer value)
+{
+	if (node == null) {
+		return prb_tree_node_new(RED, null, key, value, null);
+	}
+
+	int cmp = prb_tree_compare(tree, key, node->key);
+	if (cmp == 0) {
+		return prb_tree_node_new(node->color,
+					 prb_tree_node_ref(node->left),
+					 node->key, value,
+					 prb_tree_node_ref(node->right));
+	} else if (cmp < 0) {
+		PRBTreeNode *l = prb_tree_node_insert(tree, node->left,
+						      key, value);
+		PRBTreeNode *r = prb_tree_node_ref(node->right);
+		if (node->color == BLACK) {
+			return prb_tree_balance_left(l, node->key,
+						     node->value, r);
+		}
+		return prb_tree_node_new(RED, l, node->key, node->value, r);
+	} else { /* (cmp > 0) */
+		PRBTreeNode *l = prb_tree_node_ref(node->left);
+		PRBTreeNode *r = prb_tree_node_insert(tree, node->right,
+						      key, value);
+		if (node->color == BLACK) {
+			return prb_tree_balance_right(l, node->key,
+						      node->value, r);
+		}
+		return prb_tree_node_new(RED, l, node->key, node->value, r);
+	}
+}
+
+
+/* {{{1
+ * Remove ‘key’ from the borrowed tree ‘node’, returning an owned reference to
+ * the new tree, which is one black node lower if ‘node’ is black.
+ *
+ *   del x Leaf = Leaf
+ *   del x (Node l a r) = case cmp x a of
+ *           LT => if l is black then baldL (del x l) a r
+ *                 else R (del x l) a r
+ *           GT => if r is black then baldR l a (del x r)
+ *                 else R l a (del x r)
+ *           EQ => join l r
+ */
+static PRBTreeNode *
+prb_tree_node_remove(PRBTree *tree, PRBTreeNode *node, constpointer key)
+{
+	if (node == null) {
+		return null;
+	}
+
+	int cmp = prb_tree_compare(tree, key, node->key);
+	if (cmp == 0) {
+		return prb_tree_join(prb_tree_node_ref(node->left),
+				     prb_tree_node_ref(node->right));
+	} else if (cmp < 0) {
+		PRBTreeNode *l = prb_tree_node_remove(tree, node->left, key);
+		PRBTreeNode *r = prb_tree_node_ref(node->right);
+		if (prb_tree_node_black_p(node->left)) {
+			return prb_tree_rebalance_left(l, node->key,
+						       node->value, r);
+		}
+		return prb_tree_node_new(RED, l, node->key, node->value, r);
+	} else { /* (cmp > 0) */
+		PRBTreeNode *l = prb_tree_node_ref(node->left);
+		PRBTreeNode *r = prb_tree_node_remove(tree, node->right, key);
+		if (prb_tree_node_black_p(node->right)) {
+			return prb_tree_rebalance_right(l, node->key,
+							node->value, r);
+		}
+		return prb_tree_node_new(RED, l, node->key, node->value, r);
+	}
+}
+
+
+/* {{{1
+ * Create a new version of ‘tree’ with the owned tree ‘root’ of ‘size’ nodes.
+ */
+static PRBTree *
+prb_tree_version_new(CompareDataFunc key_compare,
+		     pointer key_compare_data,
+		     PRBTreeNode *root,
+		     int size)
+{
+	PRBTree *tree = new_struct(PRBTree);
+
+	tree->refs = 1;
+	tree->root = root;
+	tree->size = size;
+	tree->key_compare = key_compare;
+	tree->key_compare_data = key_compare_data;
+
+	return tree;
+}
+
+
+/* {{{1
+ * Create a new, empty, persistent red-black tree, ordered by ‘key_compare’,
+ * which is passed ‘key_compare_data’.  Returns a reference to it, which must
+ * be given to |prb_tree_unref| when it's no longer needed, as must those to
+ * the versions made from it.
+ */
+PRBTree *
+prb_tree_new(CompareDataFunc key_compare, pointer key_compare_data)
+{
+	invariant(key_compare != null);
+
+	return prb_tree_version_new(key_compare, key_compare_data, null, 0);
+}
+
+
+/* {{{1
+ * Take another reference to the version ‘tree’, and return it.  This is how
+ * snapshots are taken, in O(1) time.
+ */
+PRBTree *
+prb_tree_ref(PRBTree *tree)
+{
+	invariant(tree != null);
+
+	__atomic_add_fetch(&tree->refs, 1, __ATOMIC_RELAXED);
+
+	return tree;
+}
+
+
+/* {{{1
+ * Release a reference to the version ‘tree’, releasing it, and the nodes that
+ * no other version shares, if it was the last one.
+ */
+void
+prb_tree_unref(PRBTree *tree)
+{
+	invariant(tree != null);
+
+	if (__atomic_sub_fetch(&tree->refs, 1, __ATOMIC_ACQ_REL) == 0) {
+		prb_tree_node_unref(tree->root);
+		release(tree);
+	}
+}
+
+
+/* {{{1
+ * Return a new version of ‘tree’ with ‘key’ associated with ‘value’, leaving
+ * ‘tree’ as it is.  If ‘key’ is in ‘tree’ already, its value is replaced in
+ * the new version, but its key is kept.  This takes O(log n) time, and the
+ * new version shares all but O(log n) nodes with ‘tree’.  The returned
+ * reference must be given to |prb_tree_unref|.
+ */
+PRBTree *
+prb_tree_insert(PRBTree *tree, pointer key, pointer value)
+{
+	invariant(tree != null);
+
+	int size = tree->size;
+	unless (prb_tree_lookup_extended(tree, key, null, null)) {
+		size++;
+	}
+
+	PRBTreeNode *root = prb_tree_node_insert(tree, tree->root, key, value);
+	return prb_tree_version_new(tree->key_compare, tree->key_compare_data,
+				    prb_tree_node_paint(root, BLACK), size);
+}
+
+
+/* {{{1
+ * Return a new version of ‘tree’ without ‘key’, leaving ‘tree’ as it is, see
+ * |prb_tree_insert|.  If ‘key’ isn't in ‘tree’, another reference to ‘tree’
+ * is returned.
+ */
+PRBTree *
+prb_tree_remove(PRBTree *tree, constpointer key)
+{
+	invariant(tree != null);
+
+	unless (prb_tree_lookup_extended(tree, key, null, null)) {
+		return prb_tree_ref(tree);
+	}
+
+	PRBTreeNode *root = prb_tree_node_remove(tree, tree->root, key);
+	return prb_tree_version_new(tree->key_compare, tree->key_compare_data,
+				    prb_tree_node_paint(root, BLACK),
+				    tree->size - 1);
+}
+
+
+/* {{{1
+ * Return the number of key-value pairs in the version ‘tree’.
+ */
+int
+prb_tree_size(PRBTree *tree)
+{
+	invariant(tree != null);
+
+	return tree->size;
+}
+
+
+/* {{{1
+ * Get the value associated with ‘key’ in the version ‘tree’, or ‹null› if
+ * ‘key’ isn't in it.
+ */
+pointer
+prb_tree_lookup(PRBTree *tree, constpointer key)
+{
+	pointer value;
+
+	return prb_tree_lookup_extended(tree, key, null, &value) ? value : null;
+}
+
+
+/* {{{1
+ * Works like |prb_tree_lookup| except that the return value tells whether
+ * ‘key’ was found in the tree or not, and ‘orig_key’ and ‘value’, if they
+ * aren't ‹null›, are set to the key and value found, as with
+ * |rb_tree_lookup_extended|.
+ */
+bool
+prb_tree_lookup_extended(PRBTree *tree,
+			 constpointer key,
+			 pointer *orig_key,
+			 pointer *value)
+{
+	invariant(tree != null);
+
+	PRBTreeNode *node = tree->root;
+
+	until (node == null) {
+		int cmp = prb_tree_compare(tree, key, node->key);
+		if (cmp < 0) {
+			node = node->left;
+		} else if (cmp == 0) {
+			unless (orig_key == null) {
+				*orig_key = node->key;
+			}
+			unless (value == null) {
+				*value = node->value;
+			}
+			return true;
+		} else { /* (cmp > 0) */
+			node = node->right;
+		}
+	}
+
+	return false;
+}
+
+
+/* {{{1
+ * Call ‘lambda’ for each key-value pair in the version ‘tree’, in order,
+ * until it returns false, as with |rb_tree_map|.  As nodes have no parent
+ * pointers, we keep the nodes whose right sub-trees are still to be visited
+ * on a stack, which is never deeper than the tree is high.
+ */
+void
+prb_tree_map(PRBTree *tree, MappingMapFunc lambda, pointer closure)
+{
+	invariant(tree != null);
+	invariant(lambda != null);
+
+	PRBTreeNode *stack[PRB_TREE_MAX_HEIGHT];
+	int depth = 0;
+	PRBTreeNode *node = tree->root;
+
+	while (node != null || depth > 0) {
+		until (node == null) {
+			invariant(depth < PRB_TREE_MAX_HEIGHT);
+			stack[depth++] = node;
+			node = node->left;
+		}
+
+		node = stack[--depth];
+		unless (lambda(node->key, node->value, closure)) {
+			return;
+		}
+		node = node->right;
+	}
+}
+
+
+/* }}}1 */
+
+
+
+/* vim: set sts=0 sw=8 ts=8: */
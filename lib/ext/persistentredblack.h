@@ -0,0 +1,50 @@
+/*
+ * contents: Persistent Red-Black Tree ADT.
+ * arch-tag: d334ea5f-d6e1-4ecc-aac0-f8e8a55286a2
+ *
+ * Copyright (C) 2004 Nikolai Weibull <source@pcppopper.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+
+
+#ifndef PERSISTENTREDBLACK_H
+#define PERSISTENTREDBLACK_H
+
+
+typedef struct _PRBTree PRBTree;
+
+
+PRBTree *prb_tree_new(CompareDataFunc key_compare, pointer key_compare_data);
+PRBTree *prb_tree_ref(PRBTree *tree);
+void prb_tree_unref(PRBTree *tree);
+
+PRBTree *prb_tree_insert(PRBTree *tree, pointer key, pointer value);
+PRBTree *prb_tree_remove(PRBTree *tree, constpointer key);
+int prb_tree_size(PRBTree *tree);
+pointer prb_tree_lookup(PRBTree *tree, constpointer key);
+bool prb_tree_lookup_extended(PRBTree *tree,
+			      constpointer key,
+			      pointer *orig_key,
+			      pointer *value);
+void prb_tree_map(PRBTree *tree, MappingMapFunc lambda, pointer closure);
+
+
+#endif /* PERSISTENTREDBLACK_H */
+
+
+
+/* vim: set sts=0 sw=8 ts=8: */
@@ -20,6 +20,7 @@
  */
 
 
+#include <string.h>
 #include <clear/internal.h>
 #include <clear/mem.h>
 #include "priorityqueue.h"
@@ -33,11 +34,30 @@
 #define PRIORITY_QUEUE_INITIAL_SIZE	16
 
 
+/* {{{1
+ * The default arity of the heap, i.e. the number of children of each node.
+ */
+#define PRIORITY_QUEUE_DEFAULT_ARITY	2
+
+
 /* {{{1
  * Our priority queue structure.  ‘compare’ is the function we use for
  * determining the placement of data items we put in the queue and ‘equal’ is
  * used for checking if a data item is a member of the queue.  ‘heap’ is of
- * course our heap structure and ‘size’/‘len’ keep track of it.
+ * course our heap structure and ‘size’/‘len’ keep track of it.  ‘arity’ is
+ * the number of children of each node in the heap.  The heap starts at index
+ * 1, so the children of node i are found at ‘arity’ * (i - 1) + 2 through
+ * ‘arity’ * i + 1.  If ‘indexed’ is true, each data item keeps its own index
+ * in the heap in a ‹size_t› at ‘index_offset’ bytes into it, see
+ * |priority_queue_new_indexed|.  While an item is being sifted, ‘sifted’ is
+ * the item, ‘start’ the node it started out at, ‘hole’ the node it belongs in
+ * at the moment, and ‘upwards’ the direction it's going in.  While
+ * |priority_queue_push| sifts, ‘pushing’ is true, and while
+ * |priority_queue_pop| does, ‘popping’ is true and ‘root’ is the item it's
+ * popping.  This lets |priority_queue_recover| undo the call if ‘compare’
+ * never returns.
+ * ‘stats’ is only there if PRIORITY_QUEUE_STATS is defined, see
+ * |priority_queue_get_stats|.
  */
 struct _PriorityQueue {
 	CompareFunc compare;
@@ -45,9 +65,108 @@ struct _PriorityQueue {
 	pointer *heap;
 	size_t len;
 	size_t size;
+	size_t arity;
+	bool indexed;
+	size_t index_offset;
+	pointer sifted;
+	size_t start;
+	size_t hole;
+	bool upwards;
+	bool pushing;
+	bool popping;
+	pointer root;
+#ifdef PRIORITY_QUEUE_STATS
+	PriorityQueueStats stats;
+#endif
 };
 
 
+/* {{{1
+ * Statistics: Each statement that keeps the statistics of a queue is wrapped
+ * in PRIORITY_QUEUE_STAT, so that it disappears entirely unless
+ * PRIORITY_QUEUE_STATS is defined, and the counting costs nothing by default.
+ */
+#ifdef PRIORITY_QUEUE_STATS
+#  define PRIORITY_QUEUE_STAT(statement)	statement
+#else
+#  define PRIORITY_QUEUE_STAT(statement)
+#endif
+
+
+/* {{{1
+ * Compare the items ‘a’ and ‘b’ of the heap of ‘q’, counting the comparison.
+ */
+static inline int
+priority_queue_compare(PriorityQueue *q, constpointer a, constpointer b)
+{
+	PRIORITY_QUEUE_STAT(q->stats.comparisons++);
+
+	return q->compare(a, b);
+}
+
+
+#ifdef PRIORITY_QUEUE_STATS
+/* {{{1
+ * Count a sift of the heap of ‘q’ over ‘levels’ levels in ‘sifts’ and
+ * ‘total’, the counters of its statistics for that kind of sift.
+ */
+static void
+priority_queue_count_sift(PriorityQueue *q,
+			  unsigned long *sifts,
+			  unsigned long *total,
+			  size_t levels)
+{
+	(*sifts)++;
+	*total += levels;
+	q->stats.depths[MIN(levels, PRIORITY_QUEUE_STATS_DEPTHS - 1)]++;
+}
+#endif
+
+
+/* {{{1
+ * Get a pointer to the heap index stored in ‘data’ of an indexed queue.
+ */
+static inline size_t *
+priority_queue_index(PriorityQueue *q, constpointer data)
+{
+	return (size_t *)((char *)data + q->index_offset);
+}
+
+
+/* {{{1
+ * Put ‘data’ at node ‘i’ of the heap, keeping track of its index if the queue
+ * is indexed.
+ */
+static inline void
+priority_queue_set(PriorityQueue *q, size_t i, pointer data)
+{
+	q->heap[i] = data;
+	if (q->indexed) {
+		*priority_queue_index(q, data) = i;
+	}
+}
+
+
+/* {{{1
+ * Get the index of the parent of node ‘i’.
+ */
+static inline size_t
+priority_queue_parent(PriorityQueue *q, size_t i)
+{
+	return (i - 2) / q->arity + 1;
+}
+
+
+/* {{{1
+ * Get the index of the first child of node ‘i’.
+ */
+static inline size_t
+priority_queue_first_child(PriorityQueue *q, size_t i)
+{
+	return q->arity * (i - 1) + 2;
+}
+
+
 /* {{{1
  * Create a new priority queue ADT using the given functions for the purposes
  * described above.
@@ -76,6 +195,56 @@ priority_queue_sized_new(CompareFunc compare, EqualFunc equal, size_t size)
 	q->size = size;
 	q->heap = new_array(pointer, q->size + 1);
 	q->len = 0;
+	q->arity = PRIORITY_QUEUE_DEFAULT_ARITY;
+	q->indexed = false;
+	q->index_offset = 0;
+	q->sifted = null;
+	q->start = 0;
+	q->hole = 0;
+	q->upwards = false;
+	q->pushing = false;
+	q->popping = false;
+	q->root = null;
+	PRIORITY_QUEUE_STAT(memset(&q->stats, 0, sizeof(q->stats)));
+
+	return q;
+}
+
+
+/* {{{1
+ * Create a new priority queue whose heap is ‘arity’-ary instead of binary.
+ * A wider heap is shallower, so popping touches fewer cache lines for large
+ * queues, at the cost of more comparisons per level.  4 is usually a good
+ * choice.
+ */
+PriorityQueue *
+priority_queue_new_dary(CompareFunc compare, EqualFunc equal, size_t arity)
+{
+	invariant(arity >= 2);
+
+	PriorityQueue *q = priority_queue_new(compare, equal);
+	q->arity = arity;
+
+	return q;
+}
+
+
+/* {{{1
+ * Create a new indexed priority queue.  Each data item pushed on such a queue
+ * must contain a ‹size_t› at ‘index_offset’ bytes into it (as given by
+ * |offsetof()|), which the queue uses to keep track of the item's position in
+ * the heap.  It's zero whenever the item isn't in the queue, so it must be
+ * initialized to zero.  This makes |priority_queue_contains| O(1), and
+ * |priority_queue_update| and |priority_queue_remove| O(log n).  Items are
+ * compared by identity, so ‘equal’ isn't needed, and an item may only be in
+ * one indexed queue at a time.
+ */
+PriorityQueue *
+priority_queue_new_indexed(CompareFunc compare, size_t index_offset)
+{
+	PriorityQueue *q = priority_queue_new(compare, null);
+	q->indexed = true;
+	q->index_offset = index_offset;
 
 	return q;
 }
@@ -94,6 +263,137 @@ priority_queue_release(PriorityQueue *q)
 }
 
 
+/* {{{1
+ * Sift the item at node ‘i’ upwards while it's smaller than its parent.  We
+ * move the parents down into the hole left by the item instead of swapping,
+ * keeping track of the hole in ‘hole’ until the item is back in the heap.
+ * Returns the index where the item ended up.
+ */
+static size_t
+priority_queue_sift_up(PriorityQueue *q, size_t i)
+{
+	pointer data = q->heap[i];
+	PRIORITY_QUEUE_STAT(size_t levels = 0);
+
+	q->sifted = data;
+	q->start = q->hole = i;
+	q->upwards = true;
+	for (size_t p; i > 1; i = p) {
+		p = priority_queue_parent(q, i);
+		unless (priority_queue_compare(q, q->heap[p], data) > 0) {
+			break;
+		}
+		priority_queue_set(q, i, q->heap[p]);
+		q->hole = p;
+		PRIORITY_QUEUE_STAT(levels++);
+	}
+	priority_queue_set(q, i, data);
+	q->hole = 0;
+	PRIORITY_QUEUE_STAT(priority_queue_count_sift(q, &q->stats.sift_ups,
+			&q->stats.sift_up_levels, levels));
+
+	return i;
+}
+
+
+/* {{{1
+ * Sift the item at node ‘i’ downwards while its smallest child is smaller
+ * than it.  Works like |priority_queue_sift_up|.
+ */
+static void
+priority_queue_sift_down(PriorityQueue *q, size_t i)
+{
+	pointer data = q->heap[i];
+	PRIORITY_QUEUE_STAT(size_t levels = 0);
+
+	q->sifted = data;
+	q->start = q->hole = i;
+	q->upwards = false;
+	for (size_t c; (c = priority_queue_first_child(q, i)) <= q->len; ) {
+		/* find the smallest child */
+		size_t last = MIN(c + q->arity - 1, q->len);
+		for (size_t j = c + 1; j <= last; j++) {
+			if (priority_queue_compare(q, q->heap[j],
+						   q->heap[c]) < 0) {
+				c = j;
+			}
+		}
+
+		unless (priority_queue_compare(q, data, q->heap[c]) > 0) {
+			break;
+		}
+		priority_queue_set(q, i, q->heap[c]);
+		i = q->hole = c;
+		PRIORITY_QUEUE_STAT(levels++);
+	}
+	priority_queue_set(q, i, data);
+	q->hole = 0;
+	PRIORITY_QUEUE_STAT(priority_queue_count_sift(q, &q->stats.sift_downs,
+			&q->stats.sift_down_levels, levels));
+}
+
+
+/* {{{1
+ * Restore the heap ordering of the whole heap, bottom-up, in O(n) time, by
+ * sifting down each inner node, starting with the last one (Floyd's method).
+ */
+static void
+priority_queue_heapify(PriorityQueue *q)
+{
+	/* leaves are never sifted, so tell indexed items where they are */
+	if (q->indexed) {
+		for (size_t i = 1; i <= q->len; i++) {
+			priority_queue_set(q, i, q->heap[i]);
+		}
+	}
+
+	if (q->len < 2) {
+		return;
+	}
+
+	for (size_t i = priority_queue_parent(q, q->len); i >= 1; i--) {
+		priority_queue_sift_down(q, i);
+	}
+}
+
+
+/* {{{1
+ * Make sure there's room for at least ‘size’ items in the heap.
+ */
+static void
+priority_queue_reserve(PriorityQueue *q, size_t size)
+{
+	if (size > q->size) {
+		q->size = size;
+		q->heap = resize_array(q->heap, pointer, q->size + 1);
+	}
+}
+
+
+/* {{{1
+ * Create a new priority queue containing the ‘n’ items in ‘data’.  The heap
+ * is allocated to fit exactly these items and is built in O(n) time, instead
+ * of the O(n log n) time it takes to push them one by one.
+ */
+PriorityQueue *
+priority_queue_new_from_array(CompareFunc compare,
+			      EqualFunc equal,
+			      pointer *data,
+			      size_t n)
+{
+	invariant(data != null || n == 0);
+
+	PriorityQueue *q = priority_queue_sized_new(compare, equal, n);
+	unless (n == 0) {
+		memcpy(&q->heap[1], data, n * sizeof(pointer));
+	}
+	q->len = n;
+	priority_queue_heapify(q);
+
+	return q;
+}
+
+
 /* {{{1
  * Push ‘data’ on the priority queue.
  */
@@ -103,53 +403,262 @@ priority_queue_push(PriorityQueue *q, pointer data)
 	invariant(q != null);
 
 	/* first, resize to fit this element as well, if necessary */
-	if (q->len > q->size) {
-		q->size *= 2;
+	if (q->len == q->size) {
+		q->size = (q->size > 0) ? 2 * q->size :
+			PRIORITY_QUEUE_INITIAL_SIZE;
 		q->heap = resize_array(q->heap, pointer, q->size + 1);
 	}
 
 	/* increase the number of elements in queue and add it */
-	q->heap[++q->len] = data;
+	priority_queue_set(q, ++q->len, data);
 
 	/* then sift it upwards while it's smaller than its parents */
-	for (size_t i = q->len, p;
-	     i > 1 && q->compare(q->heap[p = i / 2], q->heap[i]) > 0;
-	     i = p) {
-		pointer tmp = q->heap[p];
-		q->heap[p] = q->heap[i];
-		q->heap[i] = tmp;
+	q->pushing = true;
+	priority_queue_sift_up(q, q->len);
+	q->pushing = false;
+}
+
+
+/* {{{1
+ * Push the ‘n’ items in ‘data’ on the priority queue.  The heap is grown at
+ * most once, to fit exactly the new items.  If there are enough new items
+ * compared to the ones already in the queue, we add them all and rebuild the
+ * heap in O(n) time, otherwise we sift them up one by one.
+ */
+void
+priority_queue_push_many(PriorityQueue *q, pointer *data, size_t n)
+{
+	invariant(q != null);
+	invariant(data != null || n == 0);
+
+	priority_queue_reserve(q, q->len + n);
+
+	/* sifting up n items costs about n log(len + n) comparisons */
+	size_t log = 0;
+	for (size_t i = q->len + n; i > 1; i /= q->arity) {
+		log++;
+	}
+
+	if (n * log > q->len + n) {
+		memcpy(&q->heap[q->len + 1], data, n * sizeof(pointer));
+		q->len += n;
+		priority_queue_heapify(q);
+	} else {
+		for (size_t i = 0; i < n; i++) {
+			priority_queue_set(q, ++q->len, data[i]);
+			priority_queue_sift_up(q, q->len);
+		}
 	}
 }
 
 
 /* {{{1
  * Pop the item with highest priority (sorted as the smallest item with
- * |PriorityQueue|->compare), off of the priority queue.
+ * |PriorityQueue|->compare), off of the priority queue.  Returns ‹null› if the
+ * queue is empty.
  */
 pointer
 priority_queue_pop(PriorityQueue *q)
 {
 	invariant(q != null);
 
+	if (q->len == 0) {
+		return null;
+	}
+
 	/* first, save the root so that we can return it later on */
 	pointer root = q->heap[1];
+	if (q->indexed) {
+		*priority_queue_index(q, root) = 0;
+	}
 
 	/* then, set the root to our last element, and sift it downwards */
 	q->heap[1] = q->heap[q->len--];
-	for (size_t i = 1, c; (c = 2 * i) <= q->len; i = c) {
-		if (c + 1 <= q->len && q->heap[c + 1] < q->heap[c]) {
-			c++;
+	if (q->len > 0) {
+		q->popping = true;
+		q->root = root;
+		priority_queue_sift_down(q, 1);
+		q->popping = false;
+	}
+
+	return root;
+}
+
+
+/* {{{1
+ * Undo the sift that was interrupted in ‘q’, putting each item it moved back
+ * where it was before the sift, without comparing any items.  The items it
+ * moved are those on the path between ‘start’ and ‘hole’, each of which was
+ * moved one node towards ‘start’, into the hole, so we move them back one
+ * node towards ‘hole’ again, and put the sifted item back at ‘start’.  The
+ * ‘hole’ still holds the last item moved out of it, so it's overwritten
+ * with a copy of what was there.
+ */
+static void
+priority_queue_unsift(PriorityQueue *q)
+{
+	if (q->upwards) {
+		/* the path goes up from start to hole */
+		pointer carry = q->heap[q->start];
+		for (size_t i = q->start; i != q->hole; ) {
+			i = priority_queue_parent(q, i);
+			pointer next = q->heap[i];
+			priority_queue_set(q, i, carry);
+			carry = next;
 		}
-		if (q->compare(q->heap[i], q->heap[c]) > 0) {
-			pointer tmp = q->heap[c];
-			q->heap[c] = q->heap[i];
-			q->heap[i] = tmp;
-		} else {
-			break;
+	} else {
+		/* the path goes down from start to hole */
+		for (size_t i = q->hole; i != q->start; ) {
+			size_t p = priority_queue_parent(q, i);
+			priority_queue_set(q, i, q->heap[p]);
+			i = p;
 		}
 	}
+	priority_queue_set(q, q->start, q->sifted);
+	q->hole = 0;
+}
 
-	return root;
+
+/* {{{1
+ * Put ‘q’ back the way it was before a push or pop whose compare function
+ * failed to return, for example by |longjmp|ing out of it.  The sift that
+ * was interrupted is undone, see |priority_queue_unsift|, and then the item
+ * that was being pushed is taken off of the bottom of the heap again, or the
+ * item that was being popped is put back on top, with the last item back at
+ * the bottom.  This doesn't compare any items, so it can't fail as well, and
+ * leaves the heap exactly as it was before.  Other calls that sift can't be
+ * undone like this, as their sifts depend on each other.
+ */
+void
+priority_queue_recover(PriorityQueue *q)
+{
+	invariant(q != null);
+
+	unless (q->hole == 0) {
+		priority_queue_unsift(q);
+	}
+
+	if (q->pushing) {
+		if (q->indexed) {
+			*priority_queue_index(q, q->heap[q->len]) = 0;
+		}
+		q->len--;
+		q->pushing = false;
+	}
+
+	if (q->popping) {
+		priority_queue_set(q, ++q->len, q->heap[1]);
+		priority_queue_set(q, 1, q->root);
+		q->popping = false;
+	}
+}
+
+
+/* {{{1
+ * Get the item with highest priority without removing it from the queue.
+ * Returns ‹null› if the queue is empty.
+ */
+pointer
+priority_queue_peek(PriorityQueue *q)
+{
+	invariant(q != null);
+
+	return (q->len > 0) ? q->heap[1] : null;
+}
+
+
+/* {{{1
+ * Pop the (at most) ‘k’ items with highest priority off of the priority
+ * queue, storing them in ‘out’ in order of decreasing priority.  Returns the
+ * number of items popped, which is less than ‘k’ only if the queue ran out of
+ * items.
+ */
+size_t
+priority_queue_pop_many(PriorityQueue *q, pointer *out, size_t k)
+{
+	invariant(q != null);
+	invariant(out != null || k == 0);
+
+	size_t n = MIN(k, q->len);
+	for (size_t i = 0; i < n; i++) {
+		out[i] = priority_queue_pop(q);
+	}
+
+	return n;
+}
+
+
+/* {{{1
+ * Find the index of ‘data’ in the heap, or zero if it's not in the queue.
+ * For indexed queues, the item knows where it is.  Other queues must have an
+ * ‘equal’ function, and we have to look through the whole heap.
+ */
+static size_t
+priority_queue_position(PriorityQueue *q, constpointer data)
+{
+	if (q->indexed) {
+		size_t i = *priority_queue_index(q, data);
+		return (i <= q->len && q->heap[i] == data) ? i : 0;
+	}
+
+	invariant(q->equal != null);
+
+	for (size_t i = 1; i <= q->len; i++) {
+		if (q->equal(q->heap[i], data)) {
+			return i;
+		}
+	}
+
+	return 0;
+}
+
+
+/* {{{1
+ * Restore the position of ‘data’ in the heap after its priority has changed
+ * (in either direction).  ‘data’ must be in the queue.  This is O(log n) for
+ * indexed queues.  For other queues, finding ‘data’ takes O(n) time.
+ */
+void
+priority_queue_update(PriorityQueue *q, pointer data)
+{
+	invariant(q != null);
+
+	size_t i = priority_queue_position(q, data);
+	invariant(i != 0);
+
+	if (priority_queue_sift_up(q, i) == i) {
+		priority_queue_sift_down(q, i);
+	}
+}
+
+
+/* {{{1
+ * Remove ‘data’ from the queue.  The return value tells whether it was in the
+ * queue.  The running times are the same as for |priority_queue_update|.
+ */
+bool
+priority_queue_remove(PriorityQueue *q, constpointer data)
+{
+	invariant(q != null);
+
+	size_t i = priority_queue_position(q, data);
+	if (i == 0) {
+		return false;
+	}
+	if (q->indexed) {
+		*priority_queue_index(q, q->heap[i]) = 0;
+	}
+
+	/* fill the hole with our last element, which may go either way */
+	pointer last = q->heap[q->len--];
+	if (i <= q->len) {
+		priority_queue_set(q, i, last);
+		if (priority_queue_sift_up(q, i) == i) {
+			priority_queue_sift_down(q, i);
+		}
+	}
+
+	return true;
 }
 
 
@@ -179,32 +688,112 @@ priority_queue_empty(PriorityQueue *q)
 
 /* {{{1
  * Check if the priority queue contains the given data.  This requires that the
- * priority queue was created with an non-‹null› ‘equal’ function.
+ * priority queue was created with an non-‹null› ‘equal’ function, or that it's
+ * indexed, in which case this takes O(1) time.  Otherwise we have to look
+ * through the whole heap, as the heap ordering can't tell us where to look.
  */
 bool
 priority_queue_contains(PriorityQueue *q, constpointer data)
 {
 	invariant(q != null);
-	invariant(q->equal != null);
 
-	if (q->len > 0 && q->equal(q->heap[1], data)) {
-		return true;
+	return priority_queue_position(q, data) != 0;
+}
+
+
+/* {{{1
+ * Sift index ‘i’ of the auxiliary heap ‘aux’ of ‘len’ heap indices used by
+ * |priority_queue_map_sorted| downwards.  ‘aux’ is a binary heap, starting at
+ * index 0, ordered by the items at the heap nodes it refers to.
+ */
+static void
+priority_queue_aux_sift_down(PriorityQueue *q, size_t *aux, size_t len,
+			     size_t i)
+{
+	size_t node = aux[i];
+
+	for (size_t c; (c = 2 * i + 1) < len; i = c) {
+		if (c + 1 < len &&
+		    q->compare(q->heap[aux[c + 1]], q->heap[aux[c]]) < 0) {
+			c++;
+		}
+		unless (q->compare(q->heap[node], q->heap[aux[c]]) > 0) {
+			break;
+		}
+		aux[i] = aux[c];
+	}
+	aux[i] = node;
+}
+
+
+/* {{{1
+ * Sift index ‘i’ of the auxiliary heap ‘aux’ upwards.
+ */
+static void
+priority_queue_aux_sift_up(PriorityQueue *q, size_t *aux, size_t i)
+{
+	size_t node = aux[i];
+
+	for (size_t p; i > 0 &&
+	     q->compare(q->heap[aux[p = (i - 1) / 2]], q->heap[node]) > 0;
+	     i = p) {
+		aux[i] = aux[p];
+	}
+	aux[i] = node;
+}
+
+
+/* {{{1
+ * Call ‘lambda’ on the (at most) ‘k’ items with highest priority, in order of
+ * decreasing priority, without modifying the queue.  The next item in order
+ * is always the root or a child of an item we've already visited, so we keep
+ * these candidates in a small auxiliary heap of node indices, which never
+ * holds more than 1 + ‘k’ * (‘arity’ - 1) of them.  Visiting k items thus
+ * costs O(k log k) time, independently of the size of the queue.  Returns
+ * the number of items visited.
+ */
+static size_t
+priority_queue_map_sorted(PriorityQueue *q, size_t k, MapFunc lambda,
+			  pointer closure)
+{
+	k = MIN(k, q->len);
+	if (k == 0) {
+		return 0;
 	}
 
-	for (size_t i = 1, c; (c = 2 * i) <= q->len; i = c) {
-		if (q->equal(q->heap[c], data) ||
-		    (c + 1 <= q->len && q->equal(q->heap[c + 1], data))) {
-			return true;
+	size_t *aux = new_array(size_t,
+				MIN(1 + k * (q->arity - 1), q->len));
+	size_t len = 0;
+	aux[len++] = 1;
+
+	for (size_t n = 0; n < k; n++) {
+		size_t i = aux[0];
+		lambda(q->heap[i], closure);
+
+		/* replace the visited node by its children */
+		aux[0] = aux[--len];
+		if (len > 0) {
+			priority_queue_aux_sift_down(q, aux, len, 0);
+		}
+
+		size_t c = priority_queue_first_child(q, i);
+		size_t last = MIN(c + q->arity - 1, q->len);
+		for (; c <= last; c++) {
+			aux[len] = c;
+			priority_queue_aux_sift_up(q, aux, len++);
 		}
 	}
 
-	return false;
+	release(aux);
+
+	return k;
 }
 
 
 /* {{{1
  * Call the given function on each item of the given priority queue in order of
- * decreasing priority.
+ * decreasing priority.  This takes O(n log n) time, see
+ * |priority_queue_map_sorted|.
  */
 void
 priority_queue_map(PriorityQueue *q, MapFunc lambda, pointer closure)
@@ -212,19 +801,98 @@ priority_queue_map(PriorityQueue *q, MapFunc lambda, pointer closure)
 	invariant(q != null);
 	invariant(lambda != null);
 
-	if (q->len > 0) {
-		lambda(q->heap[1], closure);
-	}
+	priority_queue_map_sorted(q, q->len, lambda, closure);
+}
 
-	for (size_t i = 1, c; (c = 2 * i) <= q->len; i = c) {
-		lambda(q->heap[c], closure);
-		if (c + 1 <= q->len) {
-			lambda(q->heap[c + 1], closure);
-		}
+
+/* {{{1
+ * Call the given function on each item of the given priority queue, in no
+ * particular order.  This takes O(n) time, and is what to use when the order
+ * doesn't matter, such as when marking the items for a garbage collector.
+ */
+void
+priority_queue_map_unordered(PriorityQueue *q, MapFunc lambda, pointer closure)
+{
+	invariant(q != null);
+	invariant(lambda != null);
+
+	for (size_t i = 1; i <= q->len; i++) {
+		lambda(q->heap[i], closure);
 	}
 }
 
 
+/* {{{1
+ * Append ‘data’ to the array being filled in by
+ * |priority_queue_to_sorted_array|.
+ */
+static void
+priority_queue_collect(pointer data, pointer closure)
+{
+	pointer **out = closure;
+
+	*(*out)++ = data;
+}
+
+
+/* {{{1
+ * Store the (at most) ‘k’ items with highest priority in ‘out’, in order of
+ * decreasing priority, without modifying the queue.  Returns the number of
+ * items stored, which is less than ‘k’ only if there are fewer items in the
+ * queue.  This takes O(k log k) time, so getting the top few items of a large
+ * queue is cheap.
+ */
+size_t
+priority_queue_to_sorted_array(PriorityQueue *q, pointer *out, size_t k)
+{
+	invariant(q != null);
+	invariant(out != null || k == 0);
+
+	return priority_queue_map_sorted(q, k, priority_queue_collect, &out);
+}
+
+
+
+/* {{{1
+ * Get the statistics of ‘q’ into ‘stats’, returning true, if the library was
+ * compiled with PRIORITY_QUEUE_STATS defined.  Otherwise, ‘stats’ is cleared,
+ * and false is returned.  The statistics cover the time since the queue was
+ * created or last given to |priority_queue_reset_stats|:
+ *
+ * ‘sift_ups’ and ‘sift_downs’ are the number of times an item was sifted up or
+ * down the heap, and ‘sift_up_levels’ and ‘sift_down_levels’ the total number
+ * of levels they moved it.  ‘depths’[d] is the number of sifts, of either
+ * kind, that moved an item d levels, the last bucket counting all the longer
+ * ones as well.  ‘comparisons’ is the number of items compared by the sifts.
+ */
+bool
+priority_queue_get_stats(PriorityQueue *q, PriorityQueueStats *stats)
+{
+	invariant(q != null);
+	invariant(stats != null);
+
+#ifdef PRIORITY_QUEUE_STATS
+	*stats = q->stats;
+	return true;
+#else
+	memset(stats, 0, sizeof(*stats));
+	return false;
+#endif
+}
+
+
+/* {{{1
+ * Reset the statistics of ‘q’, see |priority_queue_get_stats|.
+ */
+void
+priority_queue_reset_stats(PriorityQueue *q)
+{
+	invariant(q != null);
+
+	PRIORITY_QUEUE_STAT(memset(&q->stats, 0, sizeof(q->stats)));
+}
+
+
 /* }}}1 */
 
 
@@ -28,17 +28,54 @@
 typedef struct _PriorityQueue PriorityQueue;
 
 
+#define PRIORITY_QUEUE_STATS_DEPTHS	64
+
+typedef struct _PriorityQueueStats PriorityQueueStats;
+
+struct _PriorityQueueStats {
+	unsigned long comparisons;
+	unsigned long sift_ups;
+	unsigned long sift_up_levels;
+	unsigned long sift_downs;
+	unsigned long sift_down_levels;
+	unsigned long depths[PRIORITY_QUEUE_STATS_DEPTHS];
+};
+
+
 PriorityQueue *priority_queue_new(CompareFunc compare, EqualFunc equal);
 PriorityQueue *priority_queue_sized_new(CompareFunc compare,
 					EqualFunc equal,
 					size_t size);
+PriorityQueue *priority_queue_new_dary(CompareFunc compare,
+				       EqualFunc equal,
+				       size_t arity);
+PriorityQueue *priority_queue_new_indexed(CompareFunc compare,
+					  size_t index_offset);
+PriorityQueue *priority_queue_new_from_array(CompareFunc compare,
+					     EqualFunc equal,
+					     pointer *data,
+					     size_t n);
 void priority_queue_release(PriorityQueue *q);
 void priority_queue_push(PriorityQueue *q, pointer data);
+void priority_queue_push_many(PriorityQueue *q, pointer *data, size_t n);
 pointer priority_queue_pop(PriorityQueue *q);
-inline int priority_queue_length(PriorityQueue *q);
-inline bool priority_queue_empty(PriorityQueue *q);
+pointer priority_queue_peek(PriorityQueue *q);
+void priority_queue_recover(PriorityQueue *q);
+size_t priority_queue_pop_many(PriorityQueue *q, pointer *out, size_t k);
+int priority_queue_length(PriorityQueue *q);
+bool priority_queue_empty(PriorityQueue *q);
 bool priority_queue_contains(PriorityQueue *q, constpointer data);
+void priority_queue_update(PriorityQueue *q, pointer data);
+bool priority_queue_remove(PriorityQueue *q, constpointer data);
 void priority_queue_map(PriorityQueue *q, MapFunc lambda, pointer closure);
+void priority_queue_map_unordered(PriorityQueue *q,
+				  MapFunc lambda,
+				  pointer closure);
+size_t priority_queue_to_sorted_array(PriorityQueue *q,
+				      pointer *out,
+				      size_t k);
+bool priority_queue_get_stats(PriorityQueue *q, PriorityQueueStats *stats);
+void priority_queue_reset_stats(PriorityQueue *q);
 
 
 #endif /* PRIORITYQUEUE_H */
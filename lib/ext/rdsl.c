@@ -0,0 +1,174 @@
+/*
+ * contents: Ruby extension for the RDSL data structures.
+ * arch-tag: 00e13c8a-ef64-4c9a-bd8f-a9908f34db76
+ *
+ * Copyright (C) 2004 Nikolai Weibull <source@pcppopper.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+
+#include <string.h>
+#include <ruby.h>
+#include <clear/internal.h>
+#include "rdsl.h"
+
+
+/* {{{1
+ * The RDSL module and the SortedAssociation module that our classes include.
+ */
+VALUE mRDSL;
+VALUE mSortedAssociation;
+
+
+/* {{{1
+ * The IDs of the methods we call.
+ */
+static ID s_id_cmp;
+
+
+/* {{{1
+ * Compare two Ruby objects the way |CompareDataFunc|s do, which is how our
+ * ADTs want it.  Fixnums, Symbols, and Strings are compared directly, as they
+ * are by far the most common keys, and everything else with <=>, which may
+ * raise an exception if the two objects can't be compared.  The exception
+ * unwinds straight through the C code of the ADT that called us, which is
+ * only safe while the ADT could be abandoned as it is.  The trees and
+ * skiplists compare keys only while searching, before they change anything,
+ * and only change their fingers once they're done comparing, so they're left
+ * as they were.  Any other ADT that compares keys while it's in an
+ * inconsistent state must protect the comparison with |rb_protect| in its
+ * binding, and repair itself before passing the exception on, as the
+ * PriorityQueue does.
+ */
+int
+rdsl_compare(constpointer a, constpointer b, pointer data)
+{
+	VALUE x = (VALUE)a;
+	VALUE y = (VALUE)b;
+
+	if (FIXNUM_P(x) && FIXNUM_P(y)) {
+		long i = FIX2LONG(x), j = FIX2LONG(y);
+		return (i > j) - (i < j);
+	}
+
+	/* Symbol#<=> compares the names of the symbols */
+	if (SYMBOL_P(x) && SYMBOL_P(y)) {
+		return strcmp(rb_id2name(SYM2ID(x)), rb_id2name(SYM2ID(y)));
+	}
+
+	if (TYPE(x) == T_STRING && TYPE(y) == T_STRING) {
+		return rb_str_cmp(x, y);
+	}
+
+	return rb_cmpint(rb_funcall(x, s_id_cmp, 1, y), x, y);
+}
+
+
+/* {{{1
+ * Check if the traversal ‘order’ is SortedAssociation::DESCENDING.
+ */
+bool
+rdsl_descending_p(VALUE order)
+{
+	return RTEST(rb_equal(order, rb_const_get(mSortedAssociation,
+						  rb_intern("DESCENDING"))));
+}
+
+
+/* {{{1
+ * Check the arguments of a |load_sorted| method: ‘keys’ and ‘values’ must be
+ * Arrays of the same length, and ‘keys’ must be in strictly ascending order
+ * according to |rdsl_compare|, or the ADT built from them, without comparing
+ * any keys, would be left out of order.  Raises ArgumentError otherwise.
+ * This is done before the ADT is touched, as the comparisons may raise.
+ */
+void
+rdsl_check_sorted(VALUE keys, VALUE values)
+{
+	Check_Type(keys, T_ARRAY);
+	Check_Type(values, T_ARRAY);
+	if (RARRAY_LEN(keys) != RARRAY_LEN(values)) {
+		rb_raise(rb_eArgError, "keys and values differ in length");
+	}
+
+	for (long i = 1; i < RARRAY_LEN(keys); i++) {
+		if (rdsl_compare((constpointer)rb_ary_entry(keys, i - 1),
+				 (constpointer)rb_ary_entry(keys, i),
+				 null) >= 0) {
+			rb_raise(rb_eArgError,
+				 "keys aren't in ascending order");
+		}
+	}
+}
+
+
+/* {{{1
+ * Convert the ‘n’ ‘buckets’ of a histogram in the statistics of one of our
+ * ADTs to an Array, leaving out the empty buckets at the end.
+ */
+VALUE
+rdsl_histogram(const unsigned long *buckets, size_t n)
+{
+	while (n > 0 && buckets[n - 1] == 0) {
+		n--;
+	}
+
+	VALUE histogram = rb_ary_new2(n);
+	for (size_t i = 0; i < n; i++) {
+		rb_ary_push(histogram, ULONG2NUM(buckets[i]));
+	}
+
+	return histogram;
+}
+
+
+/* {{{1
+ * Initialize the extension.  This is called by Ruby when the extension is
+ * required.  It's meant to be required by the Ruby files that define the
+ * classes it provides native implementations for, see src/skiplist.rb,
+ * src/redblacktree.rb, and src/stringsearch.rb.
+ */
+void
+Init_rdsl(void)
+{
+	s_id_cmp = rb_intern("<=>");
+
+	rb_require("sortedassociation");
+	mRDSL = rb_define_module("RDSL");
+	mSortedAssociation = rb_const_get(mRDSL,
+					  rb_intern("SortedAssociation"));
+
+	/*
+	 * our Skiplist methods replace those of src/skiplist.rb, which requires
+	 * us once it has defined them, so if we're required first, load it
+	 * before we define ours, or it would replace them instead.
+	 */
+	unless (rb_const_defined(mRDSL, rb_intern("Skiplist"))) {
+		rb_require("skiplist");
+	}
+	rdsl_init_skiplist();
+	rdsl_init_redblack();
+	rdsl_init_pattern();
+	rdsl_init_multipattern();
+	rdsl_init_priorityqueue();
+}
+
+
+/* }}}1 */
+
+
+
+/* vim: set sts=0 sw=8 ts=8: */
@@ -0,0 +1,48 @@
+/*
+ * contents: Ruby extension for the RDSL data structures.
+ * arch-tag: 92cce9d5-0184-4c56-ad11-f5de3c6bccb7
+ *
+ * Copyright (C) 2004 Nikolai Weibull <source@pcppopper.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+
+
+#ifndef RDSL_H
+#define RDSL_H
+
+
+extern VALUE mRDSL;
+extern VALUE mSortedAssociation;
+
+
+int rdsl_compare(constpointer a, constpointer b, pointer data);
+bool rdsl_descending_p(VALUE order);
+void rdsl_check_sorted(VALUE keys, VALUE values);
+VALUE rdsl_histogram(const unsigned long *buckets, size_t n);
+
+void rdsl_init_skiplist(void);
+void rdsl_init_redblack(void);
+void rdsl_init_pattern(void);
+void rdsl_init_multipattern(void);
+void rdsl_init_priorityqueue(void);
+
+
+#endif /* RDSL_H */
+
+
+
+/* vim: set sts=0 sw=8 ts=8: */
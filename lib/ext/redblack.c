@@ -21,11 +21,20 @@
 
 
 
+#include <stdint.h>
+#include <string.h>
 #include <clear/internal.h>
 #include <clear/mem.h>
 #include "redblack.h"
 
 
+/* {{{1
+ * The number of nodes in each slab allocated for trees that don't specify it
+ * themselves, i.e. those created by |rb_tree_new_from_sorted|.
+ */
+#define RB_TREE_DEFAULT_SLAB_SIZE	64
+
+
 /* {{{1
  * Type definitions: We need a couple of types for our red-black tree
  * implementation, namely a way of distinguishing node colors, nodes, and our
@@ -45,8 +54,12 @@ typedef enum {
 /* {{{2
  * Our node type.  ‘left’ and ‘right’ are our binary children, ‘parent’ is our
  * parent node, ‘color’ defines our color, ‘key’ and ‘value’ are also obvious.
- * There's no use in using a bit-field for ‘color’ as we still need it to align
- * properly with the rest of the data.
+ * ‘height’ is the height of the sub-tree rooted at this node, which is never
+ * more than RB_TREE_MAX_HEIGHT, so that |rb_tree_height| is O(1).  ‘count’ is
+ * the number of nodes in the sub-tree rooted at this node, which we use for
+ * order-statistics queries.  ‘color’ and ‘height’ are stored in a byte each,
+ * which, on most architectures, lets them and ‘count’ fit in the padding
+ * before ‘key’, so they're all free.
  */
 typedef struct _RBTreeNode RBTreeNode;
 
@@ -54,7 +67,9 @@ struct _RBTreeNode {
 	RBTreeNode *left;
 	RBTreeNode *right;
 	RBTreeNode *parent;
-	RBTreeNodeColor color;
+	unsigned char color;
+	unsigned char height;
+	int count;
 	pointer key;
 	pointer value;
 };
@@ -63,61 +78,239 @@ struct _RBTreeNode {
 /* {{{2
  * We use the following node to denote our ‘null node’.  We use it instead of a
  * normal ‹null› for nodes as we can use it's properties even when we mostly
- * treat it as ‹null›.
+ * treat it as ‹null›.  It's shared by all trees, so we must never write to it,
+ * or trees used by different threads would race on it.
  */
 static RBTreeNode s_null_node = {
-	&s_null_node, &s_null_node, &s_null_node, BLACK, null, null
+	&s_null_node, &s_null_node, &s_null_node, BLACK, 0, 0, null, null
 };
 #define rb_null	(&s_null_node)
 
 
+/* {{{2
+ * A slab is a contiguous chunk of ‘slab_size’ nodes owned by a single tree.
+ * Slabs are chained through ‘next’ so that they can all be released together
+ * with the tree.
+ */
+typedef struct _RBTreeSlab RBTreeSlab;
+
+struct _RBTreeSlab {
+	RBTreeSlab *next;
+	RBTreeNode *nodes;
+};
+
+
+/* {{{2
+ * RBTreeKeyType: Enumeration over the kinds of keys we have specialized
+ * searches for.  Trees with custom keys use the comparator they were given.
+ */
+typedef enum {
+	KEY_CUSTOM,
+	KEY_INT,
+	KEY_STRING
+} RBTreeKeyType;
+
+
 /* {{{2
  * Our tree structure, containing function pointers to notifiers and
- * comparators (with data), and a pointer to the root node of our tree.
+ * comparators (with data), a pointer to the root node of our tree, and the
+ * number of nodes in it, ‘size’.  If ‘slab_size’ is non-zero, nodes are taken
+ * from the tree's own ‘slabs’ instead of the global free-list.  ‘slab_used’ is
+ * the number of nodes handed out from the first slab in ‘slabs’ and
+ * ‘slab_free_list’ holds nodes that have been removed from the tree.
+ * ‘key_type’ tells us which search to use, see |rb_tree_find_from|.
+ * ‘concurrent’, ‘seq’, and ‘limbo’ are used for trees created with
+ * |rb_tree_new_concurrent|, see below.  ‘stats’ is only there if
+ * RB_TREE_STATS is defined, see |rb_tree_get_stats|.
  */
 struct _RBTree {
+	RBTreeKeyType key_type;
 	CompareDataFunc key_compare;
 	pointer key_compare_data;
 	ReleaseNotify key_release;
 	ReleaseNotify value_release;
 	RBTreeNode *root;
+	int size;
+	RBTreeSlab *slabs;
+	RBTreeNode *slab_free_list;
+	size_t slab_size;
+	size_t slab_used;
+	bool concurrent;
+	unsigned int seq;
+	RBTreeNode *limbo;
+#ifdef RB_TREE_STATS
+	RBTreeStats stats;
+#endif
 };
 
 
+/* {{{2
+ * Statistics: Each statement that keeps the statistics of a tree is wrapped in
+ * RB_TREE_STAT, so that it disappears entirely unless RB_TREE_STATS is
+ * defined, and the counting costs nothing by default.
+ */
+#ifdef RB_TREE_STATS
+#  define RB_TREE_STAT(statement)	statement
+#else
+#  define RB_TREE_STAT(statement)
+#endif
+
+
+/* {{{1
+ * Concurrent Readers: Trees created with |rb_tree_new_concurrent| may be read
+ * with |rb_tree_lookup| and |rb_tree_lookup_extended| by any number of
+ * threads while one thread modifies it, without any locking.  This works like
+ * a sequence lock: the writer increments ‘seq’ before and after each
+ * modification, so it's odd while one is in progress.  A reader records
+ * ‘seq’, searches the tree, and then checks that ‘seq’ is still the same, as
+ * it may otherwise have seen the tree in an inconsistent state, in which case
+ * it simply tries again.
+ *
+ * As readers may still be looking at nodes, keys, and values that the writer
+ * has removed from the tree, they can't be released right away.  Instead, they
+ * are put in ‘limbo’, a list of retired nodes linked through their ‘parent’
+ * pointers, with ‘count’ telling what to release (see below).  The writer
+ * must then call |rb_tree_reclaim| when no reader that started before the
+ * retirement can still be running.
+ */
+#define LIMBO_KEY	(1 << 0)
+#define LIMBO_VALUE	(1 << 1)
+
+/*
+ * No valid tree is higher than this, as a red-black tree with n nodes is at
+ * most 2 log(n + 1) high.  It must fit in the ‘height’ of a node.
+ */
+#define RB_TREE_MAX_HEIGHT	(2 * 64)
+
+#define rb_tree_read(lvalue)	__atomic_load_n(&(lvalue), __ATOMIC_RELAXED)
+
+
+/* {{{2
+ * Begin a modification of ‘tree’.
+ */
+static inline void
+rb_tree_write_begin(RBTree *tree)
+{
+	if (tree->concurrent) {
+		__atomic_store_n(&tree->seq, tree->seq + 1, __ATOMIC_RELAXED);
+		__atomic_thread_fence(__ATOMIC_RELEASE);
+	}
+}
+
+
+/* {{{2
+ * End a modification of ‘tree’.
+ */
+static inline void
+rb_tree_write_end(RBTree *tree)
+{
+	if (tree->concurrent) {
+		__atomic_store_n(&tree->seq, tree->seq + 1, __ATOMIC_RELEASE);
+	}
+}
+
+
 /* {{{1
  * Memory Management: We use, like all other ADT's in our library for which
- * it applies, free-lists.  So let's define them here.
+ * it applies, free-lists.  So let's define them here.  Trees created with
+ * |rb_tree_new_slab| keep their own free-list, which needs no locking, as a
+ * tree may only be modified by one thread at a time anyway.
  */
 G_LOCK_DEFINE_STATIC(node_free_list);
 static RBTreeNode *node_free_list = null;
 
 
 
+/* {{{1
+ * Get a node from the slabs of ‘tree’, allocating a new slab if the current
+ * one has been used up.
+ */
+static RBTreeNode *
+rb_tree_slab_node_new(RBTree *tree)
+{
+	RBTreeNode *node;
+
+	if (tree->slab_free_list != null) {
+		RB_TREE_STAT(tree->stats.free_list_hits++);
+		node = tree->slab_free_list;
+		tree->slab_free_list = node->left;
+		return node;
+	}
+
+	RB_TREE_STAT(tree->stats.free_list_misses++);
+
+	if (tree->slabs == null || tree->slab_used == tree->slab_size) {
+		RBTreeSlab *slab = new_struct(RBTreeSlab);
+		slab->nodes = new_array(RBTreeNode, tree->slab_size);
+		slab->next = tree->slabs;
+		tree->slabs = slab;
+		tree->slab_used = 0;
+	}
+
+	return &tree->slabs->nodes[tree->slab_used++];
+}
+
+
+/* {{{1
+ * Release all slabs of ‘tree’, and thereby all of its nodes, at once.
+ */
+static void
+rb_tree_slabs_release(RBTree *tree)
+{
+	RBTreeSlab *slab = tree->slabs;
+
+	until (slab == null) {
+		RBTreeSlab *next = slab->next;
+		release(slab->nodes);
+		release(slab);
+		slab = next;
+	}
+
+	tree->slabs = null;
+	tree->slab_free_list = null;
+	tree->slab_used = 0;
+}
+
+
 /* {{{1
  * Create a new node with the given key and value.  Uses the memory allocation
  * scheme outlined above.
  */
 static RBTreeNode *
-rb_tree_node_new(pointer key,
+rb_tree_node_new(RBTree *tree,
+		 pointer key,
 		 pointer value,
 		 RBTreeNode *parent,
 		 RBTreeNodeColor color)
 {
 	RBTreeNode *node;
 
-	G_LOCK(node_free_list);
-	if (node_free_list) {
-		node = node_free_list;
-		node_free_list = node->left;
+	if (tree->slab_size > 0) {
+		node = rb_tree_slab_node_new(tree);
 	} else {
-		node = new_struct(RBTreeNode);
+		G_LOCK(node_free_list);
+		if (node_free_list) {
+			node = node_free_list;
+			node_free_list = node->left;
+		} else {
+			node = null;
+		}
+		G_UNLOCK(node_free_list);
+
+		if (node != null) {
+			RB_TREE_STAT(tree->stats.free_list_hits++);
+		} else {
+			RB_TREE_STAT(tree->stats.free_list_misses++);
+			node = new_struct(RBTreeNode);
+		}
 	}
-	G_UNLOCK(node_free_list);
 
 	node->left = rb_null;
 	node->right = rb_null;
 	node->parent = parent;
 	node->color = color;
+	node->height = 1;
+	node->count = 1;
 	node->key = key;
 	node->value = value;
 
@@ -126,36 +319,145 @@ rb_tree_node_new(pointer key,
 
 
 /* {{{1
- * Free a node, notifying the tree's owner before doing so.  It's basically the
- * owners responsibility to free the key and value if necessary.  These
- * functions are passed to |rb_tree_new_full| if needed.  We simply use them
- * if they're defined.
+ * Put the chain of nodes from ‘first’ to ‘last’, linked through their ‘left’
+ * pointers, back on the free-list they came from.  Nodes are freed in chains
+ * like this where we can, so that the lock of the global free-list is taken
+ * once for all of them, instead of once for each.
+ */
+static void
+rb_tree_nodes_free(RBTree *tree, RBTreeNode *first, RBTreeNode *last)
+{
+	if (tree->slab_size > 0) {
+		last->left = tree->slab_free_list;
+		tree->slab_free_list = first;
+	} else {
+		G_LOCK(node_free_list);
+		last->left = node_free_list;
+		node_free_list = first;
+		G_UNLOCK(node_free_list);
+	}
+}
+
+
+/* {{{1
+ * Put ‘node’ back on the free-list it came from.
+ */
+static inline void
+rb_tree_node_free(RBTree *tree, RBTreeNode *node)
+{
+	rb_tree_nodes_free(tree, node, node);
+}
+
+
+/* {{{1
+ * Notify the tree's owner of the release of ‘key’ and/or ‘value’, as told by
+ * ‘what’, if they want to know.
+ */
+static void
+rb_tree_pair_release(RBTree *tree, pointer key, pointer value, int what)
+{
+	if ((what & LIMBO_KEY) && tree->key_release != null) {
+		tree->key_release(key);
+	}
+	if ((what & LIMBO_VALUE) && tree->value_release != null) {
+		tree->value_release(value);
+	}
+}
+
+
+/* {{{1
+ * Release the key and/or value of ‘node’, as told by ‘what’, and then the
+ * node itself, which must no longer be in ‘tree’.  For concurrent trees, the
+ * node is put in limbo instead.
+ */
+static void
+rb_tree_node_retire(RBTree *tree, RBTreeNode *node, int what)
+{
+	if (tree->concurrent) {
+		node->count = what;
+		node->parent = tree->limbo;
+		tree->limbo = node;
+	} else {
+		rb_tree_pair_release(tree, node->key, node->value, what);
+		rb_tree_node_free(tree, node);
+	}
+}
+
+
+/* {{{1
+ * Release ‘key’ and/or ‘value’, as told by ‘what’, which have been replaced in
+ * ‘tree’.  For concurrent trees, they are put in limbo, using a node of their
+ * own.
+ */
+static void
+rb_tree_pair_retire(RBTree *tree, pointer key, pointer value, int what)
+{
+	if (tree->concurrent) {
+		rb_tree_node_retire(tree,
+				    rb_tree_node_new(tree, key, value,
+						     rb_null, BLACK),
+				    what);
+	} else {
+		rb_tree_pair_release(tree, key, value, what);
+	}
+}
+
+
+/* {{{1
+ * Release all nodes of ‘tree’, notifying the tree's owner of the release of
+ * their keys and values, if they want to know.  The nodes are put back on the
+ * free-list in one chain, except for trees with slabs, as those nodes are all
+ * released at once with the slabs afterwards.
  *
- * TODO: There's a possible speed improvement to be made here by making this
- * function act like a tail-recursive function so that we simply jump to the
- * initial test if the left and/or right nodes need releasing as well, but
- * that's a bit of a pain to get right.
+ * We don't recurse, as deep trees would need a deep stack, and we don't do a
+ * post-order traversal either, as that needs to climb back up through each
+ * node.  Instead, we rotate the left child of the root up until the root has
+ * none, at which point it's the smallest node left, and can be released, and
+ * its right child becomes the new root.  Each node is rotated up at most
+ * once, so this takes O(n) time.
  */
 static void
-rb_tree_node_release(RBTreeNode *node, ReleaseNotify key_release,
-		     ReleaseNotify value_release)
+rb_tree_nodes_release(RBTree *tree)
 {
-	unless (node == rb_null) {
-		rb_tree_node_release(node->right, key_release, value_release);
-		rb_tree_node_release(node->left, key_release, value_release);
+	bool notify = tree->key_release != null || tree->value_release != null;
+	bool chain = tree->slab_size == 0;
+	RBTreeNode *first = null;
+	RBTreeNode *last = null;
+	RBTreeNode *node = tree->root;
+
+	unless (notify || chain) {
+		node = rb_null;
+	}
 
-		unless (key_release == null) {
-			key_release(node->key);
+	until (node == rb_null) {
+		RBTreeNode *left = node->left;
+
+		unless (left == rb_null) {
+			node->left = left->right;
+			left->right = node;
+			node = left;
+			continue;
 		}
-		unless (value_release == null) {
-			value_release(node->key);
+
+		RBTreeNode *right = node->right;
+
+		rb_tree_pair_release(tree, node->key, node->value,
+				     LIMBO_KEY | LIMBO_VALUE);
+		if (chain) {
+			node->left = first;
+			first = node;
+			if (last == null) {
+				last = node;
+			}
 		}
+		node = right;
+	}
 
-		G_LOCK(node_free_list);
-		node->left = node_free_list;
-		node_free_list = node;
-		G_UNLOCK(node_free_list);
+	unless (first == null) {
+		rb_tree_nodes_free(tree, first, last);
 	}
+	tree->root = rb_null;
+	tree->size = 0;
 }
 
 
@@ -204,11 +506,258 @@ rb_tree_new_full(CompareDataFunc key_compare,
 	invariant(key_compare != null);
 
 	RBTree *tree = new_struct(RBTree);
+	tree->key_type = KEY_CUSTOM;
 	tree->key_compare = key_compare;
 	tree->key_compare_data = key_compare_data;
 	tree->key_release = key_release;
 	tree->value_release = value_release;
 	tree->root = rb_null;
+	tree->size = 0;
+	tree->slabs = null;
+	tree->slab_free_list = null;
+	tree->slab_size = 0;
+	tree->slab_used = 0;
+	tree->concurrent = false;
+	tree->seq = 0;
+	tree->limbo = null;
+	RB_TREE_STAT(memset(&tree->stats, 0, sizeof(tree->stats)));
+	return tree;
+}
+
+
+/* {{{1
+ * Comparators for the key types we specialize on.  These are the comparators
+ * of trees with such keys, used everywhere but in the searches done by
+ * |rb_tree_find_from|, which use the macros instead.
+ */
+#define RB_TREE_INT_COMPARE(a, b) \
+	(((intptr_t)(a) > (intptr_t)(b)) - ((intptr_t)(a) < (intptr_t)(b)))
+#define RB_TREE_STRING_COMPARE(a, b) \
+	strcmp((const char *)(a), (const char *)(b))
+
+static int
+rb_tree_int_compare(constpointer a, constpointer b, pointer data)
+{
+	return RB_TREE_INT_COMPARE(a, b);
+}
+
+static int
+rb_tree_string_compare(constpointer a, constpointer b, pointer data)
+{
+	return RB_TREE_STRING_COMPARE(a, b);
+}
+
+
+/* {{{1
+ * Create a new red-black tree with integer keys, i.e. ‹intptr_t›s cast to
+ * pointers.  Lookups in such a tree compare keys directly, instead of calling
+ * a comparator for each node visited.  As the keys aren't pointers they are
+ * never released, but the values of the tree are, using ‘value_release’ if
+ * it's non-‹null›.
+ */
+RBTree *
+rb_tree_new_int(ReleaseNotify value_release)
+{
+	RBTree *tree = rb_tree_new_full(rb_tree_int_compare,
+					null,
+					null,
+					value_release);
+	tree->key_type = KEY_INT;
+	return tree;
+}
+
+
+/* {{{1
+ * Create a new red-black tree with ‹NUL›-terminated strings as keys, ordered
+ * as by |strcmp()|.  Lookups in such a tree call |strcmp()| directly, instead
+ * of calling a comparator through a function pointer.  Keys and values are
+ * released as for trees created with |rb_tree_new_full|.
+ */
+RBTree *
+rb_tree_new_str(ReleaseNotify key_release, ReleaseNotify value_release)
+{
+	RBTree *tree = rb_tree_new_full(rb_tree_string_compare,
+					null,
+					key_release,
+					value_release);
+	tree->key_type = KEY_STRING;
+	return tree;
+}
+
+
+/* {{{1
+ * Create a new red-black tree with the same arguments as |rb_tree_new_full|,
+ * but whose nodes are allocated from slabs of ‘slab_size’ contiguous nodes
+ * owned by the tree.  Allocating and freeing nodes of such a tree needs no
+ * locking, neighboring nodes end up close together in memory, and all nodes
+ * are released at once by |rb_tree_release|.  Memory used by a slab is only
+ * given back when the tree is released, so use this for trees that mostly
+ * grow.
+ */
+RBTree *
+rb_tree_new_slab(CompareDataFunc key_compare,
+		 pointer key_compare_data,
+		 ReleaseNotify key_release,
+		 ReleaseNotify value_release,
+		 size_t slab_size)
+{
+	invariant(slab_size > 0);
+
+	RBTree *tree = rb_tree_new_full(key_compare,
+					key_compare_data,
+					key_release,
+					value_release);
+	tree->slab_size = slab_size;
+	return tree;
+}
+
+
+/* {{{1
+ * Create a new red-black tree with the same arguments as |rb_tree_new_full|,
+ * that may be read concurrently with modifications, as described above.  The
+ * owner of the tree must still make sure that only one thread modifies it at
+ * a time, and that values returned by lookups aren't used after they may have
+ * been released by |rb_tree_reclaim|.  Only |rb_tree_lookup| and
+ * |rb_tree_lookup_extended| may be used concurrently with modifications.
+ */
+RBTree *
+rb_tree_new_concurrent(CompareDataFunc key_compare,
+		       pointer key_compare_data,
+		       ReleaseNotify key_release,
+		       ReleaseNotify value_release)
+{
+	RBTree *tree = rb_tree_new_full(key_compare,
+					key_compare_data,
+					key_release,
+					value_release);
+	tree->concurrent = true;
+	return tree;
+}
+
+
+/* {{{1
+ * Release the nodes, keys, and values that modifications of ‘tree’ have put in
+ * limbo.  This may only be called by the thread modifying the tree, when no
+ * reader that started before the last modification can still be running.
+ */
+void
+rb_tree_reclaim(RBTree *tree)
+{
+	invariant(tree != null);
+
+	RBTreeNode *node = tree->limbo;
+	RBTreeNode *first = null;
+	RBTreeNode *last = null;
+
+	tree->limbo = null;
+	until (node == null) {
+		RBTreeNode *next = node->parent;
+
+		rb_tree_pair_release(tree, node->key, node->value, node->count);
+		node->left = first;
+		first = node;
+		if (last == null) {
+			last = node;
+		}
+		node = next;
+	}
+
+	unless (first == null) {
+		rb_tree_nodes_free(tree, first, last);
+	}
+}
+
+
+/* {{{1
+ * Build a perfectly balanced sub-tree out of ‘nodes’[‘lo’..‘hi’), which is
+ * installed under ‘parent’.  Nodes on level ‘red_depth’, the lowest level of
+ * the tree, are colored red, which gives all paths the same number of black
+ * nodes, as the nil-leaves of a tree built like this all lie on its two
+ * lowest levels.
+ */
+static RBTreeNode *
+rb_tree_node_build(RBTreeNode *nodes,
+		   pointer *keys,
+		   pointer *values,
+		   size_t lo,
+		   size_t hi,
+		   RBTreeNode *parent,
+		   int depth,
+		   int red_depth)
+{
+	if (lo == hi) {
+		return rb_null;
+	}
+
+	size_t mid = lo + (hi - lo) / 2;
+	RBTreeNode *node = &nodes[mid];
+
+	node->parent = parent;
+	node->color = (depth == red_depth) ? RED : BLACK;
+	node->count = hi - lo;
+	node->key = keys[mid];
+	node->value = (values != null) ? values[mid] : null;
+	node->left = rb_tree_node_build(nodes, keys, values, lo, mid, node,
+					depth + 1, red_depth);
+	node->right = rb_tree_node_build(nodes, keys, values, mid + 1, hi,
+					 node, depth + 1, red_depth);
+	node->height = MAX(node->left->height, node->right->height) + 1;
+
+	return node;
+}
+
+
+/* {{{1
+ * Create a new red-black tree, taking the same arguments as
+ * |rb_tree_new_full|, filled with the ‘n’ key/value pairs in ‘keys’ and
+ * ‘values’.  ‘keys’ must be sorted in strictly increasing order according to
+ * ‘key_compare’.  ‘values’ may be ‹null›, in which case all values will be
+ * ‹null›.  The tree is built bottom-up in O(n) time, without doing any
+ * comparisons, and all its nodes are taken from one contiguous allocation.
+ * Nodes inserted later on are allocated from slabs, as with
+ * |rb_tree_new_slab|.
+ */
+RBTree *
+rb_tree_new_from_sorted(pointer *keys,
+			pointer *values,
+			size_t n,
+			CompareDataFunc key_compare,
+			pointer key_compare_data,
+			ReleaseNotify key_release,
+			ReleaseNotify value_release)
+{
+	invariant(keys != null || n == 0);
+
+	RBTree *tree = rb_tree_new_slab(key_compare,
+					key_compare_data,
+					key_release,
+					value_release,
+					RB_TREE_DEFAULT_SLAB_SIZE);
+	if (n == 0) {
+		return tree;
+	}
+
+	/*
+	 * the nodes go in a slab of their own, which we mark as used up, so
+	 * that later insertions get a new one.
+	 */
+	RBTreeSlab *slab = new_struct(RBTreeSlab);
+	slab->nodes = new_array(RBTreeNode, n);
+	slab->next = null;
+	tree->slabs = slab;
+	tree->slab_used = tree->slab_size;
+
+	/* the lowest level of the tree is at depth floor(log2(n)) */
+	int red_depth = 0;
+	for (size_t i = n; i > 1; i /= 2) {
+		red_depth++;
+	}
+
+	tree->root = rb_tree_node_build(slab->nodes, keys, values, 0, n,
+					rb_null, 0, red_depth);
+	tree->root->color = BLACK;
+	tree->size = n;
+
 	return tree;
 }
 
@@ -223,13 +772,42 @@ rb_tree_release(RBTree *tree)
 {
 	invariant(tree != null);
 
-	rb_tree_node_release(tree->root,
-			     tree->key_release,
-			     tree->value_release);
+	rb_tree_reclaim(tree);
+	rb_tree_nodes_release(tree);
+	rb_tree_slabs_release(tree);
 	release(tree);
 }
 
 
+/* {{{1
+ * Recompute the height of ‘node’ from those of its children.
+ */
+static inline void
+rb_tree_node_update_height(RBTreeNode *node)
+{
+	node->height = MAX(node->left->height, node->right->height) + 1;
+}
+
+
+/* {{{1
+ * Recompute the heights of ‘node’ and its ancestors after the height of one of
+ * its sub-trees has changed.  We can stop as soon as a height stays the same,
+ * as the heights above it then do too.
+ */
+static void
+rb_tree_node_update_heights(RBTreeNode *node)
+{
+	until (node == rb_null) {
+		int height = MAX(node->left->height, node->right->height) + 1;
+		if (height == node->height) {
+			break;
+		}
+		node->height = height;
+		node = node->parent;
+	}
+}
+
+
 /* {{{1
  * Rotates a tree left.
  * 		X	-> rotate_left(X) ->		Y
@@ -246,6 +824,8 @@ rb_tree_rotate_left(RBTree *tree, RBTreeNode *x)
 
 	RBTreeNode *y = x->right;
 
+	RB_TREE_STAT(tree->stats.rotations++);
+
 	/* move b and set it's parent to x if it's not null*/
 	x->right = y->left;
 	if (y->left != rb_null) {
@@ -272,6 +852,15 @@ rb_tree_rotate_left(RBTree *tree, RBTreeNode *x)
 
 	/* and finally set x's parent to y */
 	x->parent = y;
+
+	/* y now roots what x used to, and x lost y's right sub-tree */
+	y->count = x->count;
+	x->count = x->left->count + x->right->count + 1;
+
+	/* which may have changed the heights of all of them */
+	rb_tree_node_update_height(x);
+	rb_tree_node_update_height(y);
+	rb_tree_node_update_heights(y->parent);
 }
 
 
@@ -287,10 +876,12 @@ rb_tree_rotate_right(RBTree *tree, RBTreeNode *y)
 
 	RBTreeNode *x = y->left;
 
+	RB_TREE_STAT(tree->stats.rotations++);
+
 	/* move b and set it's parent to y if it's not null*/
-	y->left = y->right;
+	y->left = x->right;
 	if (x->right != rb_null) {
-		y->right->parent = y;
+		x->right->parent = y;
 	}
 
 	/* x's parent will be y's parent */
@@ -313,44 +904,84 @@ rb_tree_rotate_right(RBTree *tree, RBTreeNode *y)
 
 	/* and finally set y's parent to x */
 	y->parent = x;
+
+	/* x now roots what y used to, and y lost x's left sub-tree */
+	x->count = y->count;
+	y->count = y->left->count + y->right->count + 1;
+
+	/* which may have changed the heights of all of them */
+	rb_tree_node_update_height(y);
+	rb_tree_node_update_height(x);
+	rb_tree_node_update_heights(x->parent);
 }
 
 
 /* {{{1
- * Find a node with the given key in ‘tree’.  If the node does not exist in
- * ‘tree’ already and ‘insert’ is true, insert it into ‘tree’ with the given
- * key and value.  If the tree already contains the given ‘key’ and if
- * ‘replace’ is true, replace the found nodes value with ‘value’.
+ * Traverse down the tree from ‘iter’ looking for ‘key’, comparing keys with
+ * ‘compare’.  This is expanded once for each key type in |rb_tree_find_from|,
+ * so that the comparisons can be inlined for the specialized ones.
+ */
+#define RB_TREE_DESCEND(compare) do {					\
+	until (iter == rb_null || found) {				\
+		iters_parent = iter;					\
+		RB_TREE_STAT(depth++);					\
+									\
+		cmp = compare(key, iter->key);				\
+		if (cmp < 0) {						\
+			iter = iter->left;				\
+		} else if (cmp == 0) {					\
+			found = true;					\
+		} else { /* (cmp > 0) */				\
+			iter = iter->right;				\
+		}							\
+	}								\
+} while (false)
+
+#define RB_TREE_CUSTOM_COMPARE(a, b) \
+	tree->key_compare((a), (b), tree->key_compare_data)
+
+
+/* {{{1
+ * Find a node with the given key in ‘tree’, starting the search at ‘start’,
+ * which must be the root of a sub-tree that ‘key’ belongs in.  If the node
+ * does not exist in ‘tree’ already and ‘insert’ is true, insert it into
+ * ‘tree’ with the given key and value.  If the tree already contains the
+ * given ‘key’ and if ‘replace’ is true, replace the found nodes value with
+ * ‘value’.
  */
 static RBTreeNode *
-rb_tree_find(RBTree *tree,
-	     pointer key,
-	     pointer value,
-	     bool insert,
-	     bool replace)
+rb_tree_find_from(RBTree *tree,
+		  RBTreeNode *start,
+		  pointer key,
+		  pointer value,
+		  bool insert,
+		  bool replace)
 {
 	/* replace can only be true if insert is so as well */
 	invariant(!replace || insert);
 
 	RBTreeNode *iters_parent = rb_null;
-	RBTreeNode *iter = tree->root;
+	RBTreeNode *iter = start;
 
 	/* traverse down the tree */
 	bool found = false;
-	until (iter == rb_null || found) {
-		iters_parent = iter;
-
-		int cmp = tree->key_compare(key,
-					    iter->key,
-					    tree->key_compare_data);
-		if (cmp < 0) {
-			iter = iter->left;
-		} else if (cmp == 0) {
-			found = true;
-		} else { /* (cmp > 0) */
-			iter = iter->right;
-		}
-	}
+	int cmp = 0;
+	RB_TREE_STAT(int depth = 0);
+	switch (tree->key_type) {
+	case KEY_INT:
+		RB_TREE_DESCEND(RB_TREE_INT_COMPARE);
+		break;
+	case KEY_STRING:
+		RB_TREE_DESCEND(RB_TREE_STRING_COMPARE);
+		break;
+	default:
+		RB_TREE_DESCEND(RB_TREE_CUSTOM_COMPARE);
+		break;
+	}
+	RB_TREE_STAT(tree->stats.searches++);
+	RB_TREE_STAT(tree->stats.comparisons += depth);
+	RB_TREE_STAT(tree->stats.depths[MIN(depth,
+					    RB_TREE_STATS_DEPTHS - 1)]++);
 
 	/* if it's in the tree already, figure out what to do */
 	if (found && insert && replace) {
@@ -358,23 +989,18 @@ rb_tree_find(RBTree *tree,
 		 * this assumes that two keys that are equal will have the
 		 * same total ordering.
 		 */
-		unless (tree->key_release == null) {
-			tree->key_release(iter->key);
-		}
-		unless (tree->value_release == null) {
-			tree->value_release(iter->value);
-		}
+		rb_tree_pair_retire(tree, iter->key, iter->value,
+				    LIMBO_KEY | LIMBO_VALUE);
 		iter->key = key;
 		iter->value = value;
 
 		return iter;
 	} else if (found && insert) {
+		/* key was never in the tree, so it needn't be retired */
 		unless (tree->key_release == null) {
 			tree->key_release(key);
 		}
-		unless (tree->value_release == null) {
-			tree->value_release(iter->value);
-		}
+		rb_tree_pair_retire(tree, null, iter->value, LIMBO_VALUE);
 		iter->value = value;
 
 		return iter;
@@ -383,15 +1009,13 @@ rb_tree_find(RBTree *tree,
 	}
 
 	/* otherwise we create a new node */
-	RBTreeNode *new_node = rb_tree_node_new(key, value, iters_parent, RED);
+	RBTreeNode *new_node =
+		rb_tree_node_new(tree, key, value, iters_parent, RED);
 
-	/* and insert it appropriately */
+	/* and insert it appropriately, on the side we last went to */
 	if (iters_parent == rb_null) {
 		tree->root = new_node;
 	} else {
-		int cmp = tree->key_compare(new_node->key,
-					    iters_parent->key,
-					    tree->key_compare_data);
 		if (cmp < 0) {
 			iters_parent->left = new_node;
 		} else {
@@ -399,10 +1023,19 @@ rb_tree_find(RBTree *tree,
 		}
 	}
 
+	/* account for the new node in the tree and all sub-trees above it */
+	tree->size++;
+	for (iter = iters_parent; iter != rb_null; iter = iter->parent) {
+		iter->count++;
+		rb_tree_node_update_height(iter);
+	}
+
 	/* but since we inserted a red node, we must restore the balancing */
 	iter = new_node;
 
 	while (iter != tree->root && iter->parent->color == RED) {
+		RB_TREE_STAT(tree->stats.fixups++);
+
 		/* if parent is a lefty */
 		if (iter->parent == iter->parent->parent->left) {
 			/* get our parents sibling */
@@ -468,6 +1101,199 @@ rb_tree_find(RBTree *tree,
 }
 
 
+/* {{{1
+ * Find a node with the given key in ‘tree’, possibly inserting or replacing
+ * it.  See |rb_tree_find_from|.
+ */
+static inline RBTreeNode *
+rb_tree_find(RBTree *tree,
+	     pointer key,
+	     pointer value,
+	     bool insert,
+	     bool replace)
+{
+	return rb_tree_find_from(tree, tree->root, key, value, insert, replace);
+}
+
+
+/* {{{1
+ * Batch Operations: Keys in a batch are looked up in sorted order, each one
+ * starting from where the previous one was found (its ‘finger’), so that
+ * neighboring keys share the upper part of their search paths instead of
+ * each descending all the way from the root.
+ */
+
+
+/* {{{2
+ * Merge the sorted runs ‘from’[‘lo’..‘mid’) and ‘from’[‘mid’..‘hi’) of
+ * indices into ‘keys’ into ‘to’[‘lo’..‘hi’).
+ */
+static void
+rb_tree_batch_merge(RBTree *tree,
+		    constpointer *keys,
+		    size_t *from,
+		    size_t *to,
+		    size_t lo,
+		    size_t mid,
+		    size_t hi)
+{
+	size_t i = lo, j = mid, k = lo;
+
+	/* skip the merge if the runs are in order already */
+	if (mid < hi && tree->key_compare(keys[from[mid - 1]],
+					  keys[from[mid]],
+					  tree->key_compare_data) > 0) {
+		while (i < mid && j < hi) {
+			int cmp = tree->key_compare(keys[from[j]],
+						    keys[from[i]],
+						    tree->key_compare_data);
+			to[k++] = (cmp < 0) ? from[j++] : from[i++];
+		}
+	}
+
+	while (i < mid) {
+		to[k++] = from[i++];
+	}
+	while (j < hi) {
+		to[k++] = from[j++];
+	}
+}
+
+
+/* {{{2
+ * Sort the ‘n’ ‘keys’ of a batch according to the ordering of ‘tree’.  The
+ * sorting isn't done in place; instead we sort indices into ‘keys’.  ‘order’
+ * must have room for 2 * ‘n’ indices, and the return value points to the
+ * sorted ones within it.  The sort is a stable merge-sort, so that equal keys
+ * keep their relative order, and it runs in linear time on sorted input.
+ */
+static size_t *
+rb_tree_batch_sort(RBTree *tree, constpointer *keys, size_t *order, size_t n)
+{
+	size_t *from = order;
+	size_t *to = order + n;
+
+	for (size_t i = 0; i < n; i++) {
+		from[i] = i;
+	}
+
+	for (size_t width = 1; width < n; width *= 2) {
+		for (size_t lo = 0; lo < n; lo += 2 * width) {
+			rb_tree_batch_merge(tree, keys, from, to, lo,
+					    MIN(lo + width, n),
+					    MIN(lo + 2 * width, n));
+		}
+
+		size_t *tmp = from;
+		from = to;
+		to = tmp;
+	}
+
+	return from;
+}
+
+
+/* {{{2
+ * Find the root of the smallest sub-tree containing both ‘finger’ and where
+ * ‘key’ belongs, given that ‘key’ isn't less than the key of ‘finger’.  We do
+ * this by climbing towards the root, only comparing ‘key’ to the ancestors
+ * whose left sub-trees we come out of, as those are the upper bounds of the
+ * sub-trees we pass.
+ */
+static RBTreeNode *
+rb_tree_finger_start(RBTree *tree, RBTreeNode *finger, constpointer key)
+{
+	RBTreeNode *iter = finger;
+
+	while (true) {
+		while (iter->parent != rb_null && iter == iter->parent->right) {
+			iter = iter->parent;
+		}
+		if (iter->parent == rb_null) {
+			return iter;
+		}
+
+		int cmp = tree->key_compare(key,
+					    iter->parent->key,
+					    tree->key_compare_data);
+		if (cmp < 0) {
+			return iter;
+		} else if (cmp == 0) {
+			return iter->parent;
+		}
+		iter = iter->parent;
+	}
+}
+
+
+/* {{{2
+ * Look up the ‘n’ keys in ‘keys’ in ‘tree’, storing the value associated with
+ * each in the corresponding slot in ‘values’, or ‹null› if it's not in the
+ * tree.  ‘keys’ need not be sorted, but sorted batches are faster.
+ */
+void
+rb_tree_lookup_batch(RBTree *tree,
+		     constpointer *keys,
+		     pointer *values,
+		     size_t n)
+{
+	invariant(tree != null);
+	invariant(n == 0 || (keys != null && values != null));
+
+	size_t *order = new_array(size_t, 2 * n);
+	size_t *sorted = rb_tree_batch_sort(tree, keys, order, n);
+
+	RBTreeNode *finger = rb_null;
+	for (size_t i = 0; i < n; i++) {
+		constpointer key = keys[sorted[i]];
+		RBTreeNode *start = (finger != rb_null) ?
+			rb_tree_finger_start(tree, finger, key) : tree->root;
+		RBTreeNode *node = rb_tree_find_from(tree, start, (pointer)key,
+						     null, false, false);
+
+		if (node != rb_null) {
+			values[sorted[i]] = node->value;
+			finger = node;
+		} else {
+			values[sorted[i]] = null;
+		}
+	}
+
+	release(order);
+}
+
+
+/* {{{2
+ * Insert the ‘n’ key/value pairs in ‘keys’ and ‘values’ into ‘tree’, with the
+ * same effect as calling |rb_tree_insert| for each of them in order.  ‘keys’
+ * need not be sorted, but sorted batches are faster.
+ */
+void
+rb_tree_insert_batch(RBTree *tree, pointer *keys, pointer *values, size_t n)
+{
+	invariant(tree != null);
+	invariant(n == 0 || (keys != null && values != null));
+
+	size_t *order = new_array(size_t, 2 * n);
+	size_t *sorted = rb_tree_batch_sort(tree, (constpointer *)keys,
+					    order, n);
+
+	rb_tree_write_begin(tree);
+	RBTreeNode *finger = rb_null;
+	for (size_t i = 0; i < n; i++) {
+		pointer key = keys[sorted[i]];
+		RBTreeNode *start = (finger != rb_null) ?
+			rb_tree_finger_start(tree, finger, key) : tree->root;
+
+		finger = rb_tree_find_from(tree, start, key, values[sorted[i]],
+					   true, false);
+	}
+	rb_tree_write_end(tree);
+
+	release(order);
+}
+
+
 /* {{{1
  * Insert a key/value pair into ‘tree’.  If the given key already exists it's
  * associated value is updated.  The previous value will be freed if
@@ -479,7 +1305,9 @@ rb_tree_insert(RBTree *tree, pointer key, pointer value)
 {
 	invariant(tree != null);
 
+	rb_tree_write_begin(tree);
 	rb_tree_find(tree, key, value, true, false);
+	rb_tree_write_end(tree);
 }
 
 
@@ -492,74 +1320,162 @@ rb_tree_replace(RBTree *tree, pointer key, pointer value)
 {
 	invariant(tree != null);
 
+	rb_tree_write_begin(tree);
 	rb_tree_find(tree, key, value, true, true);
+	rb_tree_write_end(tree);
 }
 
 
 /* {{{1
- * Count the number of nodes under ‘node’.
+ * Return the number of nodes in ‘tree’.
  */
-static int
-rb_tree_node_count(RBTreeNode *node)
+int
+rb_tree_size(RBTree *tree)
 {
-	int count;
-
-	count = 1;
-	unless (node->left == rb_null) {
-		count += rb_tree_node_count(node->left);
-	}
-	unless (node->right == rb_null) {
-		count += rb_tree_node_count(node->right);
-	}
+	invariant(tree != null);
 
-	return count;
+	return tree->size;
 }
 
 
 /* {{{1
- * Return the number of nodes in ‘tree’.
+ * Return the rank of ‘key’ in ‘tree’, that is, the number of keys in ‘tree’
+ * that are less than ‘key’.  If ‘key’ is in the tree, this is its zero-based
+ * position in the in-order traversal of ‘tree’.
  */
 int
-rb_tree_size(RBTree *tree)
+rb_tree_rank(RBTree *tree, constpointer key)
 {
 	invariant(tree != null);
 
-	return (tree->root != rb_null) ? rb_tree_node_count(tree->root) : 0;
+	int rank = 0;
+	RBTreeNode *iter = tree->root;
+
+	until (iter == rb_null) {
+		int cmp = tree->key_compare(key,
+					    iter->key,
+					    tree->key_compare_data);
+		if (cmp < 0) {
+			iter = iter->left;
+		} else if (cmp == 0) {
+			return rank + iter->left->count;
+		} else { /* (cmp > 0) */
+			rank += iter->left->count + 1;
+			iter = iter->right;
+		}
+	}
+
+	return rank;
 }
 
 
 /* {{{1
- * Calculate the height of the given node (i.e. the number of levels below it).
+ * Find the node with rank ‘i’ in ‘tree’, i.e. the ‘i’th smallest key.  The
+ * return value tells whether ‘i’ was in range, and ‘key’ and ‘value’ will
+ * contain the key and value of the node if so.  Either may be ‹null›.
  */
-static int
-rb_tree_node_height(RBTreeNode *node)
+bool
+rb_tree_select(RBTree *tree, int i, pointer *key, pointer *value)
 {
-	int left_height;
-	int right_height;
+	invariant(tree != null);
 
-	if (node != rb_null) {
-		left_height = (node->left != rb_null) ?
-			rb_tree_node_height(node->left) : 0;
-		right_height = (node->right != rb_null) ?
-			rb_tree_node_height(node->right) : 0;
+	if (i < 0 || i >= tree->size) {
+		return false;
+	}
 
-		return MAX(left_height, right_height) + 1;
-	} else {
-		return 0;
+	RBTreeNode *iter = tree->root;
+
+	while (true) {
+		if (i < iter->left->count) {
+			iter = iter->left;
+		} else if (i == iter->left->count) {
+			break;
+		} else {
+			i -= iter->left->count + 1;
+			iter = iter->right;
+		}
+	}
+
+	unless (key == null) {
+		*key = iter->key;
 	}
+	unless (value == null) {
+		*value = iter->value;
+	}
+
+	return true;
 }
 
 
 /* {{{1
  * Return the height of the tree (i.e. the number of levels from the root node
- * to the most distant leaf).
+ * to the most distant leaf).  This is kept up to date by all modifications of
+ * the tree, so it takes O(1) time.
  */
 int
 rb_tree_height(RBTree *tree)
 {
 	invariant(tree != null);
 
-	return (tree->root != rb_null) ?  rb_tree_node_height(tree->root) : 0;
+	return tree->root->height;
+}
+
+
+/* {{{1
+ * Look up ‘key’ in the concurrent ‘tree’.  We may see the tree while it's
+ * being modified, so we can't trust its structure, and give up on a search
+ * that goes on for longer than the height of any valid tree.  We copy out the
+ * key and value found before checking that the tree wasn't modified, so that
+ * we know they're consistent.
+ */
+static bool
+rb_tree_lookup_concurrent(RBTree *tree,
+			  constpointer key,
+			  pointer *orig_key,
+			  pointer *value)
+{
+	while (true) {
+		unsigned int seq = __atomic_load_n(&tree->seq,
+						   __ATOMIC_ACQUIRE);
+		if (seq & 1) {
+			continue;
+		}
+
+		RBTreeNode *iter = rb_tree_read(tree->root);
+		pointer found_key = null;
+		pointer found_value = null;
+		bool found = false;
+		int steps = 0;
+
+		until (iter == rb_null || found ||
+		       steps++ > RB_TREE_MAX_HEIGHT) {
+			pointer iter_key = rb_tree_read(iter->key);
+			int cmp = tree->key_compare(key,
+						    iter_key,
+						    tree->key_compare_data);
+			if (cmp < 0) {
+				iter = rb_tree_read(iter->left);
+			} else if (cmp == 0) {
+				found_key = iter_key;
+				found_value = rb_tree_read(iter->value);
+				found = true;
+			} else { /* (cmp > 0) */
+				iter = rb_tree_read(iter->right);
+			}
+		}
+
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+		if (__atomic_load_n(&tree->seq, __ATOMIC_RELAXED) == seq &&
+		    steps <= RB_TREE_MAX_HEIGHT) {
+			unless (orig_key == null) {
+				*orig_key = found_key;
+			}
+			unless (value == null) {
+				*value = found_value;
+			}
+			return found;
+		}
+	}
 }
 
 
@@ -572,6 +1488,12 @@ rb_tree_lookup(RBTree *tree, constpointer key)
 {
 	invariant(tree != null);
 
+	if (tree->concurrent) {
+		pointer value;
+		return rb_tree_lookup_concurrent(tree, key, null, &value) ?
+			value : null;
+	}
+
 	RBTreeNode *node =
 		rb_tree_find(tree, (pointer)key, null, false, false);
 	return (node != rb_null) ? node->value : null;
@@ -591,13 +1513,17 @@ rb_tree_lookup_extended(RBTree *tree,
 {
 	invariant(tree != null);
 
+	if (tree->concurrent) {
+		return rb_tree_lookup_concurrent(tree, key, orig_key, value);
+	}
+
 	RBTreeNode *node =
 		rb_tree_find(tree, (pointer)key, null, false, false);
 	if (node != rb_null) {
 		unless (orig_key == null) {
 			*orig_key = node->key;
 		}
-		unless (orig_key == null) {
+		unless (value == null) {
 			*value = node->value;
 		}
 		return true;
@@ -608,29 +1534,68 @@ rb_tree_lookup_extended(RBTree *tree,
 
 
 /* {{{1
- * Call ‘func’ for ‘node’ and each node below it, passing the key and value of
- * ‘node’ plus the user supplied ‘data’ if applicable.  The traversal order is
- * in-order, visiting the left sub-tree (less than), the node itself, and
- * finally the right sub-tree (greater than).
+ * Find the smallest node greater than ‘node’ in the right sub-tree of ‘node’.
  */
-static bool
-rb_tree_node_map(RBTreeNode *node, MappingMapFunc lambda, pointer closure)
+static RBTreeNode *
+rb_tree_node_successor(RBTreeNode *node)
 {
-	unless (node->left == rb_null) {
-		unless (rb_tree_node_map(node->left, lambda, closure)) {
-			return false;
+	RBTreeNode *iter;
+
+	if (node->right != rb_null) {
+		/*
+		 * if we have a right child, go there and then find its
+		 * leftmost child.
+		 */
+		iter = node->right;
+		until (iter->left == rb_null) {
+			iter = iter->left;
+		}
+	} else {
+		/*
+		 * go upwards until we find a lefty (or root) and return its
+		 * parent.
+		 */
+		iter = node->parent;
+		until (iter == rb_null || node != iter->right) {
+			node = iter;
+			iter = iter->parent;
 		}
 	}
-	unless (lambda(node->key, node->value, closure)) {
-		return false;
-	}
-	unless (node->right == rb_null) {
-		unless (rb_tree_node_map(node->right, lambda, closure)) {
-			return false;
+
+	return iter;
+}
+
+
+/* {{{1
+ * Find the largest node less than ‘node’.  See |rb_tree_node_successor|.
+ */
+static RBTreeNode *
+rb_tree_node_predecessor(RBTreeNode *node)
+{
+	RBTreeNode *iter;
+
+	if (node->left != rb_null) {
+		/*
+		 * if we have a left child, go there and then find its
+		 * rightmost child.
+		 */
+		iter = node->left;
+		until (iter->right == rb_null) {
+			iter = iter->right;
+		}
+	} else {
+		/*
+		 * go upwards until we find a righty (or root) and return its
+		 * parent.
+		 */
+		iter = node->parent;
+		until (iter == rb_null || node != iter->left) {
+			node = iter;
+			iter = iter->parent;
 		}
 	}
 
-	return true;
+	return iter;
 }
 
 
@@ -638,7 +1603,9 @@ rb_tree_node_map(RBTreeNode *node, MappingMapFunc lambda, pointer closure)
  * Call ‘func’ for each node in ‘tree’, passing the key and value of the node
  * plus the user supplied data if applicable.  The traversal order is in-order,
  * visiting the left sub-tree (less than), the node itself, and finally the
- * right sub-tree (greater than).
+ * right sub-tree (greater than).  We walk from each node to its successor
+ * instead of recursing, which takes O(n) time in total, as each edge is
+ * followed twice, and no stack.
  */
 void
 rb_tree_map(RBTree *tree, MappingMapFunc func, pointer closure)
@@ -646,113 +1613,284 @@ rb_tree_map(RBTree *tree, MappingMapFunc func, pointer closure)
 	invariant(tree != null);
 	invariant(func != null);
 
-	unless (tree->root == rb_null) {
-		rb_tree_node_map(tree->root, func, closure);
+	RBTreeNode *iter = tree->root;
+
+	unless (iter == rb_null) {
+		until (iter->left == rb_null) {
+			iter = iter->left;
+		}
+	}
+
+	for ( ; iter != rb_null; iter = rb_tree_node_successor(iter)) {
+		unless (func(iter->key, iter->value, closure)) {
+			break;
+		}
 	}
 }
 
 
 /* {{{1
- * Find the smallest node greater than ‘node’ in the right sub-tree of ‘node’.
+ * Cursors: A cursor points at a node in a tree and can be moved to the next
+ * or previous node in the ordering of the tree.  Functions returning cursors
+ * return ‹null› when there's no node to point at, e.g. when moving past the
+ * last node.  A cursor stays valid until the tree is modified, so don't
+ * insert or remove anything while traversing a tree with a cursor.  As
+ * cursors are nothing but pointers to nodes, they need not be released.
  */
-static RBTreeNode *
-rb_tree_node_successor(RBTreeNode *node)
+
+
+/* {{{2
+ * Turn ‘node’ into a cursor, mapping our ‘null node’ to ‹null›.
+ */
+static inline RBTreeCursor *
+rb_tree_cursor(RBTreeNode *node)
 {
-	RBTreeNode *iter;
+	return (node != rb_null) ? node : null;
+}
 
-	if (node->right != rb_null) {
-		/*
-		 * if we have a right child, go there and then find its
-		 * leftmost child.
-		 */
-		iter = node->right;
+
+/* {{{2
+ * Return a cursor pointing at the node with the smallest key in ‘tree’.
+ */
+RBTreeCursor *
+rb_tree_first(RBTree *tree)
+{
+	invariant(tree != null);
+
+	RBTreeNode *iter = tree->root;
+
+	unless (iter == rb_null) {
 		until (iter->left == rb_null) {
 			iter = iter->left;
 		}
-	} else {
-		/*
-		 * go upwards until we find a lefty (or root) and return its
-		 * parent.
-		 */
-		iter = node->parent;
-		until (iter == rb_null || node != iter->right) {
-			node = iter;
-			iter = iter->parent;
+	}
+
+	return rb_tree_cursor(iter);
+}
+
+
+/* {{{2
+ * Return a cursor pointing at the node with the largest key in ‘tree’.
+ */
+RBTreeCursor *
+rb_tree_last(RBTree *tree)
+{
+	invariant(tree != null);
+
+	RBTreeNode *iter = tree->root;
+
+	unless (iter == rb_null) {
+		until (iter->right == rb_null) {
+			iter = iter->right;
 		}
 	}
 
-	return iter;
+	return rb_tree_cursor(iter);
+}
+
+
+/* {{{2
+ * Find the node with the smallest key in ‘tree’ that is greater than ‘key’,
+ * or greater than or equal to ‘key’ if ‘inclusive’ is true.
+ */
+static RBTreeNode *
+rb_tree_find_bound(RBTree *tree, constpointer key, bool inclusive)
+{
+	RBTreeNode *bound = rb_null;
+	RBTreeNode *iter = tree->root;
+
+	until (iter == rb_null) {
+		int cmp = tree->key_compare(key,
+					    iter->key,
+					    tree->key_compare_data);
+		if (cmp < 0 || (cmp == 0 && inclusive)) {
+			bound = iter;
+			iter = iter->left;
+		} else {
+			iter = iter->right;
+		}
+	}
+
+	return bound;
+}
+
+
+/* {{{2
+ * Return a cursor pointing at the first node in ‘tree’ whose key is not less
+ * than ‘key’.
+ */
+RBTreeCursor *
+rb_tree_lower_bound(RBTree *tree, constpointer key)
+{
+	invariant(tree != null);
+
+	return rb_tree_cursor(rb_tree_find_bound(tree, key, true));
+}
+
+
+/* {{{2
+ * Return a cursor pointing at the first node in ‘tree’ whose key is greater
+ * than ‘key’.
+ */
+RBTreeCursor *
+rb_tree_upper_bound(RBTree *tree, constpointer key)
+{
+	invariant(tree != null);
+
+	return rb_tree_cursor(rb_tree_find_bound(tree, key, false));
+}
+
+
+/* {{{2
+ * Move ‘cursor’ to the node following it.
+ */
+RBTreeCursor *
+rb_tree_cursor_next(RBTreeCursor *cursor)
+{
+	invariant(cursor != null);
+
+	return rb_tree_cursor(rb_tree_node_successor(cursor));
+}
+
+
+/* {{{2
+ * Move ‘cursor’ to the node preceding it.
+ */
+RBTreeCursor *
+rb_tree_cursor_prev(RBTreeCursor *cursor)
+{
+	invariant(cursor != null);
+
+	return rb_tree_cursor(rb_tree_node_predecessor(cursor));
+}
+
+
+/* {{{2
+ * Return the key of the node ‘cursor’ is pointing at.
+ */
+pointer
+rb_tree_cursor_key(RBTreeCursor *cursor)
+{
+	invariant(cursor != null);
+
+	return cursor->key;
+}
+
+
+/* {{{2
+ * Return the value of the node ‘cursor’ is pointing at.
+ */
+pointer
+rb_tree_cursor_value(RBTreeCursor *cursor)
+{
+	invariant(cursor != null);
+
+	return cursor->value;
 }
 
 
 /* {{{1
- * Restore the red-black tree properties of ‘tree’ starting at node ‘x’.
+ * Call ‘func’ for each node in ‘tree’ with a key in the range [‘lo’, ‘hi’),
+ * in order, just like |rb_tree_map| does.  This takes O(log n + k) time,
+ * where k is the number of nodes visited, and doesn't use recursion.
+ */
+void
+rb_tree_map_range(RBTree *tree,
+		  constpointer lo,
+		  constpointer hi,
+		  MappingMapFunc func,
+		  pointer closure)
+{
+	invariant(tree != null);
+	invariant(func != null);
+
+	for (RBTreeNode *iter = rb_tree_find_bound(tree, lo, true);
+	     iter != rb_null &&
+	     tree->key_compare(iter->key, hi, tree->key_compare_data) < 0;
+	     iter = rb_tree_node_successor(iter)) {
+		unless (func(iter->key, iter->value, closure)) {
+			break;
+		}
+	}
+}
+
+
+/* {{{1
+ * Restore the red-black tree properties of ‘tree’ starting at node ‘x’, whose
+ * parent is ‘parent’.  ‘x’ may be |rb_null|, which is shared by all trees, so
+ * we never write to it, and keep track of its parent ourselves instead.
  */
 static void
-rb_tree_node_remove_restore(RBTree *tree, RBTreeNode *x)
+rb_tree_node_remove_restore(RBTree *tree, RBTreeNode *x, RBTreeNode *parent)
 {
 	RBTreeNode *w;
 
 	while (x != tree->root && x->color == BLACK) {
+		RB_TREE_STAT(tree->stats.fixups++);
+
 		/* if x is a lefty */
-		if (x == x->parent->left) {
-			w = x->parent->right;
+		if (x == parent->left) {
+			w = parent->right;
 			if (w->color == RED) {
 				w->color = BLACK;
-				x->parent->color = RED;
-				rb_tree_rotate_left(tree, x->parent);
-				w = x->parent->right;
+				parent->color = RED;
+				rb_tree_rotate_left(tree, parent);
+				w = parent->right;
 			}
 
 			if (w->left->color == BLACK &&
 			    w->right->color == BLACK) {
 				w->color = RED;
-				x = x->parent;
+				x = parent;
+				parent = x->parent;
 			} else {
 				if (w->right->color == BLACK) {
 					w->left->color = BLACK;
 					w->color = RED;
 					rb_tree_rotate_right(tree, w);
-					w = x->parent->right;
+					w = parent->right;
 				}
 
-				w->color = x->parent->color;
-				x->parent->color = BLACK;
+				w->color = parent->color;
+				parent->color = BLACK;
 				w->right->color = BLACK;
-				rb_tree_rotate_left(tree, x->parent);
+				rb_tree_rotate_left(tree, parent);
 				x = tree->root;
 			}
 		} else {
-			w = x->parent->left;
+			w = parent->left;
 			if (w->color == RED) {
 				w->color = BLACK;
-				x->parent->color = RED;
-				rb_tree_rotate_right(tree, x->parent);
-				w = x->parent->left;
+				parent->color = RED;
+				rb_tree_rotate_right(tree, parent);
+				w = parent->left;
 			}
 
 			if (w->right->color == BLACK &&
 			    w->left->color == BLACK) {
 				w->color = RED;
-				x = x->parent;
+				x = parent;
+				parent = x->parent;
 			} else {
 				if (w->left->color == BLACK) {
 					w->right->color = BLACK;
 					w->color = RED;
 					rb_tree_rotate_left(tree, w);
-					w = x->parent->left;
+					w = parent->left;
 				}
 
-				w->color = x->parent->color;
-				x->parent->color = BLACK;
+				w->color = parent->color;
+				parent->color = BLACK;
 				w->left->color = BLACK;
-				rb_tree_rotate_right(tree, x->parent);
+				rb_tree_rotate_right(tree, parent);
 				x = tree->root;
 			}
 		}
 	}
 
-	x->color = BLACK;
+	unless (x == rb_null) {
+		x->color = BLACK;
+	}
 }
 
 
@@ -771,7 +1909,9 @@ rb_tree_node_remove(RBTree *tree, RBTreeNode *z, bool notify)
 	}
 
 	x = (y->left != rb_null) ? y->left : y->right;
-	x->parent = y->parent;
+	unless (x == rb_null) {
+		x->parent = y->parent;
+	}
 
 	if (y->parent == rb_null) {
 		tree->root = x;
@@ -783,27 +1923,33 @@ rb_tree_node_remove(RBTree *tree, RBTreeNode *z, bool notify)
 		}
 	}
 
+	/*
+	 * if we spliced out z's successor, move its contents into z, and give
+	 * y the contents of z, so that they are released below.
+	 */
 	unless (y == z) {
+		pointer key = z->key;
+		pointer value = z->value;
+
 		z->key = y->key;
+		z->value = y->value;
+		y->key = key;
+		y->value = value;
 	}
 
-	if (y->color == BLACK) {
-		rb_tree_node_remove_restore(tree, x);
+	/* y is gone from all the sub-trees above it */
+	tree->size--;
+	for (RBTreeNode *iter = y->parent; iter != rb_null;
+	     iter = iter->parent) {
+		iter->count--;
+		rb_tree_node_update_height(iter);
 	}
 
-	if (notify) {
-		if (tree->key_release) {
-			tree->key_release(y->key);
-		}
-		if (tree->value_release) {
-			tree->value_release(y->value);
-		}
+	if (y->color == BLACK) {
+		rb_tree_node_remove_restore(tree, x, y->parent);
 	}
 
-	G_LOCK(node_free_list);
-	y->left = node_free_list;
-	node_free_list = y;
-	G_UNLOCK(node_free_list);
+	rb_tree_node_retire(tree, y, notify ? LIMBO_KEY | LIMBO_VALUE : 0);
 }
 
 
@@ -819,7 +1965,9 @@ rb_tree_remove(RBTree *tree, constpointer key)
 	RBTreeNode *node =
 		rb_tree_find(tree, (pointer)key, null, false, false);
 	unless (node == rb_null) {
+		rb_tree_write_begin(tree);
 		rb_tree_node_remove(tree, node, true);
+		rb_tree_write_end(tree);
 	}
 }
 
@@ -836,11 +1984,60 @@ rb_tree_steal(RBTree *tree, constpointer key)
 	RBTreeNode *node =
 		rb_tree_find(tree, (pointer)key, null, false, false);
 	unless (node == rb_null) {
+		rb_tree_write_begin(tree);
 		rb_tree_node_remove(tree, node, false);
+		rb_tree_write_end(tree);
 	}
 }
 
 
+
+/* {{{1
+ * Get the statistics of ‘tree’ into ‘stats’, returning true, if the library
+ * was compiled with RB_TREE_STATS defined.  Otherwise, ‘stats’ is cleared, and
+ * false is returned.  The statistics cover the time since the tree was created
+ * or last given to |rb_tree_reset_stats|:
+ *
+ * ‘searches’ is the number of descents made to find, insert, or remove a key,
+ * and ‘comparisons’ the number of keys compared in them.  ‘depths’[d] is the
+ * number of searches that compared d keys, the last bucket counting all the
+ * deeper ones as well.  ‘rotations’ counts the rotations and ‘fixups’ the
+ * steps up the tree made to restore its balance after insertions and
+ * removals.  ‘free_list_hits’ is the number of nodes reused from a free-list,
+ * and ‘free_list_misses’ the ones that had to be allocated.
+ *
+ * The counters aren't updated atomically, so they may miss some searches made
+ * while other threads are searching the same tree.  The searches of concurrent
+ * readers of trees created with |rb_tree_new_concurrent| aren't counted.
+ */
+bool
+rb_tree_get_stats(RBTree *tree, RBTreeStats *stats)
+{
+	invariant(tree != null);
+	invariant(stats != null);
+
+#ifdef RB_TREE_STATS
+	*stats = tree->stats;
+	return true;
+#else
+	memset(stats, 0, sizeof(*stats));
+	return false;
+#endif
+}
+
+
+/* {{{1
+ * Reset the statistics of ‘tree’, see |rb_tree_get_stats|.
+ */
+void
+rb_tree_reset_stats(RBTree *tree)
+{
+	invariant(tree != null);
+
+	RB_TREE_STAT(memset(&tree->stats, 0, sizeof(tree->stats)));
+}
+
+
 /* }}}1 */
 
 
@@ -26,6 +26,22 @@
 
 
 typedef struct _RBTree RBTree;
+typedef struct _RBTreeNode RBTreeCursor;
+
+
+#define RB_TREE_STATS_DEPTHS	64
+
+typedef struct _RBTreeStats RBTreeStats;
+
+struct _RBTreeStats {
+	unsigned long searches;
+	unsigned long comparisons;
+	unsigned long rotations;
+	unsigned long fixups;
+	unsigned long free_list_hits;
+	unsigned long free_list_misses;
+	unsigned long depths[RB_TREE_STATS_DEPTHS];
+};
 
 
 RBTree *rb_tree_new(CompareFunc key_compare);
@@ -35,21 +51,67 @@ RBTree *rb_tree_new_full(CompareDataFunc key_compare,
 			 pointer key_compare_data,
 			 ReleaseNotify key_release,
 			 ReleaseNotify value_release);
+RBTree *rb_tree_new_int(ReleaseNotify value_release);
+RBTree *rb_tree_new_str(ReleaseNotify key_release, ReleaseNotify value_release);
+RBTree *rb_tree_new_slab(CompareDataFunc key_compare,
+			 pointer key_compare_data,
+			 ReleaseNotify key_release,
+			 ReleaseNotify value_release,
+			 size_t slab_size);
+RBTree *rb_tree_new_concurrent(CompareDataFunc key_compare,
+			       pointer key_compare_data,
+			       ReleaseNotify key_release,
+			       ReleaseNotify value_release);
+RBTree *rb_tree_new_from_sorted(pointer *keys,
+				pointer *values,
+				size_t n,
+				CompareDataFunc key_compare,
+				pointer key_compare_data,
+				ReleaseNotify key_release,
+				ReleaseNotify value_release);
 void rb_tree_release(RBTree *tree);
+void rb_tree_reclaim(RBTree *tree);
 
 void rb_tree_insert(RBTree *tree, pointer key, pointer value);
 void rb_tree_replace(RBTree *tree, pointer key, pointer value);
+void rb_tree_insert_batch(RBTree *tree,
+			  pointer *keys,
+			  pointer *values,
+			  size_t n);
 int rb_tree_size(RBTree *tree);
 int rb_tree_height(RBTree *tree);
+int rb_tree_rank(RBTree *tree, constpointer key);
+bool rb_tree_select(RBTree *tree, int i, pointer *key, pointer *value);
 pointer rb_tree_lookup(RBTree *tree, constpointer key);
 bool rb_tree_lookup_extended(RBTree *tree,
 			     constpointer key,
 			     pointer *orig_key,
 			     pointer *value);
+void rb_tree_lookup_batch(RBTree *tree,
+			  constpointer *keys,
+			  pointer *values,
+			  size_t n);
 void rb_tree_map(RBTree *tree, MappingMapFunc lambda, pointer closure);
+void rb_tree_map_range(RBTree *tree,
+		       constpointer lo,
+		       constpointer hi,
+		       MappingMapFunc func,
+		       pointer closure);
 void rb_tree_remove(RBTree *tree, constpointer key);
 void rb_tree_steal(RBTree *tree, constpointer key);
 
+bool rb_tree_get_stats(RBTree *tree, RBTreeStats *stats);
+void rb_tree_reset_stats(RBTree *tree);
+
+RBTreeCursor *rb_tree_first(RBTree *tree);
+RBTreeCursor *rb_tree_last(RBTree *tree);
+RBTreeCursor *rb_tree_lower_bound(RBTree *tree, constpointer key);
+RBTreeCursor *rb_tree_upper_bound(RBTree *tree, constpointer key);
+RBTreeCursor *rb_tree_cursor_next(RBTreeCursor *cursor);
+RBTreeCursor *rb_tree_cursor_prev(RBTreeCursor *cursor);
+pointer rb_tree_cursor_key(RBTreeCursor *cursor);
+pointer rb_tree_cursor_value(RBTreeCursor *cursor);
+
 
 #endif /* REDBLACK_H */
 
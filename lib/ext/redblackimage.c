@@ -0,0 +1,534 @@
+/*
+ * contents: Saving red-black trees to and loading them from image files.
+ * arch-tag: 7970a39e-ae8f-475f-b3b5-cdbbeee145d6
+ *
+ * Copyright (C) 2004 Nikolai Weibull <source@pcppopper.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <clear/internal.h>
+#include <clear/mem.h>
+#include "redblack.h"
+#include "redblackimage.h"
+
+
+/* {{{1
+ * Image Format: An image of a tree is a header followed by the keys of the
+ * tree, in sorted order, and then by its values, in the same order.  Each key
+ * and value is stored in a record of a fixed width, so that the i'th pair can
+ * be found without reading the ones before it, and the sorted keys form an
+ * implicit perfectly balanced search tree, rooted at the middle one, just like
+ * the one |rb_tree_new_from_sorted| builds.  We can thus search an image in
+ * place, with the file mapped into memory, or turn it into an RBTree in O(n)
+ * time.
+ *
+ * Keys and values whose width is given as zero are taken to be the pointers
+ * themselves, as with the integer keys of |rb_tree_new_int|, and are stored
+ * as 64-bit unsigned integers.  Any others are taken to point to that many
+ * bytes, which are stored as they are.  The keys and the values each begin
+ * on an eight byte boundary in the file, so records that are a multiple of
+ * their alignment wide, up to eight, are properly aligned in an image mapped
+ * into memory.
+ *
+ * Everything is stored in the byte order of the machine that saved the image,
+ * which is recorded in the header, so that images can't be read on machines
+ * that disagree with it.
+ */
+#define RB_TREE_IMAGE_MAGIC		"RBTIMAGE"
+#define RB_TREE_IMAGE_BYTE_ORDER	0x01020304
+#define RB_TREE_IMAGE_ALIGNMENT		8
+
+#define RB_TREE_IMAGE_KEYS_ARE_POINTERS		(1 << 0)
+#define RB_TREE_IMAGE_VALUES_ARE_POINTERS	(1 << 1)
+
+
+/* {{{2
+ * The header of an image.  ‘count’ is the number of key-value pairs in it and
+ * ‘key_width’ and ‘value_width’ the widths of their records, in bytes.
+ * ‘flags’ tell which of them are pointers, see above.
+ */
+typedef struct _RBTreeImageHeader RBTreeImageHeader;
+
+struct _RBTreeImageHeader {
+	char magic[8];
+	uint32_t version;
+	uint32_t byte_order;
+	uint64_t count;
+	uint32_t key_width;
+	uint32_t value_width;
+	uint32_t flags;
+	uint32_t reserved;
+};
+
+
+/* {{{2
+ * An image that has been opened for reading.  ‘map’ is the whole file, mapped
+ * into memory, ‘map_size’ bytes of it, and ‘keys’ and ‘values’ point to the
+ * records within it.  ‘key_pointers’ and ‘value_pointers’ are true for
+ * records that are pointers, see above.
+ */
+struct _RBTreeImage {
+	pointer map;
+	size_t map_size;
+	size_t count;
+	const char *keys;
+	const char *values;
+	size_t key_width;
+	size_t value_width;
+	bool key_pointers;
+	bool value_pointers;
+};
+
+
+/* {{{1
+ * Round ‘n’ up to the alignment of the sections of an image.
+ */
+static inline uint64_t
+rb_tree_image_align(uint64_t n)
+{
+	return (n + RB_TREE_IMAGE_ALIGNMENT - 1) &
+		~(uint64_t)(RB_TREE_IMAGE_ALIGNMENT - 1);
+}
+
+
+/* {{{1
+ * The state of |rb_tree_save| while it writes the records of one section of an
+ * image to ‘file’.  ‘width’ is the width of each record, and ‘keys’ tells
+ * whether we're writing keys or values.  ‘ok’ turns false if writing fails.
+ */
+typedef struct _RBTreeImageWriter RBTreeImageWriter;
+
+struct _RBTreeImageWriter {
+	FILE *file;
+	size_t width;
+	bool keys;
+	bool ok;
+	uint64_t written;
+};
+
+
+/* {{{1
+ * Write the key or value of a pair to the image being written by ‘closure’.
+ */
+static bool
+rb_tree_image_write_record(pointer key, pointer value, pointer closure)
+{
+	RBTreeImageWriter *writer = closure;
+	pointer item = writer->keys ? key : value;
+
+	if (writer->width == 0) {
+		uint64_t record = (uintptr_t)item;
+		writer->ok = fwrite(&record, sizeof(record), 1,
+				    writer->file) == 1;
+		writer->written += sizeof(record);
+	} else {
+		writer->ok = fwrite(item, writer->width, 1, writer->file) == 1;
+		writer->written += writer->width;
+	}
+
+	return writer->ok;
+}
+
+
+/* {{{1
+ * Write the keys or values of ‘tree’, as told by ‘keys’, to ‘writer’, padding
+ * them to the alignment of the sections of an image.
+ */
+static bool
+rb_tree_image_write_section(RBTree *tree, RBTreeImageWriter *writer, bool keys)
+{
+	static const char padding[RB_TREE_IMAGE_ALIGNMENT];
+
+	writer->keys = keys;
+	writer->written = 0;
+	rb_tree_map(tree, rb_tree_image_write_record, writer);
+	if (writer->ok) {
+		size_t n = rb_tree_image_align(writer->written) -
+			writer->written;
+		writer->ok = n == 0 ||
+			fwrite(padding, n, 1, writer->file) == 1;
+	}
+
+	return writer->ok;
+}
+
+
+/* {{{1
+ * Save an image of ‘tree’ to the file at ‘path’.  ‘key_width’ and
+ * ‘value_width’ are the number of bytes each key and value points to, or zero
+ * if they should be saved as the pointers themselves, see above.  The image
+ * can be read with |rb_tree_image_open|.  It's first written to ‘path’ with
+ * “.tmp” appended, which is then renamed to ‘path’, so that an image already
+ * at ‘path’ is replaced all at once, and left as it was if saving fails.
+ * Images of it that are open stay valid, as they keep the old file.  Returns
+ * false, with errno set, if the image can't be written.
+ */
+bool
+rb_tree_save(RBTree *tree,
+	     const char *path,
+	     size_t key_width,
+	     size_t value_width)
+{
+	invariant(tree != null);
+	invariant(path != null);
+	invariant(key_width <= UINT32_MAX && value_width <= UINT32_MAX);
+
+	size_t length = strlen(path);
+	char *tmp_path = new_array(char, length + sizeof(".tmp"));
+	memcpy(tmp_path, path, length);
+	memcpy(tmp_path + length, ".tmp", sizeof(".tmp"));
+
+	FILE *file = fopen(tmp_path, "wb");
+	if (file == null) {
+		int saved_errno = errno;
+		release(tmp_path);
+		errno = saved_errno;
+		return false;
+	}
+
+	RBTreeImageHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, RB_TREE_IMAGE_MAGIC, sizeof(header.magic));
+	header.version = RB_TREE_IMAGE_VERSION;
+	header.byte_order = RB_TREE_IMAGE_BYTE_ORDER;
+	header.count = rb_tree_size(tree);
+	header.key_width = (key_width > 0) ? key_width : sizeof(uint64_t);
+	header.value_width = (value_width > 0) ? value_width :
+		sizeof(uint64_t);
+	if (key_width == 0) {
+		header.flags |= RB_TREE_IMAGE_KEYS_ARE_POINTERS;
+	}
+	if (value_width == 0) {
+		header.flags |= RB_TREE_IMAGE_VALUES_ARE_POINTERS;
+	}
+
+	RBTreeImageWriter writer = { file, key_width, true, true, 0 };
+	writer.ok = fwrite(&header, sizeof(header), 1, file) == 1;
+	if (writer.ok) {
+		rb_tree_image_write_section(tree, &writer, true);
+	}
+	if (writer.ok) {
+		writer.width = value_width;
+		rb_tree_image_write_section(tree, &writer, false);
+	}
+
+	int saved_errno = errno;
+	if (fclose(file) != 0 && writer.ok) {
+		writer.ok = false;
+		saved_errno = errno;
+	}
+	if (writer.ok && rename(tmp_path, path) != 0) {
+		writer.ok = false;
+		saved_errno = errno;
+	}
+	unless (writer.ok) {
+		unlink(tmp_path);
+	}
+	release(tmp_path);
+	errno = saved_errno;
+
+	return writer.ok;
+}
+
+
+/* {{{1
+ * Check that the ‘size’ bytes at ‘map’ are an image we can read, filling in
+ * ‘image’ from its header if so.
+ */
+static bool
+rb_tree_image_parse(RBTreeImage *image, const char *map, size_t size)
+{
+	const RBTreeImageHeader *header = (const RBTreeImageHeader *)map;
+
+	if (size < sizeof(*header) ||
+	    memcmp(header->magic, RB_TREE_IMAGE_MAGIC,
+		   sizeof(header->magic)) != 0 ||
+	    header->version != RB_TREE_IMAGE_VERSION ||
+	    header->byte_order != RB_TREE_IMAGE_BYTE_ORDER ||
+	    header->key_width == 0 || header->value_width == 0) {
+		return false;
+	}
+
+	/* make sure the records fit in the file, without overflowing */
+	uint64_t room = size - sizeof(*header);
+	uint64_t count = header->count;
+	if (count > room / header->key_width) {
+		return false;
+	}
+	uint64_t keys_size = rb_tree_image_align(count * header->key_width);
+	if (keys_size > room ||
+	    count > (room - keys_size) / header->value_width ||
+	    count > (uint64_t)INT_MAX) {
+		return false;
+	}
+
+	image->count = count;
+	image->keys = map + sizeof(*header);
+	image->values = image->keys + keys_size;
+	image->key_width = header->key_width;
+	image->value_width = header->value_width;
+	image->key_pointers =
+		(header->flags & RB_TREE_IMAGE_KEYS_ARE_POINTERS) != 0;
+	image->value_pointers =
+		(header->flags & RB_TREE_IMAGE_VALUES_ARE_POINTERS) != 0;
+
+	return !(image->key_pointers && image->key_width != sizeof(uint64_t)) &&
+		!(image->value_pointers &&
+		  image->value_width != sizeof(uint64_t));
+}
+
+
+/* {{{1
+ * Open the image at ‘path’, saved by |rb_tree_save|, for reading.  The file
+ * is mapped into memory, read-only, so opening it takes the same short time
+ * regardless of its size, and its pages are only read as lookups touch them.
+ * Returns ‹null›, with errno set, if the file can't be opened or mapped, and
+ * with errno set to EINVAL if it isn't an image we can read.
+ */
+RBTreeImage *
+rb_tree_image_open(const char *path)
+{
+	invariant(path != null);
+
+	int fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		return null;
+	}
+
+	struct stat st;
+	pointer map = MAP_FAILED;
+	if (fstat(fd, &st) == 0) {
+		if (S_ISREG(st.st_mode) &&
+		    (uintmax_t)st.st_size >= sizeof(RBTreeImageHeader) &&
+		    (uintmax_t)st.st_size <= SIZE_MAX) {
+			map = mmap(null, st.st_size, PROT_READ, MAP_PRIVATE,
+				   fd, 0);
+		} else {
+			errno = EINVAL;
+		}
+	}
+
+	int saved_errno = errno;
+	close(fd);
+	if (map == MAP_FAILED) {
+		errno = saved_errno;
+		return null;
+	}
+
+	RBTreeImage *image = new_struct(RBTreeImage);
+	image->map = map;
+	image->map_size = st.st_size;
+	unless (rb_tree_image_parse(image, map, st.st_size)) {
+		rb_tree_image_close(image);
+		errno = EINVAL;
+		return null;
+	}
+
+	return image;
+}
+
+
+/* {{{1
+ * Close ‘image’, unmapping it.  Any keys and values that were taken from it,
+ * including those of trees created from it with |rb_tree_load|, may no longer
+ * be used.
+ */
+void
+rb_tree_image_close(RBTreeImage *image)
+{
+	invariant(image != null);
+
+	munmap(image->map, image->map_size);
+	release(image);
+}
+
+
+/* {{{1
+ * Return the number of key-value pairs in ‘image’.
+ */
+size_t
+rb_tree_image_size(RBTreeImage *image)
+{
+	invariant(image != null);
+
+	return image->count;
+}
+
+
+/* {{{1
+ * Get the ‘i’'th key of ‘image’, either the pointer stored in it or one
+ * pointing to its record in the image.
+ */
+static inline pointer
+rb_tree_image_key(RBTreeImage *image, size_t i)
+{
+	const char *record = image->keys + i * image->key_width;
+
+	if (image->key_pointers) {
+		return (pointer)(uintptr_t)*(const uint64_t *)record;
+	}
+	return (pointer)record;
+}
+
+
+/* {{{1
+ * Get the ‘i’'th value of ‘image’, see |rb_tree_image_key|.
+ */
+static inline pointer
+rb_tree_image_value(RBTreeImage *image, size_t i)
+{
+	const char *record = image->values + i * image->value_width;
+
+	if (image->value_pointers) {
+		return (pointer)(uintptr_t)*(const uint64_t *)record;
+	}
+	return (pointer)record;
+}
+
+
+/* {{{1
+ * Look up ‘key’ in ‘image’, comparing keys with ‘key_compare’, which must
+ * order them the same way as that of the tree the image was saved from did.
+ * It's passed ‘key’ and keys of the image, which, unless they're pointers,
+ * point straight into the mapped image, so nothing is copied.  Works like
+ * |rb_tree_lookup_extended| otherwise, in that ‘orig_key’ and ‘value’, if
+ * non-‹null›, are set to the key and value found, if any.  This takes
+ * O(log n) time.
+ */
+bool
+rb_tree_image_lookup(RBTreeImage *image,
+		     constpointer key,
+		     CompareDataFunc key_compare,
+		     pointer key_compare_data,
+		     pointer *orig_key,
+		     pointer *value)
+{
+	invariant(image != null);
+	invariant(key_compare != null);
+
+	size_t lo = 0;
+	size_t hi = image->count;
+
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+		pointer mid_key = rb_tree_image_key(image, mid);
+
+		int cmp = key_compare(key, mid_key, key_compare_data);
+		if (cmp < 0) {
+			hi = mid;
+		} else if (cmp == 0) {
+			unless (orig_key == null) {
+				*orig_key = mid_key;
+			}
+			unless (value == null) {
+				*value = rb_tree_image_value(image, mid);
+			}
+			return true;
+		} else { /* (cmp > 0) */
+			lo = mid + 1;
+		}
+	}
+
+	return false;
+}
+
+
+/* {{{1
+ * Get the ‘i’'th smallest key of ‘image’, and its value, into ‘key’ and
+ * ‘value’, if they're non-‹null›, as with |rb_tree_select|.  Returns false if
+ * ‘i’ is out of range.
+ */
+bool
+rb_tree_image_select(RBTreeImage *image,
+		     size_t i,
+		     pointer *key,
+		     pointer *value)
+{
+	invariant(image != null);
+
+	if (i >= image->count) {
+		return false;
+	}
+
+	unless (key == null) {
+		*key = rb_tree_image_key(image, i);
+	}
+	unless (value == null) {
+		*value = rb_tree_image_value(image, i);
+	}
+
+	return true;
+}
+
+
+/* {{{1
+ * Create a new, mutable, tree out of the key-value pairs of ‘image’, ordered
+ * by ‘key_compare’, see |rb_tree_image_lookup|.  It's built in O(n) time by
+ * |rb_tree_new_from_sorted|, without copying the records of the keys and
+ * values, so ‘image’ must be kept open for as long as the tree uses them, and
+ * the tree has no release notifiers.  Returns ‹null›, with errno set to
+ * EINVAL, if the keys of ‘image’ aren't in strictly increasing order according
+ * to ‘key_compare’, as it's then either corrupt or ordered differently.
+ */
+RBTree *
+rb_tree_load(RBTreeImage *image,
+	     CompareDataFunc key_compare,
+	     pointer key_compare_data)
+{
+	invariant(image != null);
+	invariant(key_compare != null);
+
+	size_t n = image->count;
+	pointer *keys = new_array(pointer, n);
+	pointer *values = new_array(pointer, n);
+
+	for (size_t i = 0; i < n; i++) {
+		keys[i] = rb_tree_image_key(image, i);
+		values[i] = rb_tree_image_value(image, i);
+		if (i > 0 && key_compare(keys[i - 1], keys[i],
+					 key_compare_data) >= 0) {
+			release(values);
+			release(keys);
+			errno = EINVAL;
+			return null;
+		}
+	}
+
+	RBTree *tree = rb_tree_new_from_sorted(keys, values, n,
+					       key_compare, key_compare_data,
+					       null, null);
+	release(values);
+	release(keys);
+
+	return tree;
+}
+
+
+/* }}}1 */
+
+
+
+/* vim: set sts=0 sw=8 ts=8: */
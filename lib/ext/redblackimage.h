@@ -0,0 +1,62 @@
+/*
+ * contents: Saving red-black trees to and loading them from image files.
+ * arch-tag: 0418f848-0257-4876-bd79-06d10ec8dcf0
+ *
+ * Copyright (C) 2004 Nikolai Weibull <source@pcppopper.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+
+
+#ifndef REDBLACKIMAGE_H
+#define REDBLACKIMAGE_H
+
+
+#define RB_TREE_IMAGE_VERSION	1
+
+
+typedef struct _RBTreeImage RBTreeImage;
+
+
+bool rb_tree_save(RBTree *tree,
+		  const char *path,
+		  size_t key_width,
+		  size_t value_width);
+
+RBTreeImage *rb_tree_image_open(const char *path);
+void rb_tree_image_close(RBTreeImage *image);
+size_t rb_tree_image_size(RBTreeImage *image);
+bool rb_tree_image_lookup(RBTreeImage *image,
+			  constpointer key,
+			  CompareDataFunc key_compare,
+			  pointer key_compare_data,
+			  pointer *orig_key,
+			  pointer *value);
+bool rb_tree_image_select(RBTreeImage *image,
+			  size_t i,
+			  pointer *key,
+			  pointer *value);
+
+RBTree *rb_tree_load(RBTreeImage *image,
+		     CompareDataFunc key_compare,
+		     pointer key_compare_data);
+
+
+#endif /* REDBLACKIMAGE_H */
+
+
+
+/* vim: set sts=0 sw=8 ts=8: */
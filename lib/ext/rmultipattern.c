@@ -0,0 +1,279 @@
+/*
+ * contents: Ruby binding of the MultiPattern ADT.
+ * arch-tag: 492add14-0c05-484f-82fc-08f4cf2760a1
+ *
+ * Copyright (C) 2004 Nikolai Weibull <source@pcppopper.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+
+#include <ruby.h>
+#include <clear/internal.h>
+#include "multipattern.h"
+#include "rdsl.h"
+
+
+/* {{{1
+ * The RDSL::MultiPattern class.
+ */
+static VALUE cMultiPattern;
+
+
+/* {{{1
+ * Release the |MultiPattern| of an RDSL::MultiPattern once it's been garbage
+ * collected.
+ */
+static void
+rmultipattern_free(MultiPattern *mp)
+{
+	unless (mp == null) {
+		multi_pattern_release(mp);
+	}
+}
+
+
+/* {{{1
+ * Allocate a new RDSL::MultiPattern.  It gets its |MultiPattern| in
+ * #initialize, once we know the needles.
+ */
+static VALUE
+rmultipattern_alloc(VALUE klass)
+{
+	return Data_Wrap_Struct(klass, null, rmultipattern_free, null);
+}
+
+
+/* {{{1
+ * Get the |MultiPattern| of ‘self’.
+ */
+static MultiPattern *
+rmultipattern_get(VALUE self)
+{
+	MultiPattern *mp;
+	Data_Get_Struct(self, MultiPattern, mp);
+	if (mp == null) {
+		rb_raise(rb_eArgError, "uninitialized MultiPattern");
+	}
+
+	return mp;
+}
+
+
+/* {{{1
+ * call-seq: MultiPattern.new(needles)
+ *
+ * Creates a +MultiPattern+ that searches for all the Strings in the Array
+ * _needles_ at once.  The needles may contain any bytes, but none of them
+ * may be empty.  A needle is identified by its index in _needles_.  They're
+ * compiled into an Aho-Corasick automaton once, here, and then each search
+ * looks at each byte of the text only once, however many needles there are.
+ * Raises an ArgumentError if the automaton would be too large.  A
+ * +MultiPattern+ can't be initialized again, as a search, such as an
+ * #each_match, may still be using its automaton.
+ */
+static VALUE
+rmultipattern_initialize(VALUE self, VALUE needles)
+{
+	Check_Type(needles, T_ARRAY);
+	unless (DATA_PTR(self) == null) {
+		rb_raise(rb_eArgError, "already initialized MultiPattern");
+	}
+
+	VALUE sources = rb_ary_new2(RARRAY_LEN(needles));
+	for (long i = 0; i < RARRAY_LEN(needles); i++) {
+		VALUE needle = rb_ary_entry(needles, i);
+		StringValue(needle);
+		if (RSTRING_LEN(needle) == 0) {
+			rb_raise(rb_eArgError, "empty needle");
+		}
+		rb_ary_push(sources, rb_obj_freeze(rb_str_dup(needle)));
+	}
+
+	MultiPattern *mp = multi_pattern_new();
+	for (long i = 0; i < RARRAY_LEN(sources); i++) {
+		VALUE needle = rb_ary_entry(sources, i);
+		multi_pattern_add(mp, RSTRING_PTR(needle), RSTRING_LEN(needle));
+	}
+	unless (multi_pattern_compile(mp)) {
+		multi_pattern_release(mp);
+		rb_raise(rb_eArgError, "too many needles to compile");
+	}
+
+	DATA_PTR(self) = mp;
+	rb_iv_set(self, "@sources", rb_obj_freeze(sources));
+
+	return self;
+}
+
+
+/* {{{1
+ * Make ‘self’ a copy of ‘orig’, for #dup and #clone.  A |MultiPattern| can't
+ * be shared, as each is released with the object that holds it, so ‘self’
+ * gets its own, compiled from the needles of ‘orig’.
+ */
+static VALUE
+rmultipattern_initialize_copy(VALUE self, VALUE orig)
+{
+	if (self == orig) {
+		return self;
+	}
+
+	rmultipattern_get(orig);
+
+	return rmultipattern_initialize(self, rb_iv_get(orig, "@sources"));
+}
+
+
+/* {{{1
+ * Search for the needles of ‘self’ in the String ‘argv[0]’, starting at the
+ * offset ‘argv[1]’, if given, as with Pattern#index.  Returns the offset of
+ * the match, or -1 if there is none, and stores the id of the needle in
+ * ‘id’.
+ */
+static long
+rmultipattern_search(int argc, VALUE *argv, VALUE self, size_t *id)
+{
+	VALUE text, offset;
+	rb_scan_args(argc, argv, "11", &text, &offset);
+	StringValue(text);
+
+	long n = RSTRING_LEN(text);
+	long pos = NIL_P(offset) ? 0 : NUM2LONG(offset);
+	if (pos < 0) {
+		pos += n;
+		if (pos < 0) {
+			return -1;
+		}
+	}
+
+	size_t match = multi_pattern_search(rmultipattern_get(self),
+					    RSTRING_PTR(text), n, pos, id);
+
+	return (match == MULTI_PATTERN_NO_MATCH) ? -1 : (long)match;
+}
+
+
+/* {{{1
+ * call-seq: multipattern.index(string, pos = 0)
+ *
+ * Returns the byte offset of the leftmost occurrence of any of the needles
+ * in _string_ at or after _pos_, or +nil+ if there is none.
+ */
+static VALUE
+rmultipattern_index(int argc, VALUE *argv, VALUE self)
+{
+	size_t id;
+	long match = rmultipattern_search(argc, argv, self, &id);
+
+	return (match < 0) ? Qnil : LONG2NUM(match);
+}
+
+
+/* {{{1
+ * call-seq: multipattern.find(string, pos = 0)
+ *
+ * Like MultiPattern#index, but returns the id of the needle that matched
+ * as well, as an Array [offset, id].  If several needles match at the same
+ * offset, the one with the lowest id wins.
+ */
+static VALUE
+rmultipattern_find(int argc, VALUE *argv, VALUE self)
+{
+	size_t id;
+	long match = rmultipattern_search(argc, argv, self, &id);
+
+	return (match < 0) ? Qnil :
+		rb_assoc_new(LONG2NUM(match), LONG2NUM(id));
+}
+
+
+/* {{{1
+ * Yield the id and the offset of a match to the block of #each_match.
+ */
+static bool
+rmultipattern_yield(size_t id, size_t offset, pointer closure)
+{
+	rb_yield_values(2, LONG2NUM(id), LONG2NUM(offset));
+
+	return true;
+}
+
+
+/* {{{1
+ * call-seq: multipattern.each_match(string) { |id, offset| ... }
+ *
+ * Executes the block once for every occurrence of every needle in
+ * _string_, overlapping ones included, passing the id of the needle and the
+ * byte offset it starts at.  All of them are found in a single pass over
+ * _string_, and they're given in the order they end in.  Returns an
+ * Enumerator if no block is given.
+ */
+static VALUE
+rmultipattern_each_match(VALUE self, VALUE text)
+{
+	RETURN_ENUMERATOR(self, 1, &text);
+
+	/* the block mustn't be able to pull the bytes out from under us */
+	VALUE frozen = rb_str_new_frozen(StringValue(text));
+	multi_pattern_map(rmultipattern_get(self), RSTRING_PTR(frozen),
+			  RSTRING_LEN(frozen), rmultipattern_yield, null);
+	RB_GC_GUARD(frozen);
+
+	return self;
+}
+
+
+/* {{{1
+ * call-seq: multipattern.size
+ *
+ * Returns the number of needles of the MultiPattern.
+ */
+static VALUE
+rmultipattern_size(VALUE self)
+{
+	return LONG2NUM(multi_pattern_size(rmultipattern_get(self)));
+}
+
+
+/* {{{1
+ * Define RDSL::MultiPattern.
+ */
+void
+rdsl_init_multipattern(void)
+{
+	cMultiPattern = rb_define_class_under(mRDSL, "MultiPattern",
+					      rb_cObject);
+
+	rb_define_alloc_func(cMultiPattern, rmultipattern_alloc);
+	rb_define_method(cMultiPattern, "initialize",
+			 rmultipattern_initialize, 1);
+	rb_define_method(cMultiPattern, "initialize_copy",
+			 rmultipattern_initialize_copy, 1);
+	rb_define_method(cMultiPattern, "index", rmultipattern_index, -1);
+	rb_define_method(cMultiPattern, "find", rmultipattern_find, -1);
+	rb_define_method(cMultiPattern, "each_match",
+			 rmultipattern_each_match, 1);
+	rb_define_method(cMultiPattern, "size", rmultipattern_size, 0);
+	rb_define_method(cMultiPattern, "length", rmultipattern_size, 0);
+	rb_define_attr(cMultiPattern, "sources", 1, 0);
+}
+
+
+/* }}}1 */
+
+
+
+/* vim: set sts=0 sw=8 ts=8: */
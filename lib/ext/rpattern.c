@@ -0,0 +1,423 @@
+/*
+ * contents: Ruby binding of the Pattern ADT.
+ * arch-tag: 516bd0a0-3c07-4067-9b23-6d56e8e066d5
+ *
+ * Copyright (C) 2004 Nikolai Weibull <source@pcppopper.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+
+#include <ruby.h>
+#include <clear/internal.h>
+#include <clear/mem.h>
+#include "pattern.h"
+#include "patternstream.h"
+#include "patternparallel.h"
+#include "rdsl.h"
+
+
+/* {{{1
+ * The RDSL::Pattern class.
+ */
+static VALUE cPattern;
+
+
+/* {{{1
+ * The type of the search functions of |Pattern|.
+ */
+typedef size_t (*RPatternSearchFunc)(Pattern *pattern,
+				     const char *text,
+				     size_t n,
+				     size_t pos);
+
+
+/* {{{1
+ * Release the |Pattern| of an RDSL::Pattern once it's been garbage
+ * collected.
+ */
+static void
+rpattern_free(Pattern *pattern)
+{
+	unless (pattern == null) {
+		pattern_release(pattern);
+	}
+}
+
+
+/* {{{1
+ * Allocate a new RDSL::Pattern.  It gets its |Pattern| in #initialize, once
+ * we know the needle.
+ */
+static VALUE
+rpattern_alloc(VALUE klass)
+{
+	return Data_Wrap_Struct(klass, null, rpattern_free, null);
+}
+
+
+/* {{{1
+ * Get the |Pattern| of ‘self’.
+ */
+static Pattern *
+rpattern_get(VALUE self)
+{
+	Pattern *pattern;
+	Data_Get_Struct(self, Pattern, pattern);
+	if (pattern == null) {
+		rb_raise(rb_eArgError, "uninitialized Pattern");
+	}
+
+	return pattern;
+}
+
+
+/* {{{1
+ * call-seq: Pattern.new(needle)
+ *
+ * Creates a +Pattern+ that searches for the String _needle_.  The tables
+ * that the searches need are built once, here, so a +Pattern+ is the thing
+ * to use when searching for the same needle many times.  The needle may
+ * contain any bytes.  A +Pattern+ can't be initialized again, as a search,
+ * such as an #each_match, may still be using its tables.
+ */
+static VALUE
+rpattern_initialize(VALUE self, VALUE needle)
+{
+	StringValue(needle);
+	unless (DATA_PTR(self) == null) {
+		rb_raise(rb_eArgError, "already initialized Pattern");
+	}
+	DATA_PTR(self) = pattern_new(RSTRING_PTR(needle), RSTRING_LEN(needle));
+	rb_iv_set(self, "@source", rb_obj_freeze(rb_str_dup(needle)));
+
+	return self;
+}
+
+
+/* {{{1
+ * Make ‘self’ a copy of ‘orig’, for #dup and #clone.  A |Pattern| can't be
+ * shared, as each is released with the object that holds it, so ‘self’ gets
+ * its own, built from the needle of ‘orig’.
+ */
+static VALUE
+rpattern_initialize_copy(VALUE self, VALUE orig)
+{
+	if (self == orig) {
+		return self;
+	}
+
+	rpattern_get(orig);
+
+	return rpattern_initialize(self, rb_iv_get(orig, "@source"));
+}
+
+
+/* {{{1
+ * Search for the Pattern of ‘self’ in the String ‘argv[0]’, starting at the
+ * offset ‘argv[1]’, if given, using ‘search’.  A negative offset counts from
+ * the end of the String, as with String#index.
+ */
+static VALUE
+rpattern_search(int argc, VALUE *argv, VALUE self, RPatternSearchFunc search)
+{
+	VALUE text, offset;
+	rb_scan_args(argc, argv, "11", &text, &offset);
+	StringValue(text);
+
+	long n = RSTRING_LEN(text);
+	long pos = NIL_P(offset) ? 0 : NUM2LONG(offset);
+	if (pos < 0) {
+		pos += n;
+		if (pos < 0) {
+			return Qnil;
+		}
+	}
+
+	size_t match = search(rpattern_get(self), RSTRING_PTR(text), n, pos);
+
+	return (match == PATTERN_NO_MATCH) ? Qnil : LONG2NUM(match);
+}
+
+
+/* {{{1
+ * call-seq: pattern.index(string, pos = 0)
+ *
+ * Returns the byte offset of the first occurrence of the Pattern in
+ * _string_ at or after _pos_, or +nil+ if there is none.  This uses the
+ * fastest search we have, which filters candidate positions with SIMD
+ * instructions where that's possible.
+ */
+static VALUE
+rpattern_index(int argc, VALUE *argv, VALUE self)
+{
+	return rpattern_search(argc, argv, self, pattern_search);
+}
+
+
+/* {{{1
+ * call-seq: pattern.bmh_index(string, pos = 0)
+ *
+ * Like Pattern#index, but always uses Boyer-Moore-Horspool.
+ */
+static VALUE
+rpattern_bmh_index(int argc, VALUE *argv, VALUE self)
+{
+	return rpattern_search(argc, argv, self, pattern_bmh_search);
+}
+
+
+/* {{{1
+ * call-seq: pattern.kmp_index(string, pos = 0)
+ *
+ * Like Pattern#index, but always uses Knuth-Morris-Pratt.
+ */
+static VALUE
+rpattern_kmp_index(int argc, VALUE *argv, VALUE self)
+{
+	return rpattern_search(argc, argv, self, pattern_kmp_search);
+}
+
+
+/* {{{1
+ * Yield the offset of a match to the block of #each_match.
+ */
+static bool
+rpattern_yield(size_t offset, pointer closure)
+{
+	rb_yield(LONG2NUM(offset));
+
+	return true;
+}
+
+
+/* {{{1
+ * call-seq: pattern.each_match(string) { |offset| ... }
+ *
+ * Executes the block once for every occurrence of the Pattern in _string_,
+ * overlapping ones included, passing the byte offset it starts at.  Returns
+ * an Enumerator if no block is given.
+ */
+static VALUE
+rpattern_each_match(VALUE self, VALUE text)
+{
+	RETURN_ENUMERATOR(self, 1, &text);
+
+	/* the block mustn't be able to pull the bytes out from under us */
+	VALUE frozen = rb_str_new_frozen(StringValue(text));
+	pattern_map(rpattern_get(self), RSTRING_PTR(frozen),
+		    RSTRING_LEN(frozen), rpattern_yield, null);
+	RB_GC_GUARD(frozen);
+
+	return self;
+}
+
+
+/* {{{1
+ * Call the block of #each_match_in_file with ‘offset’.
+ */
+static VALUE
+rpattern_yield_protected(VALUE offset)
+{
+	return rb_yield(offset);
+}
+
+
+/* {{{1
+ * Yield the offset of a match to the block of #each_match_in_file.  The
+ * search has a file open, and maybe mapped, that it must clean up after, so
+ * if the block raises an exception, or breaks out of the search, we stop
+ * the search and store the state of the jump in ‘closure’, so that it can
+ * be resumed once the search is done.
+ */
+static bool
+rpattern_yield_in_file(size_t offset, pointer closure)
+{
+	int *state = closure;
+	rb_protect(rpattern_yield_protected, LONG2NUM(offset), state);
+
+	return *state == 0;
+}
+
+
+/* {{{1
+ * call-seq: pattern.each_match_in_file(path) { |offset| ... }
+ *
+ * Executes the block once for every occurrence of the Pattern in the file
+ * at _path_, as with Pattern#each_match, but without reading the file into
+ * a String first.  Regular files are mapped into memory, and anything else
+ * is read a chunk at a time, so files of any size can be searched.  The
+ * Pattern mustn't be empty.  Returns an Enumerator if no block is given.
+ */
+static VALUE
+rpattern_each_match_in_file(VALUE self, VALUE path)
+{
+	RETURN_ENUMERATOR(self, 1, &path);
+
+	Pattern *pattern = rpattern_get(self);
+	if (pattern_length(pattern) == 0) {
+		rb_raise(rb_eArgError, "can't stream an empty Pattern");
+	}
+
+	FilePathValue(path);
+	int state = 0;
+	unless (pattern_map_file(pattern, RSTRING_PTR(path),
+				 rpattern_yield_in_file, &state)) {
+		rb_sys_fail(RSTRING_PTR(path));
+	}
+	unless (state == 0) {
+		rb_jump_tag(state);
+	}
+
+	return self;
+}
+
+
+/* {{{1
+ * Get the number of threads to search with from the optional argument
+ * ‘threads’ of #count and friends.  Leaving it out, or passing +nil+, has
+ * us use all processors, which is what 0 means to |pattern_count_parallel|.
+ */
+static int
+rpattern_threads(VALUE threads)
+{
+	return NIL_P(threads) ? 0 : NUM2INT(threads);
+}
+
+
+/* {{{1
+ * call-seq: pattern.count(string, threads = nil)
+ *
+ * Returns the number of occurrences of the Pattern in _string_, overlapping
+ * ones included.  Large Strings are split into slices that are searched by
+ * _threads_ threads at once, or one thread for each processor if _threads_
+ * is +nil+.
+ */
+static VALUE
+rpattern_count(int argc, VALUE *argv, VALUE self)
+{
+	VALUE text, threads;
+	rb_scan_args(argc, argv, "11", &text, &threads);
+	StringValue(text);
+
+	return LONG2NUM(pattern_count_parallel(rpattern_get(self),
+					       RSTRING_PTR(text),
+					       RSTRING_LEN(text),
+					       rpattern_threads(threads)));
+}
+
+
+/* {{{1
+ * call-seq: pattern.find_all(string, threads = nil)
+ *
+ * Returns an Array of the byte offsets of all occurrences of the Pattern in
+ * _string_, overlapping ones included, in increasing order.  The search is
+ * split between _threads_ threads, as with Pattern#count.
+ */
+static VALUE
+rpattern_find_all(int argc, VALUE *argv, VALUE self)
+{
+	VALUE text, threads;
+	rb_scan_args(argc, argv, "11", &text, &threads);
+	StringValue(text);
+
+	size_t *offsets;
+	size_t n = pattern_find_all(rpattern_get(self), RSTRING_PTR(text),
+				    RSTRING_LEN(text),
+				    rpattern_threads(threads), &offsets);
+	VALUE result = rb_ary_new2(n);
+	for (size_t i = 0; i < n; i++) {
+		rb_ary_push(result, LONG2NUM(offsets[i]));
+	}
+	release(offsets);
+
+	return result;
+}
+
+
+/* {{{1
+ * call-seq: pattern.count_in_file(path, threads = nil)
+ *
+ * Returns the number of occurrences of the Pattern in the file at _path_,
+ * as with Pattern#count, but without reading the file into a String
+ * first.  Regular files are mapped into memory and split between _threads_
+ * threads.  The Pattern mustn't be empty.
+ */
+static VALUE
+rpattern_count_in_file(int argc, VALUE *argv, VALUE self)
+{
+	VALUE path, threads;
+	rb_scan_args(argc, argv, "11", &path, &threads);
+
+	Pattern *pattern = rpattern_get(self);
+	if (pattern_length(pattern) == 0) {
+		rb_raise(rb_eArgError, "can't stream an empty Pattern");
+	}
+
+	FilePathValue(path);
+	size_t count;
+	unless (pattern_count_file(pattern, RSTRING_PTR(path),
+				   rpattern_threads(threads), &count)) {
+		rb_sys_fail(RSTRING_PTR(path));
+	}
+
+	return LONG2NUM(count);
+}
+
+
+/* {{{1
+ * call-seq: pattern.length
+ *
+ * Returns the length of the needle of the Pattern, in bytes.
+ */
+static VALUE
+rpattern_length(VALUE self)
+{
+	return LONG2NUM(pattern_length(rpattern_get(self)));
+}
+
+
+/* {{{1
+ * Define RDSL::Pattern.
+ */
+void
+rdsl_init_pattern(void)
+{
+	cPattern = rb_define_class_under(mRDSL, "Pattern", rb_cObject);
+
+	rb_define_alloc_func(cPattern, rpattern_alloc);
+	rb_define_method(cPattern, "initialize", rpattern_initialize, 1);
+	rb_define_method(cPattern, "initialize_copy",
+			 rpattern_initialize_copy, 1);
+	rb_define_method(cPattern, "index", rpattern_index, -1);
+	rb_define_method(cPattern, "bmh_index", rpattern_bmh_index, -1);
+	rb_define_method(cPattern, "kmp_index", rpattern_kmp_index, -1);
+	rb_define_method(cPattern, "each_match", rpattern_each_match, 1);
+	rb_define_method(cPattern, "each_match_in_file",
+			 rpattern_each_match_in_file, 1);
+	rb_define_method(cPattern, "count", rpattern_count, -1);
+	rb_define_method(cPattern, "find_all", rpattern_find_all, -1);
+	rb_define_method(cPattern, "count_in_file", rpattern_count_in_file, -1);
+	rb_define_method(cPattern, "length", rpattern_length, 0);
+	rb_define_method(cPattern, "size", rpattern_length, 0);
+	rb_define_attr(cPattern, "source", 1, 0);
+}
+
+
+/* }}}1 */
+
+
+
+/* vim: set sts=0 sw=8 ts=8: */
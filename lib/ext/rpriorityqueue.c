@@ -0,0 +1,290 @@
+/*
+ * contents: Ruby binding of the PriorityQueue ADT.
+ * arch-tag: 70aa9ebe-a2b2-4b28-a6f0-33af61100efa
+ *
+ * Copyright (C) 2004 Nikolai Weibull <source@pcppopper.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+
+#include <ruby.h>
+#include <clear/internal.h>
+#include "priorityqueue.h"
+#include "rdsl.h"
+
+
+/* {{{1
+ * The RDSL::PriorityQueue class.
+ */
+static VALUE cPriorityQueue;
+
+
+/* {{{1
+ * Compare two items of a PriorityQueue, see |rdsl_compare|.
+ */
+static int
+rpriorityqueue_compare(constpointer a, constpointer b)
+{
+	return rdsl_compare(a, b, null);
+}
+
+
+/* {{{1
+ * Mark an item of a PriorityQueue for the garbage collector.
+ */
+static void
+rpriorityqueue_mark_item(pointer data, pointer closure)
+{
+	rb_gc_mark((VALUE)data);
+}
+
+
+/* {{{1
+ * Mark all items of ‘q’ for the garbage collector.
+ */
+static void
+rpriorityqueue_mark(PriorityQueue *q)
+{
+	priority_queue_map_unordered(q, rpriorityqueue_mark_item, null);
+}
+
+
+/* {{{1
+ * Allocate a new, empty, RDSL::PriorityQueue.
+ */
+static VALUE
+rpriorityqueue_alloc(VALUE klass)
+{
+	PriorityQueue *q = priority_queue_new(rpriorityqueue_compare, null);
+
+	return Data_Wrap_Struct(klass, rpriorityqueue_mark,
+				priority_queue_release, q);
+}
+
+
+/* {{{1
+ * Get the |PriorityQueue| of ‘self’.
+ */
+static PriorityQueue *
+rpriorityqueue_get(VALUE self)
+{
+	PriorityQueue *q;
+	Data_Get_Struct(self, PriorityQueue, q);
+
+	return q;
+}
+
+
+/* {{{1
+ * Pass the exception of ‘state’, if any, on, once ‘q’ has been put back the
+ * way it was.  Items are moved around while they're being sifted, so an
+ * exception raised by <=> in the middle of a sift would otherwise leave one
+ * of them out of the heap and another one in it twice.
+ */
+static void
+rpriorityqueue_recover(PriorityQueue *q, int state)
+{
+	unless (state == 0) {
+		priority_queue_recover(q);
+		rb_jump_tag(state);
+	}
+}
+
+
+/* {{{1
+ * Push ‘args’[1] on the queue of ‘args’[0], see #push.
+ */
+static VALUE
+rpriorityqueue_push_protected(VALUE args)
+{
+	VALUE *argv = (VALUE *)args;
+
+	priority_queue_push(rpriorityqueue_get(argv[0]), (pointer)argv[1]);
+
+	return Qnil;
+}
+
+
+/* {{{1
+ * call-seq: queue.push(item)
+ *
+ * Adds _item_ to the PriorityQueue, in O(log n) time.  Items are compared
+ * with <=>, so they must all be comparable with each other.  If <=> raises an
+ * exception, _item_ isn't added, and the PriorityQueue is left as it was.
+ * Returns the PriorityQueue itself.
+ */
+static VALUE
+rpriorityqueue_push(VALUE self, VALUE item)
+{
+	VALUE argv[2] = { self, item };
+	int state = 0;
+
+	rb_protect(rpriorityqueue_push_protected, (VALUE)argv, &state);
+	rpriorityqueue_recover(rpriorityqueue_get(self), state);
+
+	return self;
+}
+
+
+/* {{{1
+ * Pop the smallest item off of the queue of ‘self’, see #pop.
+ */
+static VALUE
+rpriorityqueue_pop_protected(VALUE self)
+{
+	return (VALUE)priority_queue_pop(rpriorityqueue_get(self));
+}
+
+
+/* {{{1
+ * call-seq: queue.pop
+ *
+ * Removes the smallest item of the PriorityQueue and returns it, or +nil+
+ * if the PriorityQueue is empty.  If <=> raises an exception, the
+ * PriorityQueue is left as it was.
+ */
+static VALUE
+rpriorityqueue_pop(VALUE self)
+{
+	PriorityQueue *q = rpriorityqueue_get(self);
+	if (priority_queue_empty(q)) {
+		return Qnil;
+	}
+
+	int state = 0;
+	VALUE item = rb_protect(rpriorityqueue_pop_protected, self, &state);
+	rpriorityqueue_recover(q, state);
+
+	return item;
+}
+
+
+/* {{{1
+ * call-seq: queue.peek
+ *
+ * Returns the smallest item of the PriorityQueue without removing it, or
+ * +nil+ if the PriorityQueue is empty.
+ */
+static VALUE
+rpriorityqueue_peek(VALUE self)
+{
+	PriorityQueue *q = rpriorityqueue_get(self);
+
+	return priority_queue_empty(q) ? Qnil : (VALUE)priority_queue_peek(q);
+}
+
+
+/* {{{1
+ * call-seq: queue.length
+ *
+ * Returns the number of items in the PriorityQueue.
+ */
+static VALUE
+rpriorityqueue_length(VALUE self)
+{
+	return INT2NUM(priority_queue_length(rpriorityqueue_get(self)));
+}
+
+
+/* {{{1
+ * call-seq: queue.empty?
+ *
+ * Returns +true+ if the PriorityQueue has no items.
+ */
+static VALUE
+rpriorityqueue_empty_p(VALUE self)
+{
+	return priority_queue_empty(rpriorityqueue_get(self)) ? Qtrue : Qfalse;
+}
+
+
+/* {{{1
+ * call-seq: queue.stats
+ *
+ * Returns the statistics of the PriorityQueue as a Hash of counters, keyed by
+ * :comparisons, :sift_ups, :sift_up_levels, :sift_downs, :sift_down_levels,
+ * and :depths, see |priority_queue_get_stats|.  :depths is an Array, the
+ * number of sifts over each number of levels.  Returns +nil+ if the extension
+ * was built without statistics, see extconf.rb.
+ */
+static VALUE
+rpriorityqueue_stats(VALUE self)
+{
+	PriorityQueueStats stats;
+
+	unless (priority_queue_get_stats(rpriorityqueue_get(self), &stats)) {
+		return Qnil;
+	}
+
+	VALUE hash = rb_hash_new();
+#define STAT(name) \
+	rb_hash_aset(hash, ID2SYM(rb_intern(#name)), ULONG2NUM(stats.name))
+	STAT(comparisons);
+	STAT(sift_ups);
+	STAT(sift_up_levels);
+	STAT(sift_downs);
+	STAT(sift_down_levels);
+#undef STAT
+	rb_hash_aset(hash, ID2SYM(rb_intern("depths")),
+		     rdsl_histogram(stats.depths,
+				    PRIORITY_QUEUE_STATS_DEPTHS));
+
+	return hash;
+}
+
+
+/* {{{1
+ * call-seq: queue.reset_stats
+ *
+ * Resets the statistics of the PriorityQueue, see #stats.
+ */
+static VALUE
+rpriorityqueue_reset_stats(VALUE self)
+{
+	priority_queue_reset_stats(rpriorityqueue_get(self));
+
+	return self;
+}
+
+
+/* {{{1
+ * Define RDSL::PriorityQueue.
+ */
+void
+rdsl_init_priorityqueue(void)
+{
+	cPriorityQueue = rb_define_class_under(mRDSL, "PriorityQueue",
+					       rb_cObject);
+
+	rb_define_alloc_func(cPriorityQueue, rpriorityqueue_alloc);
+	rb_define_method(cPriorityQueue, "push", rpriorityqueue_push, 1);
+	rb_define_method(cPriorityQueue, "<<", rpriorityqueue_push, 1);
+	rb_define_method(cPriorityQueue, "pop", rpriorityqueue_pop, 0);
+	rb_define_method(cPriorityQueue, "peek", rpriorityqueue_peek, 0);
+	rb_define_method(cPriorityQueue, "length", rpriorityqueue_length, 0);
+	rb_define_method(cPriorityQueue, "size", rpriorityqueue_length, 0);
+	rb_define_method(cPriorityQueue, "empty?", rpriorityqueue_empty_p, 0);
+	rb_define_method(cPriorityQueue, "stats", rpriorityqueue_stats, 0);
+	rb_define_method(cPriorityQueue, "reset_stats",
+			 rpriorityqueue_reset_stats, 0);
+}
+
+
+/* }}}1 */
+
+
+
+/* vim: set sts=0 sw=8 ts=8: */
@@ -0,0 +1,551 @@
+/*
+ * contents: Ruby binding of the Red-black tree ADT.
+ * arch-tag: 1a065bc8-d673-417e-bc65-c80cb2af9c90
+ *
+ * Copyright (C) 2004 Nikolai Weibull <source@pcppopper.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+
+#include <ruby.h>
+#include <clear/internal.h>
+#include <clear/mem.h>
+#include "redblack.h"
+#include "rdsl.h"
+
+
+/* {{{1
+ * A Ruby RDSL::RedBlackTree.  Keys and values are stored in the ‘tree’ as
+ * VALUEs.  ‘iterating’ counts the #each calls in progress on it, during which
+ * nothing may be added to or removed from the tree, as that would leave the
+ * cursor of #each dangling.
+ */
+typedef struct _RRBTree RRBTree;
+
+struct _RRBTree {
+	RBTree *tree;
+	int iterating;
+};
+
+
+/* {{{1
+ * The RDSL::RedBlackTree class.
+ */
+static VALUE cRedBlackTree;
+
+
+/* {{{1
+ * Mark the key and value of a node for the garbage collector.
+ */
+static bool
+rredblack_mark_pair(pointer key, pointer value, pointer closure)
+{
+	rb_gc_mark((VALUE)key);
+	rb_gc_mark((VALUE)value);
+
+	return true;
+}
+
+
+/* {{{1
+ * Mark all keys and values of ‘rtree’ for the garbage collector.
+ */
+static void
+rredblack_mark(RRBTree *rtree)
+{
+	rb_tree_map(rtree->tree, rredblack_mark_pair, null);
+}
+
+
+/* {{{1
+ * Release ‘rtree’ once it's been garbage collected.
+ */
+static void
+rredblack_free(RRBTree *rtree)
+{
+	rb_tree_release(rtree->tree);
+	xfree(rtree);
+}
+
+
+/* {{{1
+ * Allocate a new, empty, RDSL::RedBlackTree.
+ */
+static VALUE
+rredblack_alloc(VALUE klass)
+{
+	RRBTree *rtree = ALLOC(RRBTree);
+	rtree->tree = rb_tree_new_with_data(rdsl_compare, null);
+	rtree->iterating = 0;
+
+	return Data_Wrap_Struct(klass, rredblack_mark, rredblack_free, rtree);
+}
+
+
+/* {{{1
+ * Get the |RRBTree| of ‘self’.
+ */
+static RRBTree *
+rredblack_get(VALUE self)
+{
+	RRBTree *rtree;
+	Data_Get_Struct(self, RRBTree, rtree);
+
+	return rtree;
+}
+
+
+/* {{{1
+ * Raise an error if ‘rtree’ is being iterated over, as it can't be modified
+ * then.  Rotations move nodes around, so unlike with a Skiplist, not even
+ * insertions are safe.
+ */
+static void
+rredblack_check_iterating(RRBTree *rtree)
+{
+	if (rtree->iterating > 0) {
+		rb_raise(rb_eRuntimeError,
+			 "can't modify a RedBlackTree during iteration");
+	}
+}
+
+
+/* {{{1
+ * call-seq: RedBlackTree.new(default = nil)
+ *
+ * Creates a +RedBlackTree+.  A default value may also be specified.
+ */
+static VALUE
+rredblack_initialize(int argc, VALUE *argv, VALUE self)
+{
+	VALUE dflt;
+	rb_scan_args(argc, argv, "01", &dflt);
+	rb_iv_set(self, "@default", dflt);
+
+	return self;
+}
+
+
+/* {{{1
+ * Make ‘self’ a copy of ‘orig’, for #dup and #clone.  As the keys of ‘orig’
+ * come out sorted, we can build the copy in linear time, without comparing
+ * any keys.
+ */
+static VALUE
+rredblack_initialize_copy(VALUE self, VALUE orig)
+{
+	if (self == orig) {
+		return self;
+	}
+
+	RRBTree *rtree = rredblack_get(self);
+	rredblack_check_iterating(rtree);
+
+	RBTree *from = rredblack_get(orig)->tree;
+	size_t n = rb_tree_size(from);
+	pointer *keys = new_array(pointer, n + 1);
+	pointer *values = new_array(pointer, n + 1);
+	size_t i = 0;
+	for (RBTreeCursor *cursor = rb_tree_first(from); cursor != null;
+	     cursor = rb_tree_cursor_next(cursor), i++) {
+		keys[i] = rb_tree_cursor_key(cursor);
+		values[i] = rb_tree_cursor_value(cursor);
+	}
+
+	rb_tree_release(rtree->tree);
+	rtree->tree = rb_tree_new_from_sorted(keys, values, n,
+					      rdsl_compare, null, null, null);
+	release(keys);
+	release(values);
+	rb_iv_set(self, "@default", rb_iv_get(orig, "@default"));
+
+	return self;
+}
+
+
+/* {{{1
+ * call-seq: tree.store(key, value)
+ *
+ * Associates _key_ with _value_.  The value of this expression is _value_.
+ */
+static VALUE
+rredblack_store(VALUE self, VALUE key, VALUE value)
+{
+	RRBTree *rtree = rredblack_get(self);
+	rredblack_check_iterating(rtree);
+	rb_tree_insert(rtree->tree, (pointer)key, (pointer)value);
+
+	return value;
+}
+
+
+/* {{{1
+ * call-seq: tree.fetch(key, ifnone = nil)
+ *
+ * Returns the value associated with _key_.  If the _key_ isn't present in
+ * the RedBlackTree, the value of the block is returned.  If no block is
+ * specified and _ifnone_ is, _ifnone_ is returned.  Else an IndexError is
+ * raised.
+ */
+static VALUE
+rredblack_fetch(int argc, VALUE *argv, VALUE self)
+{
+	VALUE key, ifnone;
+	rb_scan_args(argc, argv, "11", &key, &ifnone);
+
+	pointer value;
+	if (rb_tree_lookup_extended(rredblack_get(self)->tree,
+				    (constpointer)key, null, &value)) {
+		return (VALUE)value;
+	}
+
+	if (rb_block_given_p()) {
+		return rb_yield(key);
+	}
+	unless (NIL_P(ifnone)) {
+		return ifnone;
+	}
+
+	rb_raise(rb_eIndexError, "key not found");
+	return Qnil;
+}
+
+
+/* {{{1
+ * call-seq: tree.delete(key)
+ *
+ * Deletes a key-value pair with key _key_.  The stored value is returned, or
+ * +nil+ if there was no such pair.
+ */
+static VALUE
+rredblack_delete(VALUE self, VALUE key)
+{
+	RRBTree *rtree = rredblack_get(self);
+	rredblack_check_iterating(rtree);
+
+	pointer value;
+	unless (rb_tree_lookup_extended(rtree->tree, (constpointer)key,
+					null, &value)) {
+		return Qnil;
+	}
+	rb_tree_steal(rtree->tree, (constpointer)key);
+
+	return (VALUE)value;
+}
+
+
+/* {{{1
+ * call-seq: tree.clear
+ *
+ * Deletes all key-value pairs stored in the RedBlackTree.
+ */
+static VALUE
+rredblack_clear(VALUE self)
+{
+	RRBTree *rtree = rredblack_get(self);
+	rredblack_check_iterating(rtree);
+	rb_tree_release(rtree->tree);
+	rtree->tree = rb_tree_new_with_data(rdsl_compare, null);
+
+	return self;
+}
+
+
+/* {{{1
+ * The arguments of #each and #each_from, passed through |rb_ensure()|.
+ */
+typedef struct _RBTreeEach RRBTreeEach;
+
+struct _RBTreeEach {
+	RRBTree *rtree;
+	RBTreeCursor *start;
+	bool with_key;
+	bool with_value;
+	bool descending;
+};
+
+
+/* {{{1
+ * Yield the pairs of a RedBlackTree, see |rredblack_iterate|.
+ */
+static VALUE
+rredblack_each_yield(VALUE arg)
+{
+	RRBTreeEach *each = (RRBTreeEach *)arg;
+
+	for (RBTreeCursor *cursor = each->start; cursor != null;
+	     cursor = each->descending ? rb_tree_cursor_prev(cursor) :
+	     rb_tree_cursor_next(cursor)) {
+		VALUE key = (VALUE)rb_tree_cursor_key(cursor);
+		VALUE value = (VALUE)rb_tree_cursor_value(cursor);
+
+		if (each->with_key && each->with_value) {
+			rb_yield_values(2, key, value);
+		} else if (each->with_key) {
+			rb_yield(key);
+		} else if (each->with_value) {
+			rb_yield(value);
+		} else {
+			rb_yield_values(0);
+		}
+	}
+
+	return Qnil;
+}
+
+
+/* {{{1
+ * Mark the end of an iteration, however it ended.
+ */
+static VALUE
+rredblack_each_ensure(VALUE arg)
+{
+	((RRBTreeEach *)arg)->rtree->iterating--;
+
+	return Qnil;
+}
+
+
+/* {{{1
+ * Yield the pairs of ‘rtree’ from ‘start’ on, in descending order if
+ * ‘descending’ is true, or else in ascending order.  The key and value are
+ * yielded as separate arguments, without allocating an Array for them, or
+ * only one of them, as given by ‘with_key’ and ‘with_value’.
+ */
+static void
+rredblack_iterate(RRBTree *rtree, RBTreeCursor *start, bool with_key,
+		  bool with_value, bool descending)
+{
+	RRBTreeEach each;
+	each.rtree = rtree;
+	each.start = start;
+	each.with_key = with_key;
+	each.with_value = with_value;
+	each.descending = descending;
+
+	rtree->iterating++;
+	rb_ensure(rredblack_each_yield, (VALUE)&each,
+		  rredblack_each_ensure, (VALUE)&each);
+}
+
+
+/* {{{1
+ * call-seq: tree.each(with_key = true, with_value = true,
+ *			    order = ASCENDING) { |key, value| ... }
+ *
+ * Executes the block once for each key-value pair.  Pairs are given in the
+ * order specified by _order_, relative to the keys.  The key and the value
+ * are yielded as separate arguments, or only one of them, as specified by
+ * _with_key_ and _with_value_.  Returns an Enumerator if no block is given.
+ */
+static VALUE
+rredblack_each(int argc, VALUE *argv, VALUE self)
+{
+	RETURN_ENUMERATOR(self, argc, argv);
+
+	VALUE with_key, with_value, order;
+	rb_scan_args(argc, argv, "03", &with_key, &with_value, &order);
+
+	RRBTree *rtree = rredblack_get(self);
+	bool descending = (argc >= 3) && rdsl_descending_p(order);
+	rredblack_iterate(rtree,
+			  descending ? rb_tree_last(rtree->tree) :
+			  rb_tree_first(rtree->tree),
+			  (argc < 1) || RTEST(with_key),
+			  (argc < 2) || RTEST(with_value),
+			  descending);
+
+	return self;
+}
+
+
+/* {{{1
+ * call-seq: tree.each_from(key, order = ASCENDING) { |key, value| ... }
+ *
+ * Executes the block once for each key-value pair, starting with the
+ * smallest key not less than _key_, if _order_ is ASCENDING, or the largest
+ * key not greater than _key_, if it's DESCENDING.  Finding the first pair
+ * takes O(log n) time.  Returns an Enumerator if no block is given.
+ */
+static VALUE
+rredblack_each_from(int argc, VALUE *argv, VALUE self)
+{
+	RETURN_ENUMERATOR(self, argc, argv);
+
+	VALUE key, order;
+	rb_scan_args(argc, argv, "11", &key, &order);
+
+	RRBTree *rtree = rredblack_get(self);
+	RBTreeCursor *start;
+	bool descending = (argc >= 2) && rdsl_descending_p(order);
+	if (descending) {
+		start = rb_tree_upper_bound(rtree->tree, (constpointer)key);
+		start = (start != null) ? rb_tree_cursor_prev(start) :
+			rb_tree_last(rtree->tree);
+	} else {
+		start = rb_tree_lower_bound(rtree->tree, (constpointer)key);
+	}
+	rredblack_iterate(rtree, start, true, true, descending);
+
+	return self;
+}
+
+
+/* {{{1
+ * call-seq: tree.load_sorted(keys, values)
+ *
+ * Replaces the contents of the RedBlackTree with the pairs of _keys_ and
+ * _values_, where _keys_ must be in strictly ascending order, or an
+ * ArgumentError is raised.  The tree is built in O(n) time, comparing each
+ * key only with the one before it.  Returns the RedBlackTree.
+ */
+static VALUE
+rredblack_load_sorted(VALUE self, VALUE keys, VALUE values)
+{
+	RRBTree *rtree = rredblack_get(self);
+	rredblack_check_iterating(rtree);
+	rdsl_check_sorted(keys, values);
+
+	long n = RARRAY_LEN(keys);
+	pointer *k = new_array(pointer, n + 1);
+	pointer *v = new_array(pointer, n + 1);
+	for (long i = 0; i < n; i++) {
+		k[i] = (pointer)rb_ary_entry(keys, i);
+		v[i] = (pointer)rb_ary_entry(values, i);
+	}
+
+	rb_tree_release(rtree->tree);
+	rtree->tree = rb_tree_new_from_sorted(k, v, n, rdsl_compare, null,
+					      null, null);
+	release(k);
+	release(v);
+
+	return self;
+}
+
+
+/* {{{1
+ * call-seq: tree.length
+ *
+ * Returns the number of key-value pairs in the RedBlackTree.
+ */
+static VALUE
+rredblack_length(VALUE self)
+{
+	return INT2NUM(rb_tree_size(rredblack_get(self)->tree));
+}
+
+
+/* {{{1
+ * call-seq: tree.height
+ *
+ * Returns the height of the RedBlackTree.
+ */
+static VALUE
+rredblack_height(VALUE self)
+{
+	return INT2NUM(rb_tree_height(rredblack_get(self)->tree));
+}
+
+
+/* {{{1
+ * call-seq: tree.stats
+ *
+ * Returns the statistics of the RedBlackTree as a Hash of counters, keyed by
+ * :searches, :comparisons, :depths, :rotations, :fixups, :free_list_hits, and
+ * :free_list_misses, see |rb_tree_get_stats|.  :depths is an Array, the
+ * number of searches made at each depth.  Returns +nil+ if the extension was
+ * built without statistics, see extconf.rb.
+ */
+static VALUE
+rredblack_stats(VALUE self)
+{
+	RBTreeStats stats;
+
+	unless (rb_tree_get_stats(rredblack_get(self)->tree, &stats)) {
+		return Qnil;
+	}
+
+	VALUE hash = rb_hash_new();
+#define STAT(name) \
+	rb_hash_aset(hash, ID2SYM(rb_intern(#name)), ULONG2NUM(stats.name))
+	STAT(searches);
+	STAT(comparisons);
+	STAT(rotations);
+	STAT(fixups);
+	STAT(free_list_hits);
+	STAT(free_list_misses);
+#undef STAT
+	rb_hash_aset(hash, ID2SYM(rb_intern("depths")),
+		     rdsl_histogram(stats.depths, RB_TREE_STATS_DEPTHS));
+
+	return hash;
+}
+
+
+/* {{{1
+ * call-seq: tree.reset_stats
+ *
+ * Resets the statistics of the RedBlackTree, see #stats.
+ */
+static VALUE
+rredblack_reset_stats(VALUE self)
+{
+	rb_tree_reset_stats(rredblack_get(self)->tree);
+
+	return self;
+}
+
+
+/* {{{1
+ * Define RDSL::RedBlackTree.  The methods that don't need to be native are
+ * defined in src/redblacktree.rb.
+ */
+void
+rdsl_init_redblack(void)
+{
+	cRedBlackTree = rb_define_class_under(mRDSL, "RedBlackTree",
+					      rb_cObject);
+	rb_include_module(cRedBlackTree, mSortedAssociation);
+	rb_define_const(cRedBlackTree, "NATIVE", Qtrue);
+
+	rb_define_alloc_func(cRedBlackTree, rredblack_alloc);
+	rb_define_method(cRedBlackTree, "initialize",
+			 rredblack_initialize, -1);
+	rb_define_method(cRedBlackTree, "initialize_copy",
+			 rredblack_initialize_copy, 1);
+	rb_define_method(cRedBlackTree, "store", rredblack_store, 2);
+	rb_define_method(cRedBlackTree, "fetch", rredblack_fetch, -1);
+	rb_define_method(cRedBlackTree, "delete", rredblack_delete, 1);
+	rb_define_method(cRedBlackTree, "clear", rredblack_clear, 0);
+	rb_define_method(cRedBlackTree, "load_sorted",
+			 rredblack_load_sorted, 2);
+	rb_define_method(cRedBlackTree, "each", rredblack_each, -1);
+	rb_define_method(cRedBlackTree, "each_from", rredblack_each_from, -1);
+	rb_define_method(cRedBlackTree, "length", rredblack_length, 0);
+	rb_define_method(cRedBlackTree, "size", rredblack_length, 0);
+	rb_define_method(cRedBlackTree, "height", rredblack_height, 0);
+	rb_define_method(cRedBlackTree, "stats", rredblack_stats, 0);
+	rb_define_method(cRedBlackTree, "reset_stats",
+			 rredblack_reset_stats, 0);
+}
+
+
+/* }}}1 */
+
+
+
+/* vim: set sts=0 sw=8 ts=8: */
@@ -0,0 +1,477 @@
+/*
+ * contents: Ruby binding of the Skiplist ADT.
+ * arch-tag: a20c8e50-8cc9-48ed-9383-9e76e5099ad5
+ *
+ * Copyright (C) 2004 Nikolai Weibull <source@pcppopper.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+
+#include <ruby.h>
+#include <clear/internal.h>
+#include <clear/mem.h>
+#include "skiplist.h"
+#include "rdsl.h"
+
+
+/* {{{1
+ * A Ruby RDSL::Skiplist.  Keys and values are stored in the ‘list’ as
+ * VALUEs.  ‘iterating’ counts the #each calls in progress on it, during which
+ * nothing may be removed from the list, as that would leave the cursor of
+ * #each dangling.
+ */
+typedef struct _RSkipList RSkipList;
+
+struct _RSkipList {
+	SkipList *list;
+	int iterating;
+};
+
+
+/* {{{1
+ * The RDSL::Skiplist class.
+ */
+static VALUE cSkiplist;
+
+
+/* {{{1
+ * Mark the key and value of a node for the garbage collector.
+ */
+static bool
+rskiplist_mark_pair(pointer key, pointer value, pointer closure)
+{
+	rb_gc_mark((VALUE)key);
+	rb_gc_mark((VALUE)value);
+
+	return true;
+}
+
+
+/* {{{1
+ * Mark all keys and values of ‘rlist’ for the garbage collector.
+ */
+static void
+rskiplist_mark(RSkipList *rlist)
+{
+	skip_list_map(rlist->list, rskiplist_mark_pair, null);
+}
+
+
+/* {{{1
+ * Release ‘rlist’ once it's been garbage collected.
+ */
+static void
+rskiplist_free(RSkipList *rlist)
+{
+	skip_list_release(rlist->list);
+	xfree(rlist);
+}
+
+
+/* {{{1
+ * Allocate a new, empty, RDSL::Skiplist.
+ */
+static VALUE
+rskiplist_alloc(VALUE klass)
+{
+	RSkipList *rlist = ALLOC(RSkipList);
+	rlist->list = skip_list_new_with_data(rdsl_compare, null);
+	rlist->iterating = 0;
+
+	return Data_Wrap_Struct(klass, rskiplist_mark, rskiplist_free, rlist);
+}
+
+
+/* {{{1
+ * Get the |RSkipList| of ‘self’.
+ */
+static RSkipList *
+rskiplist_get(VALUE self)
+{
+	RSkipList *rlist;
+	Data_Get_Struct(self, RSkipList, rlist);
+
+	return rlist;
+}
+
+
+/* {{{1
+ * Raise an error if ‘rlist’ is being iterated over, as nothing can be removed
+ * from it then.
+ */
+static void
+rskiplist_check_iterating(RSkipList *rlist)
+{
+	if (rlist->iterating > 0) {
+		rb_raise(rb_eRuntimeError,
+			 "can't delete from a Skiplist during iteration");
+	}
+}
+
+
+/* {{{1
+ * call-seq: Skiplist.new(default = nil)
+ *
+ * Creates a +Skiplist+.  A default value may also be specified.
+ */
+static VALUE
+rskiplist_initialize(int argc, VALUE *argv, VALUE self)
+{
+	VALUE dflt;
+	rb_scan_args(argc, argv, "01", &dflt);
+	rb_iv_set(self, "@default", dflt);
+
+	return self;
+}
+
+
+/* {{{1
+ * Store a copy of the pairs of ‘closure’ in the list of ‘self’.
+ */
+static bool
+rskiplist_copy_pair(pointer key, pointer value, pointer closure)
+{
+	skip_list_insert((SkipList *)closure, key, value);
+
+	return true;
+}
+
+
+/* {{{1
+ * Make ‘self’ a copy of ‘orig’, for #dup and #clone.
+ */
+static VALUE
+rskiplist_initialize_copy(VALUE self, VALUE orig)
+{
+	if (self == orig) {
+		return self;
+	}
+
+	RSkipList *rlist = rskiplist_get(self);
+	rskiplist_check_iterating(rlist);
+	skip_list_clear(rlist->list);
+	skip_list_map(rskiplist_get(orig)->list, rskiplist_copy_pair,
+		      rlist->list);
+	rb_iv_set(self, "@default", rb_iv_get(orig, "@default"));
+
+	return self;
+}
+
+
+/* {{{1
+ * call-seq: skiplist.store(key, value)
+ *
+ * Associates _key_ with _value_.  The value of this expression is _value_.
+ */
+static VALUE
+rskiplist_store(VALUE self, VALUE key, VALUE value)
+{
+	skip_list_insert(rskiplist_get(self)->list,
+			 (pointer)key, (pointer)value);
+
+	return value;
+}
+
+
+/* {{{1
+ * call-seq: skiplist.fetch(key, ifnone = nil)
+ *
+ * Returns the value associated with _key_.  If the _key_ isn't present in
+ * the Skiplist, the value of the block is returned.  If no block is
+ * specified and _ifnone_ is, _ifnone_ is returned.  Else an IndexError is
+ * raised.
+ */
+static VALUE
+rskiplist_fetch(int argc, VALUE *argv, VALUE self)
+{
+	VALUE key, ifnone;
+	rb_scan_args(argc, argv, "11", &key, &ifnone);
+
+	pointer value;
+	if (skip_list_lookup_extended(rskiplist_get(self)->list,
+				      (constpointer)key, null, &value)) {
+		return (VALUE)value;
+	}
+
+	if (rb_block_given_p()) {
+		return rb_yield(key);
+	}
+	unless (NIL_P(ifnone)) {
+		return ifnone;
+	}
+
+	rb_raise(rb_eIndexError, "key not found");
+	return Qnil;
+}
+
+
+/* {{{1
+ * call-seq: skiplist.delete(key)
+ *
+ * Deletes a key-value pair with key _key_.  The stored value is returned, or
+ * +nil+ if there was no such pair.
+ */
+static VALUE
+rskiplist_delete(VALUE self, VALUE key)
+{
+	RSkipList *rlist = rskiplist_get(self);
+	rskiplist_check_iterating(rlist);
+
+	pointer value;
+	unless (skip_list_lookup_extended(rlist->list, (constpointer)key,
+					  null, &value)) {
+		return Qnil;
+	}
+	skip_list_steal(rlist->list, (constpointer)key);
+
+	return (VALUE)value;
+}
+
+
+/* {{{1
+ * call-seq: skiplist.clear
+ *
+ * Deletes all key-value pairs stored in the Skiplist.
+ */
+static VALUE
+rskiplist_clear(VALUE self)
+{
+	RSkipList *rlist = rskiplist_get(self);
+	rskiplist_check_iterating(rlist);
+	skip_list_clear(rlist->list);
+
+	return self;
+}
+
+
+/* {{{1
+ * The arguments of #each and #each_from, passed through |rb_ensure()|.
+ */
+typedef struct _SkipListEach RSkipListEach;
+
+struct _SkipListEach {
+	RSkipList *rlist;
+	SkipListCursor *start;
+	bool with_key;
+	bool with_value;
+	bool descending;
+};
+
+
+/* {{{1
+ * Yield the pairs of a Skiplist, see |rskiplist_iterate|.
+ */
+static VALUE
+rskiplist_each_yield(VALUE arg)
+{
+	RSkipListEach *each = (RSkipListEach *)arg;
+
+	for (SkipListCursor *cursor = each->start; cursor != null;
+	     cursor = each->descending ? skip_list_cursor_prev(cursor) :
+	     skip_list_cursor_next(cursor)) {
+		VALUE key = (VALUE)skip_list_cursor_key(cursor);
+		VALUE value = (VALUE)skip_list_cursor_value(cursor);
+
+		if (each->with_key && each->with_value) {
+			rb_yield_values(2, key, value);
+		} else if (each->with_key) {
+			rb_yield(key);
+		} else if (each->with_value) {
+			rb_yield(value);
+		} else {
+			rb_yield_values(0);
+		}
+	}
+
+	return Qnil;
+}
+
+
+/* {{{1
+ * Mark the end of an iteration, however it ended.
+ */
+static VALUE
+rskiplist_each_ensure(VALUE arg)
+{
+	((RSkipListEach *)arg)->rlist->iterating--;
+
+	return Qnil;
+}
+
+
+/* {{{1
+ * Yield the pairs of ‘rlist’ from ‘start’ on, in descending order if
+ * ‘descending’ is true, or else in ascending order.  The key and value are
+ * yielded as separate arguments, without allocating an Array for them, or
+ * only one of them, as given by ‘with_key’ and ‘with_value’.
+ */
+static void
+rskiplist_iterate(RSkipList *rlist, SkipListCursor *start, bool with_key,
+		  bool with_value, bool descending)
+{
+	RSkipListEach each;
+	each.rlist = rlist;
+	each.start = start;
+	each.with_key = with_key;
+	each.with_value = with_value;
+	each.descending = descending;
+
+	rlist->iterating++;
+	rb_ensure(rskiplist_each_yield, (VALUE)&each,
+		  rskiplist_each_ensure, (VALUE)&each);
+}
+
+
+/* {{{1
+ * call-seq: skiplist.each(with_key = true, with_value = true,
+ *			        order = ASCENDING) { |key, value| ... }
+ *
+ * Executes the block once for each key-value pair.  Pairs are given in the
+ * order specified by _order_, relative to the keys.  The key and the value
+ * are yielded as separate arguments, or only one of them, as specified by
+ * _with_key_ and _with_value_.  Returns an Enumerator if no block is given.
+ */
+static VALUE
+rskiplist_each(int argc, VALUE *argv, VALUE self)
+{
+	RETURN_ENUMERATOR(self, argc, argv);
+
+	VALUE with_key, with_value, order;
+	rb_scan_args(argc, argv, "03", &with_key, &with_value, &order);
+
+	RSkipList *rlist = rskiplist_get(self);
+	bool descending = (argc >= 3) && rdsl_descending_p(order);
+	rskiplist_iterate(rlist,
+			  descending ? skip_list_last(rlist->list) :
+			  skip_list_first(rlist->list),
+			  (argc < 1) || RTEST(with_key),
+			  (argc < 2) || RTEST(with_value),
+			  descending);
+
+	return self;
+}
+
+
+/* {{{1
+ * call-seq: skiplist.each_from(key, order = ASCENDING) { |key, value| ... }
+ *
+ * Executes the block once for each key-value pair, starting with the
+ * smallest key not less than _key_, if _order_ is ASCENDING, or the largest
+ * key not greater than _key_, if it's DESCENDING.  Finding the first pair
+ * takes O(log n) time.  Returns an Enumerator if no block is given.
+ */
+static VALUE
+rskiplist_each_from(int argc, VALUE *argv, VALUE self)
+{
+	RETURN_ENUMERATOR(self, argc, argv);
+
+	VALUE key, order;
+	rb_scan_args(argc, argv, "11", &key, &order);
+
+	RSkipList *rlist = rskiplist_get(self);
+	SkipListCursor *start;
+	bool descending = (argc >= 2) && rdsl_descending_p(order);
+	if (descending) {
+		start = skip_list_upper_bound(rlist->list, (constpointer)key);
+		start = (start != null) ? skip_list_cursor_prev(start) :
+			skip_list_last(rlist->list);
+	} else {
+		start = skip_list_lower_bound(rlist->list, (constpointer)key);
+	}
+	rskiplist_iterate(rlist, start, true, true, descending);
+
+	return self;
+}
+
+
+/* {{{1
+ * call-seq: skiplist.load_sorted(keys, values)
+ *
+ * Replaces the contents of the Skiplist with the pairs of _keys_ and
+ * _values_, where _keys_ must be in strictly ascending order, or an
+ * ArgumentError is raised.  The list is built in O(n) time, comparing each
+ * key only with the one before it.  Returns the Skiplist.
+ */
+static VALUE
+rskiplist_load_sorted(VALUE self, VALUE keys, VALUE values)
+{
+	RSkipList *rlist = rskiplist_get(self);
+	rskiplist_check_iterating(rlist);
+	rdsl_check_sorted(keys, values);
+
+	long n = RARRAY_LEN(keys);
+	pointer *k = new_array(pointer, n + 1);
+	pointer *v = new_array(pointer, n + 1);
+	for (long i = 0; i < n; i++) {
+		k[i] = (pointer)rb_ary_entry(keys, i);
+		v[i] = (pointer)rb_ary_entry(values, i);
+	}
+
+	skip_list_release(rlist->list);
+	rlist->list = skip_list_new_from_sorted(k, v, n, rdsl_compare, null,
+						null, null);
+	release(k);
+	release(v);
+
+	return self;
+}
+
+
+/* {{{1
+ * call-seq: skiplist.length
+ *
+ * Returns the number of key-value pairs in the Skiplist.
+ */
+static VALUE
+rskiplist_length(VALUE self)
+{
+	return INT2NUM(skip_list_size(rskiplist_get(self)->list));
+}
+
+
+/* {{{1
+ * Define the native RDSL::Skiplist.  The Ruby implementation has already
+ * defined the class and the methods that have no native implementation, so
+ * we only add the ones that do, replacing their Ruby counterparts.
+ */
+void
+rdsl_init_skiplist(void)
+{
+	cSkiplist = rb_define_class_under(mRDSL, "Skiplist", rb_cObject);
+	rb_include_module(cSkiplist, mSortedAssociation);
+	rb_define_const(cSkiplist, "NATIVE", Qtrue);
+
+	rb_define_alloc_func(cSkiplist, rskiplist_alloc);
+	rb_define_method(cSkiplist, "initialize", rskiplist_initialize, -1);
+	rb_define_method(cSkiplist, "initialize_copy",
+			 rskiplist_initialize_copy, 1);
+	rb_define_method(cSkiplist, "store", rskiplist_store, 2);
+	rb_define_method(cSkiplist, "fetch", rskiplist_fetch, -1);
+	rb_define_method(cSkiplist, "delete", rskiplist_delete, 1);
+	rb_define_method(cSkiplist, "clear", rskiplist_clear, 0);
+	rb_define_method(cSkiplist, "load_sorted", rskiplist_load_sorted, 2);
+	rb_define_method(cSkiplist, "each", rskiplist_each, -1);
+	rb_define_method(cSkiplist, "each_from", rskiplist_each_from, -1);
+	rb_define_method(cSkiplist, "length", rskiplist_length, 0);
+	rb_define_method(cSkiplist, "size", rskiplist_length, 0);
+}
+
+
+/* }}}1 */
+
+
+
+/* vim: set sts=0 sw=8 ts=8: */
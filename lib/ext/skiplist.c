@@ -0,0 +1,759 @@
+/*
+ * contents: Skiplist ADT.
+ * arch-tag: 053135fe-49e6-400a-8b23-a81cd0bd63db
+ *
+ * Copyright (C) 2004 Nikolai Weibull <source@pcppopper.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+
+#include <stdint.h>
+#include <clear/internal.h>
+#include <clear/mem.h>
+#include "skiplist.h"
+
+
+/* {{{1
+ * The maximum height of a node.  With the probability below, this is enough
+ * for 4^32 nodes.
+ */
+#define SKIP_LIST_MAX_HEIGHT	32
+
+
+/* {{{1
+ * A node in the list.  The ‘forward’ pointers are allocated inline with the
+ * node itself, one per level the node is part of, so a node is a single
+ * allocation and following a link touches only the memory of the node it
+ * leads to.  ‘backward’ points to the previous node on the lowest level, or
+ * is ‹null› for the first node, so that we can walk the list backwards.
+ */
+typedef struct _SkipListNode SkipListNode;
+
+struct _SkipListNode {
+	pointer key;
+	pointer value;
+	SkipListNode *backward;
+	int height;
+	SkipListNode *forward[];
+};
+
+
+/* {{{1
+ * Our skiplist structure.  ‘head’ is a node without key or value that is
+ * part of every level, and ‘tail’ is the last node of the list, or ‹null› if
+ * it's empty.  ‘height’ is the number of levels currently in use.  ‘random’
+ * is the state of our random number generator, see
+ * |skip_list_random_height|.  ‘finger’ is the last node on each level whose
+ * key isn't greater than the key last inserted or removed, which is where
+ * |skip_list_find| starts its searches from.  Only modifications move it, so
+ * that lookups don't write to the list, and any number of threads may look
+ * things up in a list that isn't being modified.
+ */
+struct _SkipList {
+	CompareDataFunc key_compare;
+	pointer key_compare_data;
+	ReleaseNotify key_release;
+	ReleaseNotify value_release;
+	SkipListNode *head;
+	SkipListNode *tail;
+	int height;
+	int size;
+	uint32_t random;
+	SkipListNode *finger[SKIP_LIST_MAX_HEIGHT];
+};
+
+
+/* {{{1
+ * Allocate a new node of height ‘height’.
+ */
+static SkipListNode *
+skip_list_node_new(pointer key, pointer value, int height)
+{
+	SkipListNode *node = (SkipListNode *)new_array(char,
+		sizeof(SkipListNode) + height * sizeof(SkipListNode *));
+	node->key = key;
+	node->value = value;
+	node->backward = null;
+	node->height = height;
+	for (int i = 0; i < height; i++) {
+		node->forward[i] = null;
+	}
+
+	return node;
+}
+
+
+/* {{{1
+ * Release ‘node’, calling the release-notify functions of ‘list’ on its key
+ * and value if ‘notify’ is true.
+ */
+static void
+skip_list_node_release(SkipList *list, SkipListNode *node, bool notify)
+{
+	if (notify) {
+		unless (list->key_release == null) {
+			list->key_release(node->key);
+		}
+		unless (list->value_release == null) {
+			list->value_release(node->value);
+		}
+	}
+	release(node);
+}
+
+
+/* {{{1
+ * Pick a height for a new node.  Each level is reached with probability 1/4,
+ * which gives lists that are about as fast to search as with 1/2, but with
+ * half as many forward pointers.  We use a xorshift generator, which is more
+ * than random enough for this, and take two bits at a time from it.
+ */
+static int
+skip_list_random_height(SkipList *list)
+{
+	uint32_t r = list->random;
+	r ^= r << 13;
+	r ^= r >> 17;
+	r ^= r << 5;
+	list->random = r;
+
+	int height = 1;
+	while ((r & 3) == 0 && height < SKIP_LIST_MAX_HEIGHT) {
+		height++;
+		r >>= 2;
+	}
+
+	return height;
+}
+
+
+/* {{{1
+ * Point the finger of ‘list’ at its head on all levels, as is done when
+ * there's no last key.
+ */
+static void
+skip_list_reset_finger(SkipList *list)
+{
+	for (int i = 0; i < SKIP_LIST_MAX_HEIGHT; i++) {
+		list->finger[i] = list->head;
+	}
+}
+
+
+/* {{{1
+ * Set the finger of ‘list’ to the nodes in ‘update’ on the levels in use, and
+ * to the head above them.  This is only done once a modification is done
+ * with comparing keys, as the comparison function may not return, as when a
+ * Ruby <=> raises an exception, and the finger must be right all the time.
+ */
+static void
+skip_list_set_finger(SkipList *list, SkipListNode **update)
+{
+	for (int i = 0; i < SKIP_LIST_MAX_HEIGHT; i++) {
+		list->finger[i] = (i < list->height) ? update[i] : list->head;
+	}
+}
+
+
+/* {{{1
+ * Create a new skiplist.  The list will sort keys according to ‘key_compare’,
+ * which works in the same manner as the ANSI C standard library function
+ * |strcmp()| does.
+ */
+SkipList *
+skip_list_new(CompareFunc key_compare)
+{
+	invariant(key_compare != null);
+
+	return skip_list_new_full((CompareDataFunc)key_compare,
+				  null, null, null);
+}
+
+
+/* {{{1
+ * Create a new skiplist with a comparison function that takes an additional
+ * argument, which will be ‘key_compare_data’.  Otherwise, same as
+ * |skip_list_new|.
+ */
+SkipList *
+skip_list_new_with_data(CompareDataFunc key_compare,
+			pointer key_compare_data)
+{
+	invariant(key_compare != null);
+
+	return skip_list_new_full(key_compare, key_compare_data, null, null);
+}
+
+
+/* {{{1
+ * Create a new skiplist with the same arguments as |skip_list_new_with_data|,
+ * but with two free-notify functions as well.  These work just like the ones
+ * of |rb_tree_new_full|.
+ */
+SkipList *
+skip_list_new_full(CompareDataFunc key_compare,
+		   pointer key_compare_data,
+		   ReleaseNotify key_release,
+		   ReleaseNotify value_release)
+{
+	invariant(key_compare != null);
+
+	SkipList *list = new_struct(SkipList);
+	list->key_compare = key_compare;
+	list->key_compare_data = key_compare_data;
+	list->key_release = key_release;
+	list->value_release = value_release;
+	list->head = skip_list_node_new(null, null, SKIP_LIST_MAX_HEIGHT);
+	list->tail = null;
+	list->height = 1;
+	list->size = 0;
+	list->random = (uint32_t)(uintptr_t)list | 1;
+	skip_list_reset_finger(list);
+
+	return list;
+}
+
+
+/* {{{1
+ * Create a new skiplist, taking the same arguments as |skip_list_new_full|,
+ * filled with the ‘n’ key/value pairs in ‘keys’ and ‘values’.  ‘keys’ must
+ * be sorted in strictly increasing order according to ‘key_compare’.
+ * ‘values’ may be ‹null›, in which case all values will be ‹null›.  As the
+ * nodes come in order, each one is linked in right after the last node on
+ * each of its levels, so this takes O(n) time, without doing any
+ * comparisons.
+ */
+SkipList *
+skip_list_new_from_sorted(pointer *keys,
+			  pointer *values,
+			  size_t n,
+			  CompareDataFunc key_compare,
+			  pointer key_compare_data,
+			  ReleaseNotify key_release,
+			  ReleaseNotify value_release)
+{
+	invariant(keys != null || n == 0);
+
+	SkipList *list = skip_list_new_full(key_compare, key_compare_data,
+					    key_release, value_release);
+
+	SkipListNode *last[SKIP_LIST_MAX_HEIGHT];
+	for (int i = 0; i < SKIP_LIST_MAX_HEIGHT; i++) {
+		last[i] = list->head;
+	}
+
+	for (size_t i = 0; i < n; i++) {
+		int height = skip_list_random_height(list);
+		SkipListNode *node = skip_list_node_new(keys[i],
+				(values != null) ? values[i] : null, height);
+
+		unless (last[0] == list->head) {
+			node->backward = last[0];
+		}
+		for (int j = 0; j < height; j++) {
+			last[j]->forward[j] = node;
+			last[j] = node;
+		}
+		list->height = MAX(list->height, height);
+	}
+
+	unless (last[0] == list->head) {
+		list->tail = last[0];
+	}
+	list->size = n;
+	for (int i = 0; i < SKIP_LIST_MAX_HEIGHT; i++) {
+		list->finger[i] = last[i];
+	}
+
+	return list;
+}
+
+
+/* {{{1
+ * Remove all nodes from ‘list’, freeing keys and values if applicable.
+ */
+void
+skip_list_clear(SkipList *list)
+{
+	invariant(list != null);
+
+	SkipListNode *node = list->head->forward[0];
+	until (node == null) {
+		SkipListNode *next = node->forward[0];
+		skip_list_node_release(list, node, true);
+		node = next;
+	}
+
+	for (int i = 0; i < SKIP_LIST_MAX_HEIGHT; i++) {
+		list->head->forward[i] = null;
+	}
+	list->tail = null;
+	list->height = 1;
+	list->size = 0;
+	skip_list_reset_finger(list);
+}
+
+
+/* {{{1
+ * Release a |SkipList|.  This frees all nodes in the list as well, and if
+ * release-notify functions exist for this list, memory associated with keys
+ * and values will also be released.
+ */
+void
+skip_list_release(SkipList *list)
+{
+	invariant(list != null);
+
+	skip_list_clear(list);
+	release(list->head);
+	release(list);
+}
+
+
+/* {{{1
+ * Find the first node whose key isn't less than ‘key’, or ‹null› if there's
+ * no such node.  If ‘update’ is non-‹null›, it's filled in with the last node
+ * before that one on each level in use, which is where a new node with ‘key’
+ * would be linked in.  A node we reach on several levels is compared with
+ * ‘key’ only once, as ‘last’ remembers the node we stopped at on the level
+ * above.  Nothing in ‘list’ is changed, see |skip_list_set_finger|.
+ *
+ * This is a finger search: rather than from the top of the head, we search
+ * down from the lowest level of the finger that is right for ‘key’ as well,
+ * that is, whose node is before ‘key’ and whose next node isn't.  The finger
+ * is then still right on the levels above.  If ‘key’ is after the finger on
+ * the lowest level, the finger nodes are all before it, so we climb until
+ * the next node isn't, and if it's not, the next nodes are all after it, so
+ * we climb until the finger node is before it.  Either way, this takes
+ * O(log d) time, d being the number of nodes between the two keys, so
+ * sequential and nearly sorted keys, such as appends at the tail, are found
+ * in about constant time.  Random keys take O(log n) time, as usual, but
+ * with a few more comparisons, about a quarter more, than a search from the
+ * head.
+ */
+static SkipListNode *
+skip_list_find(SkipList *list, constpointer key, SkipListNode **update)
+{
+	SkipListNode *iter = list->head;
+	SkipListNode *last = null;
+	int i = list->height - 1;
+
+	SkipListNode *finger = list->finger[0];
+	if (finger == list->head) {
+		/* no finger, so search from the head */
+	} else if (list->key_compare(finger->key, key,
+				     list->key_compare_data) < 0) {
+		for (i = 0; i < list->height - 1; i++) {
+			SkipListNode *next = list->finger[i]->forward[i];
+			if (next == null ||
+			    list->key_compare(next->key, key,
+					      list->key_compare_data) >= 0) {
+				last = next;
+				break;
+			}
+		}
+		iter = list->finger[i];
+	} else {
+		for (i = 1; i < list->height; i++) {
+			finger = list->finger[i];
+			if (finger == list->head ||
+			    list->key_compare(finger->key, key,
+					      list->key_compare_data) < 0) {
+				iter = finger;
+				break;
+			}
+		}
+		i = MIN(i, list->height - 1);
+	}
+	for (int j = i + 1; update != null && j < list->height; j++) {
+		update[j] = list->finger[j];
+	}
+
+	for (; i >= 0; i--) {
+		SkipListNode *next;
+		while ((next = iter->forward[i]) != null && next != last &&
+		       list->key_compare(next->key, key,
+					 list->key_compare_data) < 0) {
+			iter = next;
+		}
+		last = next;
+		unless (update == null) {
+			update[i] = iter;
+		}
+	}
+
+	return iter->forward[0];
+}
+
+
+/* {{{1
+ * Check if ‘node’, as returned by |skip_list_find|, has key ‘key’.
+ */
+static inline bool
+skip_list_node_matches(SkipList *list, SkipListNode *node, constpointer key)
+{
+	return node != null &&
+		list->key_compare(key, node->key, list->key_compare_data) == 0;
+}
+
+
+/* {{{1
+ * Insert ‘key’ and ‘value’ into ‘list’.  If ‘key’ already exists, its value
+ * is updated, and if ‘replace’ is true, its key is also replaced by ‘key’.
+ * The keys and values that get thrown away are released if applicable.
+ */
+static void
+skip_list_insert_real(SkipList *list,
+		      pointer key,
+		      pointer value,
+		      bool replace)
+{
+	SkipListNode *update[SKIP_LIST_MAX_HEIGHT];
+	SkipListNode *node = skip_list_find(list, key, update);
+
+	if (skip_list_node_matches(list, node, key)) {
+		skip_list_set_finger(list, update);
+		unless (list->key_release == null) {
+			list->key_release(replace ? node->key : key);
+		}
+		unless (list->value_release == null) {
+			list->value_release(node->value);
+		}
+		if (replace) {
+			node->key = key;
+		}
+		node->value = value;
+		return;
+	}
+
+	int height = skip_list_random_height(list);
+	for (; list->height < height; list->height++) {
+		update[list->height] = list->head;
+	}
+
+	node = skip_list_node_new(key, value, height);
+	for (int i = 0; i < height; i++) {
+		node->forward[i] = update[i]->forward[i];
+		update[i]->forward[i] = node;
+	}
+
+	unless (update[0] == list->head) {
+		node->backward = update[0];
+	}
+	if (node->forward[0] != null) {
+		node->forward[0]->backward = node;
+	} else {
+		list->tail = node;
+	}
+	for (int i = 0; i < height; i++) {
+		update[i] = node;
+	}
+	skip_list_set_finger(list, update);
+
+	list->size++;
+}
+
+
+/* {{{1
+ * Insert a key/value pair into ‘list’.  If the given key already exists it's
+ * associated value is updated.  The previous value will be freed if
+ * applicable.  ‘key’ will likewise be freed if it already existed and it is
+ * appropriate to do so.
+ */
+void
+skip_list_insert(SkipList *list, pointer key, pointer value)
+{
+	invariant(list != null);
+
+	skip_list_insert_real(list, key, value, false);
+}
+
+
+/* {{{1
+ * Works like |skip_list_insert| except that both key and value will be
+ * replaced if ‘key’ already exists.
+ */
+void
+skip_list_replace(SkipList *list, pointer key, pointer value)
+{
+	invariant(list != null);
+
+	skip_list_insert_real(list, key, value, true);
+}
+
+
+/* {{{1
+ * Return the number of nodes in ‘list’.
+ */
+int
+skip_list_size(SkipList *list)
+{
+	invariant(list != null);
+
+	return list->size;
+}
+
+
+/* {{{1
+ * Get the value associated with ‘key’ in ‘list’.  If ‘key’ doesn't exist,
+ * ‹null› is returned.
+ */
+pointer
+skip_list_lookup(SkipList *list, constpointer key)
+{
+	invariant(list != null);
+
+	SkipListNode *node = skip_list_find(list, key, null);
+	return skip_list_node_matches(list, node, key) ? node->value : null;
+}
+
+
+/* {{{1
+ * Works like |skip_list_lookup| except that the return value is a boolean
+ * telling whether ‘key’ was found in the list or not.  ‘orig_key’ will
+ * contain a pointer to the key found in the list and ‘value’ works likewise.
+ */
+bool
+skip_list_lookup_extended(SkipList *list,
+			  constpointer key,
+			  pointer *orig_key,
+			  pointer *value)
+{
+	invariant(list != null);
+
+	SkipListNode *node = skip_list_find(list, key, null);
+	unless (skip_list_node_matches(list, node, key)) {
+		return false;
+	}
+
+	unless (orig_key == null) {
+		*orig_key = node->key;
+	}
+	unless (value == null) {
+		*value = node->value;
+	}
+	return true;
+}
+
+
+/* {{{1
+ * Call ‘lambda’ for each node in ‘list’, in order of increasing keys,
+ * passing the key and value of the node plus ‘closure’.  The traversal stops
+ * early if ‘lambda’ returns false.
+ */
+void
+skip_list_map(SkipList *list, MappingMapFunc lambda, pointer closure)
+{
+	invariant(list != null);
+	invariant(lambda != null);
+
+	for (SkipListNode *node = list->head->forward[0]; node != null;
+	     node = node->forward[0]) {
+		unless (lambda(node->key, node->value, closure)) {
+			break;
+		}
+	}
+}
+
+
+/* {{{1
+ * Works like |skip_list_map|, but in order of decreasing keys.
+ */
+void
+skip_list_map_reverse(SkipList *list, MappingMapFunc lambda, pointer closure)
+{
+	invariant(list != null);
+	invariant(lambda != null);
+
+	for (SkipListNode *node = list->tail; node != null;
+	     node = node->backward) {
+		unless (lambda(node->key, node->value, closure)) {
+			break;
+		}
+	}
+}
+
+
+/* {{{1
+ * Unlink the node with key ‘key’ from ‘list’ and release it, freeing its key
+ * and value if ‘notify’ is true.
+ */
+static void
+skip_list_remove_real(SkipList *list, constpointer key, bool notify)
+{
+	SkipListNode *update[SKIP_LIST_MAX_HEIGHT];
+	SkipListNode *node = skip_list_find(list, key, update);
+
+	unless (skip_list_node_matches(list, node, key)) {
+		return;
+	}
+
+	for (int i = 0; i < node->height; i++) {
+		update[i]->forward[i] = node->forward[i];
+	}
+	if (node->forward[0] != null) {
+		node->forward[0]->backward = node->backward;
+	} else {
+		list->tail = node->backward;
+	}
+	while (list->height > 1 &&
+	       list->head->forward[list->height - 1] == null) {
+		list->height--;
+	}
+	skip_list_set_finger(list, update);
+
+	skip_list_node_release(list, node, notify);
+	list->size--;
+}
+
+
+/* {{{1
+ * Remove the node with the given key from ‘list’, freeing key and value if
+ * applicable.
+ */
+void
+skip_list_remove(SkipList *list, constpointer key)
+{
+	invariant(list != null);
+
+	skip_list_remove_real(list, key, true);
+}
+
+
+/* {{{1
+ * Works like |skip_list_remove|, except that the key and value of the node
+ * with key ‘key’ will not be freed even if applicable.
+ */
+void
+skip_list_steal(SkipList *list, constpointer key)
+{
+	invariant(list != null);
+
+	skip_list_remove_real(list, key, false);
+}
+
+
+/* {{{1
+ * Cursors: These work just like the cursors of |RBTree|s.  A cursor stays
+ * valid until the node it points at is removed from the list.
+ */
+
+
+/* {{{2
+ * Return a cursor pointing at the first node in ‘list’.
+ */
+SkipListCursor *
+skip_list_first(SkipList *list)
+{
+	invariant(list != null);
+
+	return list->head->forward[0];
+}
+
+
+/* {{{2
+ * Return a cursor pointing at the last node in ‘list’.
+ */
+SkipListCursor *
+skip_list_last(SkipList *list)
+{
+	invariant(list != null);
+
+	return list->tail;
+}
+
+
+/* {{{2
+ * Return a cursor pointing at the first node in ‘list’ whose key is not less
+ * than ‘key’.
+ */
+SkipListCursor *
+skip_list_lower_bound(SkipList *list, constpointer key)
+{
+	invariant(list != null);
+
+	return skip_list_find(list, key, null);
+}
+
+
+/* {{{2
+ * Return a cursor pointing at the first node in ‘list’ whose key is greater
+ * than ‘key’.
+ */
+SkipListCursor *
+skip_list_upper_bound(SkipList *list, constpointer key)
+{
+	invariant(list != null);
+
+	SkipListNode *node = skip_list_find(list, key, null);
+	return skip_list_node_matches(list, node, key) ?
+		node->forward[0] : node;
+}
+
+
+/* {{{2
+ * Move ‘cursor’ to the node following it.
+ */
+SkipListCursor *
+skip_list_cursor_next(SkipListCursor *cursor)
+{
+	invariant(cursor != null);
+
+	return cursor->forward[0];
+}
+
+
+/* {{{2
+ * Move ‘cursor’ to the node preceding it.
+ */
+SkipListCursor *
+skip_list_cursor_prev(SkipListCursor *cursor)
+{
+	invariant(cursor != null);
+
+	return cursor->backward;
+}
+
+
+/* {{{2
+ * Return the key of the node ‘cursor’ is pointing at.
+ */
+pointer
+skip_list_cursor_key(SkipListCursor *cursor)
+{
+	invariant(cursor != null);
+
+	return cursor->key;
+}
+
+
+/* {{{2
+ * Return the value of the node ‘cursor’ is pointing at.
+ */
+pointer
+skip_list_cursor_value(SkipListCursor *cursor)
+{
+	invariant(cursor != null);
+
+	return cursor->value;
+}
+
+
+/* }}}1 */
+
+
+
+/* vim: set sts=0 sw=8 ts=8: */
@@ -0,0 +1,78 @@
+/*
+ * contents: Skiplist ADT.
+ * arch-tag: 2779efdb-3d16-4370-a3d9-3449164f4262
+ *
+ * Copyright (C) 2004 Nikolai Weibull <source@pcppopper.org>
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ * 
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ * 
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+
+
+#ifndef SKIPLIST_H
+#define SKIPLIST_H
+
+
+typedef struct _SkipList SkipList;
+typedef struct _SkipListNode SkipListCursor;
+
+
+SkipList *skip_list_new(CompareFunc key_compare);
+SkipList *skip_list_new_with_data(CompareDataFunc key_compare,
+				  pointer key_compare_data);
+SkipList *skip_list_new_full(CompareDataFunc key_compare,
+			     pointer key_compare_data,
+			     ReleaseNotify key_release,
+			     ReleaseNotify value_release);
+SkipList *skip_list_new_from_sorted(pointer *keys,
+				    pointer *values,
+				    size_t n,
+				    CompareDataFunc key_compare,
+				    pointer key_compare_data,
+				    ReleaseNotify key_release,
+				    ReleaseNotify value_release);
+void skip_list_release(SkipList *list);
+void skip_list_clear(SkipList *list);
+
+void skip_list_insert(SkipList *list, pointer key, pointer value);
+void skip_list_replace(SkipList *list, pointer key, pointer value);
+int skip_list_size(SkipList *list);
+pointer skip_list_lookup(SkipList *list, constpointer key);
+bool skip_list_lookup_extended(SkipList *list,
+			       constpointer key,
+			       pointer *orig_key,
+			       pointer *value);
+void skip_list_map(SkipList *list, MappingMapFunc lambda, pointer closure);
+void skip_list_map_reverse(SkipList *list,
+			   MappingMapFunc lambda,
+			   pointer closure);
+void skip_list_remove(SkipList *list, constpointer key);
+void skip_list_steal(SkipList *list, constpointer key);
+
+SkipListCursor *skip_list_first(SkipList *list);
+SkipListCursor *skip_list_last(SkipList *list);
+SkipListCursor *skip_list_lower_bound(SkipList *list, constpointer key);
+SkipListCursor *skip_list_upper_bound(SkipList *list, constpointer key);
+SkipListCursor *skip_list_cursor_next(SkipListCursor *cursor);
+SkipListCursor *skip_list_cursor_prev(SkipListCursor *cursor);
+pointer skip_list_cursor_key(SkipListCursor *cursor);
+pointer skip_list_cursor_value(SkipListCursor *cursor);
+
+
+#endif /* SKIPLIST_H */
+
+
+
+/* vim: set sts=0 sw=8 ts=8: */
@@ -66,8 +66,11 @@ module Association
 
 	# Returns an array of all keys in the Association.
 	def keys
-		keys = []
-		each_key do |key| keys << key end
+		keys, i = Array.new(length), 0
+		each_key do |key|
+			keys[i] = key
+			i += 1
+		end
 		return keys
 	end
 
@@ -132,8 +135,11 @@ module Association
 
 	# Returns an array of all values in the Container.
 	def values
-		values = []
-		each_value do |v| values << v end
+		values, i = Array.new(length), 0
+		each_value do |v|
+			values[i] = v
+			i += 1
+		end
 		return values
 	end
 
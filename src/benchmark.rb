@@ -0,0 +1,401 @@
+require 'optparse'
+require 'treap'
+require 'skiplist'
+require 'stringsearch'
+begin
+	require 'redblacktree'
+rescue LoadError
+end
+
+module RDSL
+
+# Benchmarks of the ADTs and string searches of RDSL, and of their Ruby
+# built-in equivalents, Hash, Array, and String#index.  The ADTs are run
+# through sequential, random, and Zipfian sequences of keys of a number of
+# sizes, and the string searches count all occurrences of a needle in random
+# texts.  The native classes are included if the extension is in the load
+# path, see lib/ext/extconf.rb.  Run it from the src directory:
+#
+#   ruby -I. -I../lib/ext benchmark.rb [options]
+#
+# Each result is written as a line of tab-separated FIELDS, after a line
+# naming them, so that the output is easy to read into other tools, and so
+# that the results of two runs, say of two releases, can be compared with
+# --compare.  For the ADTs, an operation is a call of the method named by
+# the operation, or a step of the iteration for +each+, and for the string
+# searches, it's a byte of the text.  Allocations are the number of objects
+# allocated per operation, and the peak is how far the resident set size of
+# the process rose above what it was before the benchmark, in kilobytes,
+# when this Ruby and platform can tell us, or "-" when they can't.  The
+# benchmark is run once more in a forked child for the peak, so that each
+# benchmark's figure is its own, see Benchmarks.peak.
+module Benchmarks
+	# The fields of each result.
+	FIELDS = %w[benchmark workload size operation ns_per_op allocations
+		    peak_kb]
+
+	# The seed that all random workloads are generated from, so that each
+	# run sees the same ones.
+	SEED = 2004
+
+	# The sizes that are run if no others are given.
+	SIZES = [1_000, 10_000, 100_000]
+
+	# The workloads of the ADTs.
+	WORKLOADS = %w[sequential random zipfian]
+
+	# The workloads of the string searches, and the alphabets of their
+	# texts.
+	TEXTS = { 'dna' => 'ACGT',
+		  'ascii' => (32..126).map { |c| c.chr }.join }
+
+	# The texts of the string searches are this many times as long as the
+	# size.
+	TEXT_SCALE = 100
+
+	# The pure Ruby string searches are only run up to this size of text,
+	# as they'd take forever otherwise.
+	RUBY_TEXT_LIMIT = 1_000_000
+
+	# Returns a monotonic time in seconds.
+	def Benchmarks.now
+		if defined? Process::CLOCK_MONOTONIC
+			Process.clock_gettime Process::CLOCK_MONOTONIC
+		else
+			Time.now.to_f
+		end
+	end
+
+	# Returns the number of objects allocated so far, or +nil+ if this Ruby
+	# can't tell.
+	def Benchmarks.allocations
+		if GC.respond_to? :stat and GC.stat.key? :total_allocated_objects
+			return GC.stat[:total_allocated_objects]
+		end
+		return nil
+	end
+
+	# Returns the current and the peak resident set size of the process in
+	# kilobytes, or +nil+ if they can't be found out.
+	def Benchmarks.rss
+		rss = hwm = nil
+		File.open '/proc/self/status' do |file|
+			file.each_line do |line|
+				rss = line.split[1].to_i if line =~ /^VmRSS:/
+				hwm = line.split[1].to_i if line =~ /^VmHWM:/
+			end
+		end
+		return (rss and hwm) ? [rss, hwm] : nil
+	rescue SystemCallError
+		return nil
+	end
+
+	# Runs the block in a forked child and returns how many kilobytes the
+	# resident set size of the child peaked above what it was before the
+	# block, or +nil+ if this Ruby and platform can't tell.  The peak of a
+	# child starts out at its size when it's forked, and the child is
+	# thrown away with the block's garbage, so the peak isn't affected by
+	# earlier benchmarks, nor the benchmarks that follow by this one.
+	def Benchmarks.peak
+		return nil unless Process.respond_to? :fork and rss
+		reader, writer = IO.pipe
+		pid = fork do
+			begin
+				reader.close
+				# the first read allocates what the rest need
+				rss
+				before = rss[0]
+				yield
+				writer.puts rss[1] - before
+			rescue Exception
+				# the parent reports the error when it runs the block
+			ensure
+				exit! 0
+			end
+		end
+		writer.close
+		growth = reader.read
+		reader.close
+		Process.wait pid
+		return growth.empty? ? nil : growth.to_i
+	rescue NotImplementedError
+		return nil
+	end
+
+	# Runs the block, which does _ops_ operations, and returns the result
+	# as an Array of FIELDS.
+	def Benchmarks.measure(benchmark, workload, size, operation, ops,
+			       &block)
+		GC.start
+		grown = peak(&block)
+		allocated = allocations
+		start = now
+		yield
+		elapsed = now - start
+		allocated = allocations - allocated if allocated
+		ops = 1 if ops < 1
+		return [benchmark, workload, size, operation,
+			(elapsed * 1e9 / ops).round,
+			allocated ? format('%.2f', allocated.to_f / ops) : '-',
+			grown || '-']
+	end
+
+	# Returns _n_ keys drawn from a Zipfian distribution over _n_ distinct
+	# keys, so that the k'th most common key is drawn about 1/k times as
+	# often as the most common one.  The keys are shuffled, so that the
+	# common ones aren't also the smallest ones.
+	def Benchmarks.zipfian(n)
+		cdf, sum = Array.new(n), 0.0
+		n.times do |k|
+			sum += 1.0 / (k + 1)
+			cdf[k] = sum
+		end
+		ranks = (0...n).sort_by { rand }
+		return Array.new(n) do
+			r, lo, hi = rand * sum, 0, n - 1
+			while lo < hi
+				mid = (lo + hi) / 2
+				if cdf[mid] < r then lo = mid + 1 else hi = mid end
+			end
+			ranks[lo]
+		end
+	end
+
+	# Returns _n_ keys for _workload_.
+	def Benchmarks.keys(workload, n)
+		srand SEED
+		case workload
+		when 'sequential' then return (0...n).to_a
+		when 'random' then return (0...n).sort_by { rand }
+		when 'zipfian' then return zipfian(n)
+		end
+	end
+
+	# Returns the associations to benchmark, as pairs of names and classes.
+	def Benchmarks.associations
+		assocs = [['Hash', Hash], ['RDSL::Treap', Treap]]
+		assocs << [RDSL::Skiplist.const_defined?(:NATIVE) ?
+			'RDSL::Skiplist (native)' : 'RDSL::Skiplist', Skiplist]
+		if defined? RDSL::RedBlackTree
+			assocs << ['RDSL::RedBlackTree (native)', RedBlackTree]
+		end
+		return assocs
+	end
+
+	# Benchmarks storing, fetching, iterating over in sorted order, and
+	# deleting _keys_ in a new _klass_.  A Hash is sorted by its keys,
+	# which is what it takes to iterate over it in order.
+	def Benchmarks.association(name, klass, workload, keys)
+		n, assoc, results = keys.size, klass.new, []
+		results << measure(name, workload, n, 'store', n) do
+			keys.each do |key| assoc.store key, key end
+		end
+		results << measure(name, workload, n, 'fetch', n) do
+			keys.each do |key| assoc.fetch key end
+		end
+		results << measure(name, workload, n, 'each', assoc.length) do
+			if assoc.is_a? Hash
+				assoc.keys.sort.each do |key| assoc[key] end
+			else
+				assoc.each do |key, value| end
+			end
+		end
+		results << measure(name, workload, n, 'delete', n) do
+			keys.each do |key| assoc.delete key end
+		end
+		return results
+	end
+
+	# Benchmarks pushing _keys_ onto a priority queue and popping them all
+	# off again, with RDSL::PriorityQueue, and with an Array that is sorted
+	# before the first pop.
+	def Benchmarks.priority_queues(workload, keys)
+		n, results = keys.size, []
+		if defined? RDSL::PriorityQueue
+			name, q = 'RDSL::PriorityQueue (native)', PriorityQueue.new
+			results << measure(name, workload, n, 'push', n) do
+				keys.each do |key| q.push key end
+			end
+			results << measure(name, workload, n, 'pop', n) do
+				n.times do q.pop end
+			end
+		end
+		name, ary = 'Array (sorted)', []
+		results << measure(name, workload, n, 'push', n) do
+			keys.each do |key| ary.push key end
+		end
+		results << measure(name, workload, n, 'pop', n) do
+			ary.sort!
+			n.times do ary.shift end
+		end
+		return results
+	end
+
+	# Returns the searches to benchmark for a text of _n_ bytes, as pairs
+	# of names and lambdas that count the occurrences of a needle in a
+	# text.
+	def Benchmarks.searches(n)
+		repeat = lambda do |search|
+			lambda do |text, x|
+				i, pos = 0, 0
+				while pos = search.call(text, x, pos)
+					i += 1
+					pos += 1
+				end
+				i
+			end
+		end
+		searches = [['String#index (built-in)', repeat.call(lambda do
+			|text, x, pos| text._old_index x, pos end)]]
+		if n <= RUBY_TEXT_LIMIT
+			[:bmh_index, :kmp_index, :brute].each do |method|
+				searches << ["String##{method}", repeat.call(lambda do
+					|text, x, pos| text.send method, x, pos end)]
+			end
+		end
+		if defined? RDSL::Pattern
+			[:index, :bmh_index, :kmp_index].each do |method|
+				searches << ["RDSL::Pattern##{method}", lambda do
+					|text, x|
+					pattern, i, pos = Pattern.new(x), 0, 0
+					while pos = pattern.send(method, text, pos)
+						i += 1
+						pos += 1
+					end
+					i
+				end]
+			end
+			searches << ['RDSL::Pattern#count', lambda do |text, x|
+				Pattern.new(x).count text
+			end]
+		end
+		return searches
+	end
+
+	# Benchmarks counting the occurrences of an eight byte needle in a
+	# random text of _n_ bytes over _alphabet_.  The needle is taken from
+	# the text, so that there's at least one occurrence.  A search that
+	# raises is skipped with a warning.
+	def Benchmarks.strings(workload, alphabet, n)
+		srand SEED
+		text = Array.new(n) { alphabet[rand(alphabet.length), 1] }.join
+		x = text[n / 2, 8]
+		results = []
+		searches(n).each do |name, search|
+			begin
+				results << measure(name, workload, n, 'count', n) do
+					search.call text, x
+				end
+			rescue StandardError => e
+				warn "skipping #{name}: #{e.message}"
+			end
+		end
+		return results
+	end
+
+	# Runs the benchmarks of the given _sizes_ whose names match _only_,
+	# passing each result to the block as it's done.
+	def Benchmarks.run(sizes = SIZES, only = nil, &block)
+		filter = lambda do |results|
+			results.each do |result|
+				if only.nil? or result[0] =~ only
+					block.call result
+				end
+			end
+		end
+		sizes.each do |size|
+			WORKLOADS.each do |workload|
+				ks = keys(workload, size)
+				associations.each do |name, klass|
+					next unless only.nil? or name =~ only
+					filter.call association(name, klass,
+								workload, ks)
+				end
+				filter.call priority_queues(workload, ks)
+			end
+			TEXTS.each do |workload, alphabet|
+				filter.call strings(workload, alphabet,
+						    size * TEXT_SCALE)
+			end
+		end
+	end
+
+	# Reads the results written by an earlier run from _path_, as a Hash of
+	# ns/op keyed by the benchmark, workload, size, and operation.
+	def Benchmarks.read(path)
+		baseline = {}
+		File.open path do |file|
+			file.each_line do |line|
+				fields = line.chomp.split "\t"
+				next if fields == FIELDS
+				baseline[fields[0, 4]] = fields[4].to_f
+			end
+		end
+		return baseline
+	end
+
+	# Compares _results_ to _baseline_, see Benchmarks.read, reporting
+	# each result that is more than _tolerance_ times as slow as it was as
+	# a regression.  Returns the number of regressions.
+	def Benchmarks.compare(results, baseline, tolerance)
+		regressions = 0
+		results.each do |result|
+			old = baseline[result[0, 4].map { |f| f.to_s }]
+			next if old.nil? or old == 0
+			ratio = result[4] / old
+			if ratio > tolerance
+				warn format("regression: %s: %.2fx slower " +
+					    "(%d ns/op, was %d)",
+					    result[0, 4].join(' '), ratio,
+					    result[4], old)
+				regressions += 1
+			end
+		end
+		return regressions
+	end
+end
+
+end
+
+if __FILE__ == $0
+	sizes, only, output = RDSL::Benchmarks::SIZES, nil, $stdout
+	baseline, tolerance = nil, 1.25
+	ARGV.options do |opts|
+		opts.banner = "Usage: #{$0} [options]"
+		opts.on('-s', '--sizes SIZES', Array,
+			'comma-separated sizes to run') do |s|
+			sizes = s.map { |size| Integer(size) }
+		end
+		opts.on('-b', '--only PATTERN',
+			'only run benchmarks matching PATTERN') do |pattern|
+			only = Regexp.new pattern
+		end
+		opts.on('-o', '--output FILE', 'write results to FILE') do |path|
+			output = File.open path, 'w'
+		end
+		opts.on('-c', '--compare FILE',
+			'compare with the results in FILE') do |path|
+			baseline = RDSL::Benchmarks.read path
+		end
+		opts.on('-t', '--tolerance RATIO', Float,
+			'slow-down to report as a regression ' +
+			"(default #{tolerance})") do |t|
+			tolerance = t
+		end
+		opts.parse!
+	end
+
+	output.puts RDSL::Benchmarks::FIELDS.join("\t")
+	results = []
+	RDSL::Benchmarks.run sizes, only do |result|
+		output.puts result.join("\t")
+		output.flush
+		results << result
+	end
+	output.close unless output == $stdout
+
+	if baseline and
+	   RDSL::Benchmarks.compare(results, baseline, tolerance) > 0
+		exit 1
+	end
+end
@@ -0,0 +1,90 @@
+require 'rdsl'
+
+module RDSL
+
+# The PriorityQueue class is a binary heap of items that are compared with
+# <=>, backed by the priority queue ADT in lib/ext/priorityqueue.c.  It only
+# exists when the native extension has been built, see lib/ext/extconf.rb.
+# The methods that do the actual work are defined there.
+class PriorityQueue
+	# Creates a +PriorityQueue+ of the given items.
+	def PriorityQueue.[](*items)
+		queue = PriorityQueue.new
+		items.each do |item|
+			queue.push item
+		end
+		return queue
+	end
+end
+
+end
+
+if __FILE__ == $0 or defined? RDSL::DEBUG
+	require 'test/unit'
+
+	class PriorityQueueTest < Test::Unit::TestCase
+		def setup
+			@queue = RDSL::PriorityQueue[1935, 1926, 1941, 1936, 1915]
+		end
+
+		def drain(queue)
+			items = []
+			items << queue.pop until queue.empty?
+			return items
+		end
+
+		def test_size
+			assert_equal 5, @queue.size
+			assert_equal @queue.size, @queue.length
+		end
+
+		def test_push_and_pop
+			assert_same @queue, @queue.push(1940)
+			assert_equal 1915, @queue.peek
+			assert_equal [1915, 1926, 1935, 1936, 1940, 1941],
+				drain(@queue)
+			assert_nil @queue.pop
+			assert_nil @queue.peek
+		end
+
+		class Bomb
+			include Comparable
+			attr_reader :key
+			class << self; attr_accessor :fuse; end
+			def initialize(key) @key = key end
+			def <=>(other)
+				fuse = Bomb.fuse
+				raise "boom" if fuse and (Bomb.fuse = fuse - 1) == 0
+				@key <=> other.key
+			end
+		end
+
+		# Each pop that doesn't raise on the first two comparisons has
+		# moved an item a level, and each push that doesn't raise on the
+		# first, so these raise in the middle of sifts.
+		def test_raising_compare
+			srand 2004
+			[:pop, :push].each do |operation|
+				100.times do
+					items = Array.new(100) { Bomb.new rand(500) }
+					queue = RDSL::PriorityQueue[*items]
+					expected = items.map { |item| item.key }.sort
+					Bomb.fuse = 3 + rand(10)
+					begin
+						if operation == :pop
+							queue.pop
+							expected.shift
+						else
+							queue.push Bomb.new(-1)
+							expected.unshift(-1)
+						end
+					rescue RuntimeError
+					end
+					Bomb.fuse = nil
+					keys = drain(queue).map { |item| item.key }
+					assert_equal expected, keys
+				end
+			end
+		end
+	end
+end
@@ -0,0 +1,172 @@
+require 'sortedassociation'
+require 'rdsl'
+
+module RDSL
+
+# The RedBlackTree class is a SortedAssociation backed by the red-black tree
+# ADT in lib/ext/redblack.c.  It has the same interface as Treap and Skiplist,
+# but only exists when the native extension has been built, see
+# lib/ext/extconf.rb.  The methods that do the actual work are defined there.
+class RedBlackTree
+	include SortedAssociation
+
+	# The default value for non-existent keys.
+	attr_accessor :default
+
+	# Creates a +RedBlackTree+. Each successive pair is treated as a
+	# key-value pair.
+	def RedBlackTree.[](*ary)
+		raise ArgumentError, "odd number args to RedBlackTree" if
+						ary.size % 2 != 0
+		tree = RedBlackTree.new
+		0.step(ary.size - 2, 2) do |i|
+			tree.store ary[i], ary[i + 1]
+		end
+		return tree
+	end
+
+	# Returns a string representation of the RedBlackTree.
+	def to_s
+		str = ""
+		each do |key, value|
+			str << "[ #{key}: #{value} ]->"
+		end
+		str[0..-3]
+	end
+end
+
+end
+
+if __FILE__ == $0 or defined? RDSL::DEBUG
+	require 'test/unit'
+
+	class RedBlackTreeTest < Test::Unit::TestCase
+		def setup
+			@tree = RDSL::RedBlackTree[1935, "Elvis Presley",
+						   1926, "Chuck Berry",
+						   1941, "Bob Dylan",
+						   1936, "Roy Orbison",
+						   1915, "Muddy Waters"]
+		end
+
+		def test_create
+			assert_not_nil @tree,
+				"RedBlackTree#[] didn't create a RedBlackTree"
+		end
+
+		def test_size
+			assert_equal 5, @tree.size
+			assert_equal @tree.size, @tree.length
+		end
+
+		def test_fetch
+			assert_equal "Elvis Presley", @tree.fetch(1935)
+			assert_equal @tree.fetch(1935), @tree[1935]
+			assert_raises(IndexError) { @tree.fetch 1940 }
+			assert_equal "none", @tree.fetch(1940, "none")
+		end
+
+		def test_delete
+			assert_equal "Bob Dylan", @tree.delete(1941)
+			assert_nil @tree.delete(1941)
+			assert_equal 4, @tree.size
+		end
+
+		def test_each_order
+			keys = []
+			@tree.each_pair { |key, value| keys << key }
+			assert_equal [1915, 1926, 1935, 1936, 1941], keys
+			keys = []
+			@tree.each_pair(RDSL::SortedAssociation::DESCENDING) do
+				|key, value| keys << key
+			end
+			assert_equal [1941, 1936, 1935, 1926, 1915], keys
+		end
+
+		def test_each_from
+			keys = []
+			@tree.each_from(1930) { |key, value| keys << key }
+			assert_equal [1935, 1936, 1941], keys
+			keys = []
+			@tree.each_from(1936, RDSL::SortedAssociation::DESCENDING) do
+				|key, value| keys << key
+			end
+			assert_equal [1936, 1935, 1926, 1915], keys
+			assert_equal [[1941, "Bob Dylan"]], @tree.each_from(1940).to_a
+			assert_equal [1915, 1926, 1935, 1936, 1941], @tree.keys
+		end
+
+		def test_key_max_and_min
+			assert @tree.key?(1941)
+			assert !@tree.key?(1940)
+			assert_equal [1941, "Bob Dylan"], @tree.max
+			assert_equal [1915, "Muddy Waters"], @tree.min
+		end
+
+		def test_update_and_invert
+			other = RDSL::RedBlackTree[1926, "Little Richard",
+						1932, "Elvis Presley"]
+			assert_same @tree, @tree.update(other)
+			assert_equal [1915, 1926, 1932, 1935, 1936, 1941], @tree.keys
+			assert_equal "Little Richard", @tree.fetch(1926)
+			inverse = @tree.invert
+			assert_equal 1935, inverse.fetch("Elvis Presley")
+			assert_equal 5, inverse.size
+			@tree.replace RDSL::RedBlackTree[1, "one"]
+			assert_equal [[1, "one"]], @tree.each_pair.to_a
+		end
+
+		def test_load_sorted
+			assert_same @tree, @tree.load_sorted([1, 2, 3], [:a, :b, :c])
+			assert_equal [1, 2, 3], @tree.keys
+			assert_equal :b, @tree.fetch(2)
+			[[3, 1, 2], [1, 2, 2]].each do |keys|
+				assert_raises(ArgumentError) do
+					@tree.load_sorted keys, [:a, :b, :c]
+				end
+				assert_equal [1, 2, 3], @tree.keys
+			end
+			assert_raises(ArgumentError) { @tree.load_sorted [1, 2], [:a] }
+			assert_raises(ArgumentError) do
+				@tree.load_sorted [1, "one"], [:a, :b]
+			end
+			assert_equal [1, 2, 3], @tree.keys
+		end
+
+		def test_modify_during_each
+			assert_raises(RuntimeError) do
+				@tree.each_pair { |key, value| @tree.store 0, 0 }
+			end
+			@tree.store 0, 0
+			assert_equal 6, @tree.size
+		end
+
+		def test_clone
+			copy = @tree.clone
+			copy.store 1935, "Elvis"
+			assert_equal "Elvis Presley", @tree.fetch(1935)
+			assert_equal "Elvis", copy.fetch(1935)
+		end
+
+		def test_keys
+			tree = RDSL::RedBlackTree.new
+			tree.store :b, 2
+			tree.store :a, 1
+			tree.store :c, 3
+			keys = []
+			tree.each_pair { |key, value| keys << key }
+			assert_equal [:a, :b, :c], keys
+			assert_raises(ArgumentError) { tree.store "a", 0 }
+		end
+
+		def test_stats
+			stats = @tree.reset_stats.stats
+			return if stats.nil?
+			assert_equal 0, stats[:searches]
+			@tree.fetch 1935
+			stats = @tree.stats
+			assert_equal 1, stats[:searches]
+			assert_equal stats[:comparisons], stats[:depths].index(1)
+		end
+	end
+end
@@ -19,6 +19,7 @@ class Skiplist
 		@tail = Node.new nil, nil, -1
 		@tail.backward = @tail.pred = @head
 		@head.forward[0] = @tail
+		@finger = @head
 	end
 
 	# Creates a +Skiplist+. Each successive pair is treated as a key-value
@@ -61,6 +62,7 @@ class Skiplist
 			end
 
 			new_node.backward = node
+			@finger = new_node
 			@size += 1
 		else
 			# simply update the stored value
@@ -75,7 +77,7 @@ class Skiplist
 	# is raised.
 	def fetch(key, ifnone = nil)
 		node = search_impl key
-		return node.value if node != @tail
+		return node.value if node != @tail and node.key == key
 		if block_given?
 			yield key
 		elsif ifnone != nil
@@ -90,6 +92,8 @@ class Skiplist
 		@head.true_height = 0
 		@head.forward[0] = @tail
 		@tail.backward = @tail.pred = @head
+		@finger = @head
+		@size = 0
 		return self
 	end
 
@@ -97,43 +101,90 @@ class Skiplist
 	# returned.
 	def delete(key)
 		rm_node = search_impl key
-		return nil if rm_node == @tail
+		return nil if rm_node == @tail or rm_node.key != key
 		node = rm_node.backward
 		tmp = nil
 		rm_node.height.downto 0 do |i|
 			node = node.forward[i] while node.forward[i] != rm_node
 			tmp = rm_node.forward[i]
-			node.forward = tmp
+			node.forward[i] = tmp
 			tmp.backward = node if tmp.height == i
 		end
 		tmp.pred = node
+		@finger = node
 		@size -= 1
 		return rm_node.value
 	end
 
 	# Executes the block once for each key-value pair.  Pairs are given in
-	# the order specified by _order_, relative to the keys.
+	# the order specified by _order_, relative to the keys.  The key and the
+	# value are yielded as separate arguments, or only one of them, as
+	# specified by _with_key_ and _with_value_.  Returns an Enumerator if
+	# no block is given.
 	def each(with_key = true, with_value = true, order = ASCENDING)
-		# FIXME: make this prettier
-		if order == ASCENDING
-			node = @head.forward[0]
-			while node != @tail
-				info = []
-				info << node.key if with_key
-				info << node.value if with_value
-				yield info
-				node = node.forward[0]
+		unless block_given?
+			return enum_for(:each, with_key, with_value, order)
+		end
+		first = (order == ASCENDING) ? @head.forward[0] : @tail.pred
+		if with_key and with_value
+			each_node first, order do |node|
+				yield node.key, node.value
 			end
+		elsif with_key
+			each_node first, order do |node| yield node.key end
+		elsif with_value
+			each_node first, order do |node| yield node.value end
 		else
-			node = @tail.pred
-			while node != @head
-				info = []
-				info << node.key if with_key
-				info << node.value if with_value
-				yield info
-				node = node.pred
+			each_node first, order do |node| yield end
+		end
+		return self
+	end
+
+	# Executes the block once for each key-value pair, starting at _key_,
+	# see SortedAssociation#each_from.  Finding the first pair takes
+	# O(log n) time.
+	def each_from(key, order = ASCENDING)
+		return enum_for(:each_from, key, order) unless block_given?
+		node = @head
+		@head.true_height.downto 0 do |h|
+			while (tmp = node.forward[h]) != @tail and
+			      (order == ASCENDING ? tmp.key < key : !(tmp.key > key))
+				node = tmp
+			end
+		end
+		first = (order == ASCENDING) ? node.forward[0] : node
+		each_node first, order do |n| yield n.key, n.value end
+		return self
+	end
+
+	# Replaces the contents of the Skiplist with the pairs of _keys_ and
+	# _values_, where _keys_ must be in strictly ascending order, see
+	# SortedAssociation#load_sorted.  As the nodes come in order, each is
+	# simply linked in after the last node on each of its levels, which
+	# takes O(n) time in all.
+	def load_sorted(keys, values)
+		check_sorted keys, values
+		clear
+		last = Array.new MAX_HEIGHT + 2, @head
+		height = 0
+		keys.each_index do |i|
+			node = Node.new keys[i], values[i], random_height
+			node.pred = last[0]
+			node.backward = last[node.height]
+			0.upto node.height do |h|
+				last[h].forward[h] = node
+				last[h] = node
 			end
+			height = node.height if node.height > height
+		end
+
+		@head.true_height = (keys.empty?) ? 0 : height + 1
+		0.upto @head.true_height do |h|
+			last[h].forward[h] = @tail
 		end
+		@tail.pred = @finger = last[0]
+		@size = keys.size
+		return self
 	end
 
 	# Returns the number of key-value pairs in the Skiplist.
@@ -155,26 +206,61 @@ private
 	OPTIMAL_PROBABILITY 	= 0.25
 	MAX_HEIGHT		= 32
 
+	# Returns the first node whose key isn't less than _key_, or @tail.
+	# This is a finger search, starting from @finger, the node last
+	# accessed, rather than from the head.  If _key_ is after it, we climb
+	# forward from the finger along the top level of each node until the
+	# next node isn't before _key_, and if it isn't, we climb back along the
+	# backward links until we reach a node that is, or the head.  We then
+	# search down from there as usual.  This takes O(log d) time, d being
+	# the number of nodes between the finger and _key_, so sequential and
+	# nearly sorted keys are found in about constant time.
 	def search_impl(key)
-		h = @head.true_height
-		prev = @head
-		node = @head.forward[h]
-
-		return node if node.height >= 0 && key == node.key
-
-		h -= 1
 		@tail.key = key
+		prev, h = @head, @head.true_height
+		if @finger != @head
+			if key > @finger.key
+				prev, h = @finger, @finger.height
+				while key > (node = prev.forward[h]).key
+					prev, h = node, node.height
+				end
+			else
+				prev = @finger.backward
+				until prev == @head or key > prev.key
+					prev = prev.backward
+				end
+				h = prev.height if prev != @head
+			end
+		end
 
+		found = false
 		while h >= 0
 			node = prev.forward[h]
 			prev, node = node, node.forward[h] while key > node.key
-			break if key == node.key && node != @tail
+			found = (key == node.key && node != @tail)
+			break if found
 			h -= 1
 		end
 
+		@finger = found ? node : prev
 		return node
 	end
 
+	# Yields the nodes from _node_ on, in _order_.
+	def each_node(node, order)
+		if order == ASCENDING
+			while node != @tail
+				yield node
+				node = node.forward[0]
+			end
+		else
+			while node != @head
+				yield node
+				node = node.pred
+			end
+		end
+	end
+
 	def random_height
 		height = 0
 		while rand < OPTIMAL_PROBABILITY && height < MAX_HEIGHT
@@ -206,11 +292,18 @@ end
 
 end
 
+# Replace the methods above with the native implementation from lib/ext, if it
+# has been built.
+begin
+	require 'rdsl'
+rescue LoadError
+end
+
 if __FILE__ == $0 or defined? RDSL::DEBUG
 	require 'test/unit'
 
 	class SkiplistTest < Test::Unit::TestCase
-		def set_up
+		def setup
 			@list = RDSL::Skiplist[1935, "Elvis Presley",
 						1926, "Chuck Berry",
 						1941, "Bob Dylan",
@@ -239,6 +332,136 @@ if __FILE__ == $0 or defined? RDSL::DEBUG
 		def test_fetch
 			assert_equal "Elvis Presley", @list.fetch(1935)
 			assert_equal @list.fetch(1935), @list[1935]
+			assert_raises(IndexError) { @list.fetch 1940 }
+			assert_equal "none", @list.fetch(1940, "none")
+		end
+
+		def test_delete
+			assert_equal "Bob Dylan", @list.delete(1941)
+			assert_nil @list.delete(1941)
+			assert_nil @list.delete(1940)
+			assert_equal 4, @list.size
+			assert_raises(IndexError) { @list.fetch 1941 }
+		end
+
+		def test_each_order
+			keys = []
+			@list.each_pair { |key, value| keys << key }
+			assert_equal [1915, 1926, 1935, 1936, 1941], keys
+			keys = []
+			@list.each_pair(RDSL::SortedAssociation::DESCENDING) do
+				|key, value| keys << key
+			end
+			assert_equal [1941, 1936, 1935, 1926, 1915], keys
+			assert_equal [1915, 1926, 1935, 1936, 1941], @list.keys
+			assert_equal [1926, 1915],
+				@list.each_key(RDSL::SortedAssociation::DESCENDING).
+					select { |key| key < 1930 }
+		end
+
+		def test_each_from
+			keys = []
+			@list.each_from(1930) { |key, value| keys << key }
+			assert_equal [1935, 1936, 1941], keys
+			keys = []
+			@list.each_from(1936, RDSL::SortedAssociation::DESCENDING) do
+				|key, value| keys << key
+			end
+			assert_equal [1936, 1935, 1926, 1915], keys
+			assert_equal [[1941, "Bob Dylan"]], @list.each_from(1940).to_a
+		end
+
+		def test_key
+			assert @list.key?(1941)
+			assert !@list.key?(1940)
+			assert !@list.key?(1950)
+		end
+
+		def test_update_and_invert
+			other = RDSL::Skiplist[1926, "Little Richard",
+						1932, "Elvis Presley"]
+			assert_same @list, @list.update(other)
+			assert_equal [1915, 1926, 1932, 1935, 1936, 1941], @list.keys
+			assert_equal "Little Richard", @list.fetch(1926)
+			inverse = @list.invert
+			assert_equal 1935, inverse.fetch("Elvis Presley")
+			assert_equal 5, inverse.size
+			@list.replace RDSL::Skiplist[1, "one"]
+			assert_equal [[1, "one"]], @list.each_pair.to_a
+		end
+
+		def test_load_sorted
+			assert_same @list, @list.load_sorted([1, 2, 3], [:a, :b, :c])
+			assert_equal [1, 2, 3], @list.keys
+			assert_equal :b, @list.fetch(2)
+			[[3, 1, 2], [1, 2, 2]].each do |keys|
+				assert_raises(ArgumentError) do
+					@list.load_sorted keys, [:a, :b, :c]
+				end
+				assert_equal [1, 2, 3], @list.keys
+			end
+			assert_raises(ArgumentError) { @list.load_sorted [1, 2], [:a] }
+			assert_raises(ArgumentError) do
+				@list.load_sorted [1, "one"], [:a, :b]
+			end
+			assert_equal [1, 2, 3], @list.keys
+		end
+
+		def test_finger
+			list = RDSL::Skiplist.new
+			0.step(398, 2) { |key| list.store key, key }
+			[399, 397, 1, 201, 199, 400, 3].each do |key|
+				list.store key, -key
+			end
+			assert_equal -201, list.fetch(201)
+			assert_equal 398, list.fetch(398)
+			assert_equal 0, list.fetch(0)
+			assert_equal -397, list.delete(397)
+			assert_equal 396, list.delete(396)
+			assert_equal -399, list.fetch(399)
+			assert_nil list.delete(395)
+			assert_equal 205, list.size
+			keys = (0..398).select { |key| key.even? } +
+				[399, 1, 201, 199, 400, 3] - [396]
+			assert_equal keys.sort, list.keys
+			keys.each { |key| assert list.key?(key) }
+			assert !list.key?(397)
+		end
+
+		# A key whose <=> raises on the _n_th call.
+		class Bomb
+			include Comparable
+			attr_reader :key
+			class << self; attr_accessor :fuse; end
+			def initialize(key) @key = key end
+			def <=>(other)
+				fuse = Bomb.fuse
+				raise "boom" if fuse and (Bomb.fuse = fuse - 1) == 0
+				@key <=> other.key
+			end
+		end
+
+		def test_raising_compare
+			srand 2004
+			20.times do
+				list = RDSL::Skiplist.new
+				100.times { list.store Bomb.new(rand(500)), nil }
+				Bomb.fuse = 1 + rand(12)
+				begin
+					list.store Bomb.new(rand(500)), nil
+				rescue RuntimeError
+				end
+				Bomb.fuse = nil
+				100.times { list.store Bomb.new(rand(500)), nil }
+				keys = list.keys.map { |key| key.key }
+				assert_equal keys.sort.uniq, keys
+			end
+		end
+
+		def test_clear
+			@list.clear
+			assert_equal 0, @list.size
+			assert_raises(IndexError) { @list.fetch 1935 }
 		end
 	end
 end
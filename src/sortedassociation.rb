@@ -3,7 +3,9 @@ require 'association'
 module RDSL
 
 # The Sorted Association module assumes that the including class has an +each+
-# method which takes as an optional argument the order of the traversal.
+# method which takes as an optional argument the order of the traversal.  It
+# should yield the key and value as separate arguments, or just one of them,
+# depending on its first two arguments.
 module SortedAssociation
 	include Association
 
@@ -14,42 +16,194 @@ module SortedAssociation
 	DESCENDING = 1
 
 	# Executes the block once for each key-value pair.  The keys are given
-	# in the order specified by _order_.
+	# in the order specified by _order_.  Returns an Enumerator if no block
+	# is given.
 	def each_pair(order = ASCENDING)
+		return enum_for(:each_pair, order) unless block_given?
 		each true, true, order do |key, value| yield key, value end
 	end
 
 	# Executes the block once for each key.  The keys are given in the
-	# order specified by _order_.
+	# order specified by _order_.  Returns an Enumerator if no block is
+	# given.
 	def each_key(order = ASCENDING)
+		return enum_for(:each_key, order) unless block_given?
 		each true, false, order do |key| yield key end
 	end
 
 	# Executes the block once for each value.  The values are given in the
-	# order specified by _order_, relative to the keys.
+	# order specified by _order_, relative to the keys.  Returns an
+	# Enumerator if no block is given.
 	def each_value(order = ASCENDING)
+		return enum_for(:each_value, order) unless block_given?
 		each false, true, order do |value| yield value end
 	end
 
-	# Returns +true+ if _key_ is present in the Association.
-	def key?(key)
-		each_key do |k|
-			break if k > key
-			return true if k == key
+	# Executes the block once for each key-value pair, starting with the
+	# smallest key not less than _key_, if _order_ is ASCENDING, or the
+	# largest key not greater than _key_, if it's DESCENDING.  Returns an
+	# Enumerator if no block is given.  Including classes should override
+	# this with a method that finds the first pair in O(log n) time; this
+	# one has to skip past the pairs before it.
+	def each_from(key, order = ASCENDING)
+		return enum_for(:each_from, key, order) unless block_given?
+		each true, true, order do |k, value|
+			next if order == ASCENDING ? k < key : k > key
+			yield k, value
 		end
+	end
+
+	# Returns +true+ if _key_ is present in the Association.  This takes as
+	# long as finding the first pair with SortedAssociation#each_from.
+	def key?(key)
+		each_from key do |k, value| return k == key end
 		return false
 	end
 
 	# Returns the key-value pair in the SortedAssociation with the
-	# maximium key.
+	# maximium key, or +nil+ if it's empty.
 	def max
-		each_pair DESCENDING do |pair| return pair end
+		each true, true, DESCENDING do |key, value| return [key, value] end
+		return nil
 	end
 
 	# Returns the key-value pair in the SortedAssociation with the minimum
-	# key.
+	# key, or +nil+ if it's empty.
 	def min
-		each_pair ASCENDING do |pair| return pair end
+		each true, true, ASCENDING do |key, value| return [key, value] end
+		return nil
+	end
+
+	# Replaces the contents of the SortedAssociation with the pairs of
+	# _keys_ and _values_, where _keys_ must be in strictly ascending order,
+	# or an ArgumentError is raised.  Returns the SortedAssociation itself.
+	# This is the hook that the bulk operations below build on.  Including
+	# classes should override it with a method that builds their structure
+	# in O(n) time, after checking its arguments with
+	# SortedAssociation#check_sorted; this one simply stores the pairs one
+	# by one.
+	def load_sorted(keys, values)
+		check_sorted keys, values
+		clear
+		keys.each_index do |i| store keys[i], values[i] end
+		return self
+	end
+
+	# Returns two arrays, with the keys and the values of the
+	# SortedAssociation, in ascending order of the keys.
+	def to_sorted_arrays
+		n = length
+		keys, values, i = Array.new(n), Array.new(n), 0
+		each do |key, value|
+			keys[i], values[i] = key, value
+			i += 1
+		end
+		return [keys, values]
+	end
+
+	# Updates the SortedAssociation with the contents of _assoc_, see
+	# Association#update.  If _assoc_ is a SortedAssociation as well, and
+	# isn't much smaller than this one, the pairs of the two are merged,
+	# and the result is loaded with SortedAssociation#load_sorted, which
+	# takes O(n + m) time instead of the O(m log n) time of storing each
+	# pair.
+	def update(assoc)
+		assoc = assoc.to_assoc
+		n, m = length, assoc.length
+		unless assoc.is_a? SortedAssociation and m > 0 and
+		       m * Math.log(n + 2) > n
+			return super
+		end
+
+		a_keys, a_values = to_sorted_arrays
+		b_keys, b_values = assoc.to_sorted_arrays
+		keys, values = Array.new(n + m), Array.new(n + m)
+		i = j = k = 0
+		while i < n and j < m
+			c = a_keys[i] <=> b_keys[j]
+			if c < 0
+				keys[k], values[k] = a_keys[i], a_values[i]
+				i += 1
+			else
+				i += 1 if c == 0
+				keys[k], values[k] = b_keys[j], b_values[j]
+				j += 1
+			end
+			k += 1
+		end
+		while i < n
+			keys[k], values[k] = a_keys[i], a_values[i]
+			i += 1
+			k += 1
+		end
+		while j < m
+			keys[k], values[k] = b_keys[j], b_values[j]
+			j += 1
+			k += 1
+		end
+		keys.slice! k..-1
+		values.slice! k..-1
+		return load_sorted(keys, values)
+	end
+
+	# Replaces the contents of the SortedAssociation with that of _assoc_.
+	# If _assoc_ is a SortedAssociation, this takes O(n) time.
+	def replace(assoc)
+		assoc = assoc.to_assoc
+		return super unless assoc.is_a? SortedAssociation
+		keys, values = assoc.to_sorted_arrays
+		return load_sorted(keys, values)
+	end
+
+	# Returns a SortedAssociation containing the current values as keys
+	# and the keys as values, see Association#invert.  The pairs are
+	# sorted by value all at once and then loaded with
+	# SortedAssociation#load_sorted, instead of being stored one by one.
+	# As with storing them in order, the largest key wins when several
+	# keys share a value.
+	def invert
+		keys, values = to_sorted_arrays
+		order = (0...values.size).sort_by { |i| values[i] }
+		new_keys, new_values = Array.new(order.size), Array.new(order.size)
+		k = 0
+		order.each do |i|
+			if k == 0 or new_keys[k - 1] != values[i]
+				new_keys[k], new_values[k] = values[i], keys[i]
+				k += 1
+			elsif (keys[i] <=> new_values[k - 1]) > 0
+				new_values[k - 1] = keys[i]
+			end
+		end
+		new_keys.slice! k..-1
+		new_values.slice! k..-1
+		return self.class.new.load_sorted(new_keys, new_values)
+	end
+
+	# See SortedAssociation#key?
+	alias has_key? key?
+
+	# See SortedAssociation#key?
+	alias include? key?
+
+	# See SortedAssociation#key?.
+	alias member? key?
+
+private
+
+	# Raises an ArgumentError unless _keys_ and _values_ are of the same
+	# length and _keys_ are in strictly ascending order, as a structure
+	# built from them without comparing them would be left out of order.
+	# This is done before load_sorted changes anything, as <=> may raise.
+	def check_sorted(keys, values)
+		if keys.size != values.size
+			raise ArgumentError, "keys and values differ in length"
+		end
+		1.upto keys.size - 1 do |i|
+			c = keys[i - 1] <=> keys[i]
+			unless c != nil and c < 0
+				raise ArgumentError, "keys aren't in ascending order"
+			end
+		end
 	end
 end
 
@@ -1,35 +1,86 @@
+begin
+	require 'rdsl'
+rescue LoadError
+end
+
+if defined? RDSL::Pattern
+	class RDSL::Pattern
+		# Returns a Pattern for _needle_.  The last Pattern returned is
+		# reused if it was for the same needle, so that searching for
+		# the same String over and over again only builds its tables
+		# once.
+		def self.for(needle)
+			last = @last
+			unless last and last.source == needle
+				last = @last = new needle
+			end
+			return last
+		end
+	end
+end
+
 class String
 	alias _old_index index
 
+	# Searches for _x_ in the String, see the original String#index.  If
+	# _x_ is a String, or a precompiled RDSL::Pattern or
+	# RDSL::MultiPattern, we look for it ourselves, natively if the RDSL
+	# extension is available.  Its offsets are in bytes, so we only use it
+	# as it is for Strings where bytes and characters are one and the same.
+	# For the rest, we leave Strings and Patterns to the original, and
+	# translate the offsets of a MultiPattern between characters and bytes.
 	def index(x, pos = 0)
-		if not x.is_a? String
+		bytes = (not respond_to? :ascii_only? or ascii_only?)
+		if defined? RDSL::Pattern and x.is_a? RDSL::MultiPattern
+			bytes ? x.index(self, pos) : multi_pattern_index(x, pos)
+		elsif defined? RDSL::Pattern and x.is_a? RDSL::Pattern
+			bytes ? x.index(self, pos) : _old_index(x.source, pos)
+		elsif not x.is_a? String or not bytes
 			_old_index x, pos
-		else
+		elsif not defined? RDSL::Pattern
 			bmh_index x, pos
+		else
+			RDSL::Pattern.for(x).index self, pos
 		end
 	end
 
+	# Searches for the MultiPattern _x_ in a String whose characters may be
+	# more than one byte long, translating _pos_ to a byte offset and the
+	# match back to a character offset.
+	def multi_pattern_index(x, pos)
+		pos += length if pos < 0
+		return nil if pos < 0 or pos > length
+		match = x.index self, self[0, pos].bytesize
+		return match && byteslice(0, match).length
+	end
+
+	# Searches for _x_ with the Boyer-Moore-Horspool algorithm.  It reads
+	# bytes with getbyte, as String#[] returns characters since Ruby 1.9,
+	# so _pos_ and the match are byte offsets.
 	def bmh_index(x, pos = 0)
-		n = length
-		m = x.length
+		n = bytesize
+		m = x.bytesize
 
 		# skip preprocessing if unnecessary
 		if pos > n - m
 			return nil
+		elsif m == 0
+			return pos
 		end
 
-		# FIXME: bad to use ASCII limit here.
 		bad_char = Array.new 256, m
 
 		i = 0
-		x[0..-2].each_byte do |byte|
+		x.each_byte do |byte|
+			break if i == m - 1
 			bad_char[byte] = m - i - 1
 			i += 1
 		end
 
+		last = x.getbyte(m - 1)
 		while pos <= n - m
-			c = self[pos + m - 1]
-			if x[m - 1] == c and x == self[pos, m]
+			c = getbyte(pos + m - 1)
+			if last == c and x == byteslice(pos, m)
 				return pos
 			end
 			pos += bad_char[c]
@@ -114,4 +165,47 @@ if __FILE__ == $0
 		i += 1
 	end
 	puts "found #{x} #{i} times in searchspace. time: #{Time.new - time}"
+
+	if defined? RDSL::Pattern
+		pattern = RDSL::Pattern.new x
+		[:index, :bmh_index, :kmp_index].each do |search|
+			pos = 0
+			i = 0
+			time = Time.new
+			while pos = pattern.send(search, s, pos)
+				pos += 1
+				i += 1
+			end
+			puts "found #{x} #{i} times in searchspace with " +
+				"Pattern##{search}. time: #{Time.new - time}"
+		end
+
+		i = 0
+		time = Time.new
+		pattern.each_match_in_file "../test/searchspace" do i += 1 end
+		puts "found #{x} #{i} times in searchspace, searching the " +
+			"file itself. time: #{Time.new - time}"
+
+		time = Time.new
+		i = pattern.count s
+		puts "found #{x} #{i} times in searchspace with " +
+			"Pattern#count. time: #{Time.new - time}"
+
+		time = Time.new
+		i = pattern.count_in_file "../test/searchspace"
+		puts "found #{x} #{i} times in searchspace with " +
+			"Pattern#count_in_file. time: #{Time.new - time}"
+
+		xs = %w[GCAGAGAG CATTAG TTTAAA GATTACA]
+		counts = Array.new xs.size, 0
+		time = Time.new
+		RDSL::MultiPattern.new(xs).each_match(s) do |id, offset|
+			counts[id] += 1
+		end
+		xs.each_index do |id|
+			puts "found #{xs[id]} #{counts[id]} times in searchspace " +
+				"with MultiPattern#each_match."
+		end
+		puts "time: #{Time.new - time}"
+	end
 end
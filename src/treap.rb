@@ -7,25 +7,34 @@ module RDSL
 # interface is stringently kept the same as that of Ruby Hashes.  This means
 # that a Treap can be used as a drop in for a Hash when the data needs to be in
 # a sorted order.
+#
+# Cloning a Treap takes O(1) time, as the clone shares the nodes of the
+# original.  Each node is owned by the Treap that created it, and a Treap only
+# ever modifies the nodes that it owns.  A node that it doesn't own is copied
+# first, along with the nodes on the path down to it, so an update takes
+# O(log n) extra memory in the Treap that makes it, and neither the clone nor
+# the original sees it.  Nodes are owned through tokens, and as a clone and its
+# original both get new ones, neither owns any of the nodes that they share.
 class Treap
 	include SortedAssociation
 
 	# The default value for non-existent keys.
 	attr_accessor :default
 
-	# The number of key-value pairs; same value returned by Treap#length.
-	attr_reader :size
-
 	# Creates a +Treap+.  A default value may also be specified.
 	def initialize(default = nil)
 		@tree, @default, @size = nil, default, 0
+		@seed = rand PRIORITY_MASK + 1
+		@owner, @adopted = Object.new, nil
 	end
 
-	#def clone
-	#	treap = Treap.new
-	#	each do |pair| treap.store pair end
-	#	return pair
-	#end
+	# Makes this Treap a copy of _other_, see Object#clone, by sharing its
+	# nodes, which neither of them owns afterwards.
+	def initialize_copy(other)
+		super
+		@owner, @adopted = Object.new, nil
+		other.disown
+	end
 
 	# Creates a +Treap+. Each successive pair is treated as a key-value
 	# pair.
@@ -40,11 +49,48 @@ class Treap
 	end
 
 	# Associates _key_ with _value_.  The value of this expression is
-	# _value_.
+	# _value_.  If _key_ is already present, its value is replaced.
+	#
+	# This is done in one descent from the root.  On the way down we look
+	# for _key_, and remember the first node whose priority is larger than
+	# that of the new node, as that's where the new node goes if _key_
+	# isn't found.  The subtree rooted there is then split by _key_, and
+	# its halves become the children of the new node.  As one or the other
+	# modifies the nodes on the way down, we take ownership of them as we
+	# pass them.  Taking ownership of a node only replaces it with a copy,
+	# and the split compares all keys before it moves any node, so an
+	# exception raised by comparing keys leaves the Treap as it was.
 	def store(key, value)
-		int_max = 2 ** (1.size * 8) # OMG!
-		@tree = insert @tree, Node.new(key, value, rand(int_max))
-		@size += 1		# OMG: check it out
+		priority = next_priority
+		parent, node, left = nil, @tree, false
+		at, at_parent, at_left = nil, nil, false
+		while node != nil
+			node = own_child parent, node
+			if key == node.key
+				node.value = value
+				return value
+			end
+			if at == nil and node.priority > priority
+				at, at_parent, at_left = node, parent, left
+			end
+			parent, left = node, key < node.key
+			node = left ? node.left : node.right
+		end
+
+		new_node = Node.new key, value, priority, @owner
+		if at == nil
+			at_parent, at_left = parent, left
+		else
+			new_node.left, _, new_node.right = split_tree at, key
+		end
+		if at_parent == nil
+			@tree = new_node
+		elsif at_left
+			at_parent.left = new_node
+		else
+			at_parent.right = new_node
+		end
+		@size += 1 if @size != nil
 		return value
 	end
 
@@ -83,86 +129,228 @@ class Treap
 	end
 
 	# Executes the block once for each key-value pair.  Pairs are given in
-	# the order specified by _order_, relative to the keys.
+	# the order specified by _order_, relative to the keys.  The key and the
+	# value are yielded as separate arguments, or only one of them, as
+	# specified by _with_key_ and _with_value_.  Returns an Enumerator if
+	# no block is given.
 	def each(with_key = true, with_value = true, order = ASCENDING)
+		unless block_given?
+			return enum_for(:each, with_key, with_value, order)
+		end
 		stack = []
-		node = @tree
-		build_order = (order == ASCENDING) ? :left : :right
-		stack_order = (order == ASCENDING) ? :right : :left
-
-		while node != nil
-			stack << node
-			node = node.send build_order
+		push_path stack, @tree, nil, order
+		if with_key and with_value
+			each_node stack, order do |node| yield node.key, node.value end
+		elsif with_key
+			each_node stack, order do |node| yield node.key end
+		elsif with_value
+			each_node stack, order do |node| yield node.value end
+		else
+			each_node stack, order do |node| yield end
 		end
+		return self
+	end
 
-		while !stack.empty?
-			node = stack.last
-			if node.send(stack_order) == nil
-				tmp = stack.pop
-				while !stack.empty? and
-				      stack.last.send(stack_order) == tmp
-					tmp = stack.pop
-				end
-			else
-				tmp = node.send stack_order
-				while tmp != nil
-					stack << tmp
-					tmp = tmp.send build_order
-				end
+	# Executes the block once for each key-value pair, starting at _key_,
+	# see SortedAssociation#each_from.  Finding the first pair takes
+	# O(log n) time.
+	def each_from(key, order = ASCENDING)
+		return enum_for(:each_from, key, order) unless block_given?
+		stack = []
+		push_path stack, @tree, key, order
+		each_node stack, order do |node| yield node.key, node.value end
+		return self
+	end
+
+	# Replaces the contents of the Treap with the pairs of _keys_ and
+	# _values_, where _keys_ must be in strictly ascending order, see
+	# SortedAssociation#load_sorted.  The tree is built in O(n) time:
+	# each new node goes at the end of the right spine of the tree built
+	# so far, and is rotated up past the nodes there with larger
+	# priorities, which then become its left subtree.
+	def load_sorted(keys, values)
+		check_sorted keys, values
+		spine = []
+		keys.each_index do |i|
+			node = Node.new keys[i], values[i], next_priority, @owner
+			last = nil
+			while not spine.empty? and spine.last.priority > node.priority
+				last = spine.pop
 			end
-			
-			values = []
-			values << node.key if with_key
-			values << node.value if with_value
-			yield values	# XXX: faster with *values ???
+			node.left = last
+			spine.last.right = node unless spine.empty?
+			spine << node
 		end
+		@tree, @size = spine.first, keys.size
+		return self
 	end
 
-	# Returns the number of key-value pairs in the Treap.
+	# Returns the number of key-value pairs in the Treap.  The trees made by
+	# the operations below don't know their size, so it's counted the first
+	# time it's asked for.
 	def length
+		if @size == nil
+			@size = 0
+			each false, false do @size += 1 end
+		end
 		@size
 	end
 
+	alias size length
+
+	# Splits the Treap into a Treap with the keys smaller than _key_ and
+	# one with the rest, and returns them both, leaving the Treap as it is.
+	# This takes O(log n) time, as the two Treaps are made out of a clone of
+	# this one, see Treap#split!.
+	def split(key)
+		return clone.split!(key)
+	end
+
+	# Works like Treap#split, except that the two Treaps are made out of
+	# the nodes of this one, which is left empty.
+	def split!(key)
+		left, mid, right = split_tree take_tree, key
+		right = join_trees mid, right if mid != nil
+		owner = disown
+		return [new_with_tree(left, owner), new_with_tree(right, owner)]
+	end
+
+	# Joins this Treap and _other_, where all keys of this Treap must be
+	# smaller than those of _other_, into a new Treap, and returns it.
+	# This takes O(log n) time, and leaves the two Treaps as they are, as
+	# the new Treap is made out of clones of them, see Treap#join!.
+	def join(other)
+		return clone.join!(other.clone)
+	end
+
+	# Works like Treap#join, except that the new Treap is made out of the
+	# nodes of the two Treaps, which are left empty.
+	def join!(other)
+		a, b = @tree, other.tree
+		if a != nil and b != nil
+			a = a.right while a.right != nil
+			b = b.left while b.left != nil
+			unless a.key < b.key
+				raise ArgumentError, "keys of Treaps to join overlap"
+			end
+		end
+		return adopting(other) { |a, b| join_trees a, b }
+	end
+
+	# Joins the Treaps _a_ and _b_, see Treap#join.
+	def Treap.join(a, b)
+		a.join b
+	end
+
+	# Returns a new Treap with the keys of both this Treap and _other_.
+	# Values of keys present in both are taken from _other_.  Like
+	# Treap#split and Treap.join, this works on clones of the two Treaps,
+	# which are left as they are.  With m and n being the sizes of the
+	# smaller and larger of them, this takes O(m log(n/m + 1)) time, which
+	# is much faster than storing the pairs of one Treap in the other.
+	def union(other)
+		return clone.union!(other.clone)
+	end
+
+	# Works like Treap#union, except that the new Treap is made out of the
+	# nodes of the two Treaps, which are left empty.
+	def union!(other)
+		return adopting(other) { |a, b| union_trees a, b }
+	end
+
+	# Returns a new Treap with the keys of this Treap that are also in
+	# _other_, and their values in this Treap.  Works like Treap#union
+	# otherwise.
+	def intersection(other)
+		return clone.intersection!(other.clone)
+	end
+
+	# Works like Treap#intersection, but empties the two Treaps, see
+	# Treap#union!.
+	def intersection!(other)
+		return adopting(other) { |a, b| intersect_trees a, b }
+	end
+
+	# Returns a new Treap with the keys of this Treap that aren't in
+	# _other_.  Works like Treap#union otherwise.
+	def difference(other)
+		return clone.difference!(other.clone)
+	end
+
+	# Works like Treap#difference, but empties the two Treaps, see
+	# Treap#union!.
+	def difference!(other)
+		return adopting(other) { |a, b| subtract_trees a, b }
+	end
+
 	# Returns a string representation of the Treap.
 	def to_s
 		@tree.to_s
 	end
 
+protected
+
+	# The root of the tree of the Treap.
+	attr_reader :tree
+
+	# Sets the tree of the Treap, forgetting its size.
+	def tree=(tree)
+		@tree, @size = tree, nil
+	end
+
+	# The token of the nodes that the Treap owns.
+	attr_accessor :owner
+
+	# Gives the Treap a new token, so that it no longer owns any nodes, and
+	# returns the old one.
+	def disown
+		owner, @owner = @owner, Object.new
+		return owner
+	end
+
+	# Returns a new Treap, with the same default value as this one, made
+	# out of the nodes of _tree_, which it owns if they're owned by _owner_.
+	def new_with_tree(tree, owner = disown)
+		treap = Treap.new @default
+		treap.tree, treap.owner = tree, owner
+		return treap
+	end
+
+	# Returns a new Treap made out of the tree that the block returns when
+	# given the trees of this Treap and _other_, both of which are left
+	# empty.  The block may modify the nodes of _other_ that it owns as well
+	# as our own.
+	def adopting(other)
+		@adopted = other.owner
+		return new_with_tree(yield(take_tree, other.take_tree))
+	ensure
+		@adopted = nil
+	end
+
+	# Returns the tree of the Treap, leaving it empty.
+	def take_tree
+		tree = @tree
+		clear
+		return tree
+	end
+
 private
 
 	# Represents a node in a tree.  Can probably be useful outside of the
 	# Treap class; only time will tell.
 	class Node
-		def initialize(key, value, priority)
+		def initialize(key, value, priority, owner)
 			@key, @value, @priority = key, value, priority
 			@right, @left = nil, nil
+			@owner = owner
 		end
 
-		# Rotate the tree to the right.  Returns the rotated tree.
-		def rotate_right
-			tmp, @left, tmp.right = @left, @left.right, self
-			return tmp
-		end
-
-		# Rotate the tree to the left.  Returns the rotated tree.
-		def rotate_left
-			tmp, @right, tmp.left = @right, @right.left, self
-			return tmp
-		end
-
-		# Delete the root node of the tree.  Returns the updated tree.
-		def pop_root
-			return @right if @left == nil
-			return @left if @right == nil
-			tmp = nil
-			if @left.priority >= @right.priority
-				tmp = rotate_left
-				tmp.left = pop_root
-			else
-				tmp = rotate_right
-				tmp.right = pop_root
-			end
-			return tmp
+		# Returns a copy of the node, with the same children, owned by
+		# _owner_.
+		def copy(owner)
+			node = Node.new @key, @value, @priority, owner
+			node.left, node.right = @left, @right
+			return node
 		end
 
 		def to_s
@@ -170,7 +358,7 @@ private
 		end
 
 		attr_accessor :key, :value, :left, :right
-		attr_reader :priority
+		attr_reader :priority, :owner
 
 		def to_s_impl(level)
 			str = ""
@@ -182,36 +370,239 @@ private
 		end
 	end
 
-	def insert(tree, node)
-		return node if tree == nil
-		if node.key < tree.key
-			tree.left = insert(tree.left, node)
-			if tree.priority > tree.left.priority
-				tree = tree.rotate_right
+	# Pushes the nodes of _tree_ that we pass on the way down to the first
+	# node at or after _key_ in _order_, and that come after it in _order_,
+	# on _stack_.  With no _key_, that's the first node of _tree_.
+	def push_path(stack, tree, key, order)
+		if order == ASCENDING
+			while tree != nil
+				if key == nil or not tree.key < key
+					stack << tree
+					tree = tree.left
+				else
+					tree = tree.right
+				end
+			end
+		else
+			while tree != nil
+				if key == nil or not tree.key > key
+					stack << tree
+					tree = tree.right
+				else
+					tree = tree.left
+				end
+			end
+		end
+	end
+
+	# Yields the nodes on _stack_, primed by push_path, in _order_, along
+	# with the nodes after them.
+	def each_node(stack, order)
+		while (node = stack.pop) != nil
+			yield node
+			push_path stack, (order == ASCENDING) ? node.right : node.left,
+				  nil, order
+		end
+	end
+
+	# Returns _node_ if the Treap owns it, else a copy of it that it owns.
+	# The copy must replace _node_ in its parent, which must be owned as
+	# well, see own_child.
+	def own(node)
+		if node.owner.equal? @owner or node.owner.equal? @adopted
+			return node
+		end
+		return node.copy(@owner)
+	end
+
+	# Returns _node_, the child of _parent_, or the root if _parent_ is
+	# +nil+, if the Treap owns it, else a copy of it that replaces it.
+	def own_child(parent, node)
+		copy = own node
+		return node if copy.equal? node
+		if parent == nil
+			@tree = copy
+		elsif parent.left.equal? node
+			parent.left = copy
+		else
+			parent.right = copy
+		end
+		return copy
+	end
+
+	# Priorities are 30-bit numbers, so that they're always Fixnums.
+	PRIORITY_MASK = 0x3fffffff
+
+	# Returns the priority of a new node.  Priorities come from a linear
+	# congruential generator, which is plenty random enough for balancing
+	# the tree, and much cheaper than Kernel#rand.
+	def next_priority
+		@seed = (@seed * 69069 + 1) & PRIORITY_MASK
+	end
+
+	# Splits _tree_ into a tree with the keys smaller than _key_ and one
+	# with the keys larger than it, and returns them along with the node
+	# with _key_, if there is one, or +nil+, in the middle.  We walk down
+	# the search path of _key_, handing each node, along with the subtree
+	# on its far side, to the tree it belongs in, hanging it where the
+	# previous node handed to that tree left a hole.  The whole path is
+	# found before any node is moved, so that if comparing the keys raises
+	# an exception, _tree_ is left as it was.
+	def split_tree(tree, key)
+		path, lefts, mid = [], [], nil
+		while tree != nil
+			if key == tree.key
+				mid = tree
+				break
+			end
+			path << tree
+			lefts << (key < tree.key)
+			tree = lefts.last ? tree.left : tree.right
+		end
+
+		left = right = left_hole = right_hole = nil
+		path.each_index do |i|
+			tree = own path[i]
+			if lefts[i]
+				if right_hole == nil
+					right = tree
+				else
+					right_hole.left = tree
+				end
+				right_hole = tree
+			else
+				if left_hole == nil
+					left = tree
+				else
+					left_hole.right = tree
+				end
+				left_hole = tree
+			end
+		end
+		mid = own mid if mid != nil
+
+		# what's below the node with key goes to either side as well
+		below_left, below_right = nil, nil
+		if mid != nil
+			below_left, below_right = mid.left, mid.right
+			mid.left = mid.right = nil
+		end
+		if left_hole == nil
+			left = below_left
+		else
+			left_hole.right = below_left
+		end
+		if right_hole == nil
+			right = below_right
+		else
+			right_hole.left = below_right
+		end
+		return [left, mid, right]
+	end
+
+	# Joins the trees _a_ and _b_, where all keys of _a_ are smaller than
+	# those of _b_, and returns the result.  We walk down the right spine of
+	# _a_ and the left spine of _b_, merging them by priority.
+	def join_trees(a, b)
+		root = hole = nil
+		while a != nil and b != nil
+			if a.priority <= b.priority
+				node = own a
+				a = node.right
+			else
+				node = own b
+				b = node.left
 			end
-		elsif node.key > tree.key
-			tree.right = insert(tree.right, node)
-			if tree.priority > tree.right.priority
-				tree = tree.rotate_left
+			if hole == nil
+				root = node
+			elsif node.key < hole.key
+				hole.left = node
+			else
+				hole.right = node
 			end
+			hole = node
+		end
+
+		rest = (a != nil) ? a : b
+		if hole == nil
+			root = rest
+		elsif rest != nil and rest.key < hole.key
+			hole.left = rest
 		else
-			tree.value = node.value
-			@size -= 1	# OMG: should this be forbidden?!
+			hole.right = rest
 		end
-		return tree
+		return root
 	end
 
+	# Returns the union of the trees _a_ and _b_.  The root with the
+	# smallest priority stays the root, the other tree is split by its key,
+	# and the halves are united with the subtrees of the root.  Values from
+	# _b_ win if _b_wins_, else values from _a_ do.
+	def union_trees(a, b, b_wins = true)
+		return b if a == nil
+		return a if b == nil
+		if a.priority > b.priority
+			a, b, b_wins = b, a, !b_wins
+		end
+		a = own a
+		left, mid, right = split_tree b, a.key
+		a.value = mid.value if mid != nil and b_wins
+		a.left = union_trees a.left, left, b_wins
+		a.right = union_trees a.right, right, b_wins
+		return a
+	end
+
+	# Returns the intersection of the trees _a_ and _b_, with the nodes of
+	# _a_.  _b_ is split by the key of the root of _a_, and the halves are
+	# intersected with the subtrees of the root, which is kept only if its
+	# key was in _b_.
+	def intersect_trees(a, b)
+		return nil if a == nil or b == nil
+		left, mid, right = split_tree b, a.key
+		left = intersect_trees a.left, left
+		right = intersect_trees a.right, right
+		return join_trees(left, right) if mid == nil
+		a = own a
+		a.left, a.right = left, right
+		return a
+	end
+
+	# Returns the nodes of _a_ whose keys aren't in _b_.  Works like
+	# intersect_trees, except that the root is kept only if its key wasn't
+	# in _b_.
+	def subtract_trees(a, b)
+		return a if a == nil or b == nil
+		left, mid, right = split_tree b, a.key
+		left = subtract_trees a.left, left
+		right = subtract_trees a.right, right
+		return join_trees(left, right) if mid != nil
+		a = own a
+		a.left, a.right = left, right
+		return a
+	end
+
+	# Removes _key_ from _tree_, returning its value, or +nil+, and the new
+	# tree.  Only the nodes on the path down to _key_ whose children change
+	# are taken ownership of, so a missing key copies nothing.
 	def remove(tree, key)
 		return [nil, nil] if tree == nil
 		old = nil
 		if key < tree.key
-			old, tree.left = remove(tree.left, key)
+			old, left = remove(tree.left, key)
+			unless left.equal? tree.left
+				tree = own tree
+				tree.left = left
+			end
 		elsif key > tree.key
-			old, tree.right = remove(tree.right, key)
+			old, right = remove(tree.right, key)
+			unless right.equal? tree.right
+				tree = own tree
+				tree.right = right
+			end
 		else
 			old = tree.value
-			tree = tree.pop_root
-			@size -= 1
+			tree = join_trees tree.left, tree.right
+			@size -= 1 if @size != nil
 		end
 		return [old, tree]
 	end
@@ -224,7 +615,7 @@ if __FILE__ == $0 or defined? RDSL::DEBUG
 	require 'test/unit'
 
 	class TreapTest < Test::Unit::TestCase
-		def set_up
+		def setup
 			@treap = RDSL::Treap[1935, "Elvis Presley",
 						1926, "Chuck Berry",
 						1941, "Bob Dylan",
@@ -253,6 +644,170 @@ if __FILE__ == $0 or defined? RDSL::DEBUG
 			assert_equal "Elvis Presley", @treap.fetch(1935)
 			assert_equal @treap.fetch(1935), @treap[1935]
 		end
+
+		def test_store_existing
+			assert_equal "Elvis", @treap.store(1935, "Elvis")
+			assert_equal "Elvis", @treap.fetch(1935)
+			assert_equal 5, @treap.size
+		end
+
+		def test_delete
+			assert_equal "Bob Dylan", @treap.delete(1941)
+			assert_nil @treap.delete(1941)
+			assert_equal 4, @treap.size
+		end
+
+		def keys_of(treap)
+			keys = []
+			treap.each_pair { |key, value| keys << key }
+			return keys
+		end
+
+		def test_each_from
+			keys = []
+			@treap.each_from(1930) { |key, value| keys << key }
+			assert_equal [1935, 1936, 1941], keys
+			keys = []
+			@treap.each_from(1936, RDSL::SortedAssociation::DESCENDING) do
+				|key, value| keys << key
+			end
+			assert_equal [1936, 1935, 1926, 1915], keys
+			assert_equal [[1941, "Bob Dylan"]], @treap.each_from(1940).to_a
+		end
+
+		def test_key
+			assert @treap.key?(1941)
+			assert !@treap.key?(1940)
+			assert !@treap.key?(1950)
+		end
+
+		def test_update_and_invert
+			other = RDSL::Treap[1926, "Little Richard",
+						1932, "Elvis Presley"]
+			assert_same @treap, @treap.update(other)
+			assert_equal [1915, 1926, 1932, 1935, 1936, 1941], @treap.keys
+			assert_equal "Little Richard", @treap.fetch(1926)
+			inverse = @treap.invert
+			assert_equal 1935, inverse.fetch("Elvis Presley")
+			assert_equal 5, inverse.size
+			@treap.replace RDSL::Treap[1, "one"]
+			assert_equal [[1, "one"]], @treap.each_pair.to_a
+		end
+
+		def test_load_sorted
+			assert_same @treap, @treap.load_sorted([1, 2, 3], [:a, :b, :c])
+			assert_equal [1, 2, 3], @treap.keys
+			assert_equal :b, @treap.fetch(2)
+			[[3, 1, 2], [1, 2, 2]].each do |keys|
+				assert_raises(ArgumentError) do
+					@treap.load_sorted keys, [:a, :b, :c]
+				end
+				assert_equal [1, 2, 3], @treap.keys
+			end
+			assert_raises(ArgumentError) { @treap.load_sorted [1, 2], [:a] }
+			assert_raises(ArgumentError) do
+				@treap.load_sorted [1, "one"], [:a, :b]
+			end
+			assert_equal [1, 2, 3], @treap.keys
+		end
+
+		def test_split_and_join
+			left, right = @treap.split 1935
+			assert_equal 5, @treap.size
+			assert_equal [1915, 1926], keys_of(left)
+			assert_equal [1935, 1936, 1941], keys_of(right)
+			assert_raises(ArgumentError) { RDSL::Treap.join right, left }
+			joined = RDSL::Treap.join left, right
+			assert_equal [1915, 1926, 1935, 1936, 1941], keys_of(joined)
+			assert_equal 5, joined.size
+			assert_equal [1915, 1926], keys_of(left)
+			left.store 1900, "Louis Armstrong"
+			joined.delete 1915
+			assert_equal [1900, 1915, 1926], keys_of(left)
+			assert_equal [1926, 1935, 1936, 1941], keys_of(joined)
+
+			left, right = @treap.split! 1935
+			assert_equal 0, @treap.size
+			joined = left.join! right
+			assert_equal 0, left.size + right.size
+			assert_equal [1915, 1926, 1935, 1936, 1941], keys_of(joined)
+		end
+
+		def test_set_algebra
+			other = RDSL::Treap[1926, "Chuck", 1955, "Tom Waits"]
+			union = @treap.union other
+			assert_equal 6, union.size
+			assert_equal "Chuck", union[1926]
+			assert_equal "Chuck Berry", @treap[1926]
+			assert_equal 5, @treap.size
+			assert_equal [1926, 1955], keys_of(other)
+
+			a = RDSL::Treap[1, :a, 2, :b, 3, :c]
+			b = RDSL::Treap[2, :x, 3, :y, 4, :z]
+			assert_equal [2, 3], keys_of(a.intersection(b))
+			assert_equal [1], keys_of(a.difference(b))
+			assert_equal [1, 2, 3], keys_of(a)
+			assert_equal [2, 3, 4], keys_of(b)
+			assert_equal [1], keys_of(a.difference!(b))
+			assert_equal 0, a.size + b.size
+		end
+
+		class Bomb
+			include Comparable
+			attr_reader :key
+			class << self; attr_accessor :fuse; end
+			def initialize(key) @key = key end
+			def <=>(other)
+				fuse = Bomb.fuse
+				raise "boom" if fuse and (Bomb.fuse = fuse - 1) == 0
+				@key <=> other.key
+			end
+		end
+
+		def test_raising_compare
+			srand 2004
+			treap = RDSL::Treap.new
+			keys = (0...64).map { |i| 2 * i }.sort_by { rand }
+			keys.each { |key| treap.store Bomb.new(key), key }
+			200.times do
+				Bomb.fuse = 1 + rand(40)
+				begin
+					treap.store Bomb.new(2 * rand(64) + 1), nil
+				rescue RuntimeError
+				end
+				Bomb.fuse = nil
+				stored = keys_of(treap).map { |key| key.key }
+				assert_equal treap.size, stored.size
+				assert_equal stored.sort, stored
+				treap.delete Bomb.new(stored.find { |k| k.odd? } || -1)
+			end
+			assert_equal keys.sort, keys_of(treap).map { |key| key.key }
+		end
+
+		def test_clone
+			clone = @treap.clone
+			assert_equal keys_of(@treap), keys_of(clone)
+			clone.store 1955, "Tom Waits"
+			clone.store 1935, "Elvis"
+			clone.delete 1941
+			@treap.store 1940, "John Lennon"
+			@treap.delete 1915
+			assert_equal [1926, 1935, 1936, 1940, 1941], keys_of(@treap)
+			assert_equal "Elvis Presley", @treap[1935]
+			assert_equal [1915, 1926, 1935, 1936, 1955], keys_of(clone)
+			assert_equal "Elvis", clone[1935]
+			assert_equal 5, clone.size
+
+			left, right = clone.clone.split 1930
+			assert_equal [1915, 1926], keys_of(left)
+			assert_equal 5, clone.size
+			copy = @treap.clone
+			union = copy.union RDSL::Treap[1926, "Chuck", 1950, "Jim"]
+			union.delete 1935
+			assert_equal "Chuck Berry", @treap[1926]
+			assert_equal [1926, 1935, 1936, 1940, 1941], keys_of(@treap)
+			assert_equal [1926, 1936, 1940, 1941, 1950], keys_of(union)
+		end
 	end
 
 	time = Time.now